@@ -93,6 +93,477 @@
 
 
 
+// =============================================================================
+// CONTROL DE MOVIMIENTO
+// =============================================================================
+
+/**
+ * @brief Ancho del pulso de paso en microsegundos
+ * 
+ * @note La mayoria de drivers (A4988, DRV8825, TB6600) requieren >= 2 us
+ */
+#define ANCHO_PULSO_PASO_US 2
+
+/**
+ * @brief Numero de bloques de pasos que puede tener en espera el generador
+ * 
+ * Cada bloque (BloquePasos) ocupa 54 bytes de RAM. Uno de los huecos queda
+ * siempre libre para distinguir cola llena de cola vacia. Los bloques
+ * entregados ya no se replanifican, asi que una cola corta hace que los ajustes
+ * de avance se noten antes; el resto de la anticipacion vive en el planificador.
+ */
+#define TAMANO_COLA_PASOS 4
+
+/**
+ * @brief Capacidad del buffer del planificador (bloques G-code por delante de la ejecucion)
+ * 
+ * Cada bloque (BloquePlanificador) ocupa 54 bytes de RAM, 864 con 16. Con 16
+ * bloques el interprete puede adelantarse lo suficiente para que los trabajos
+ * con miles de segmentos cortos no se detengan entre lineas.
+ */
+#define TAMANO_BUFFER_PLANIFICADOR 16
+
+/**
+ * @brief Periodo minimo del Timer1 en cuentas (0.5 us con prescaler 8)
+ * 
+ * Limita la frecuencia de interrupciones para que la ISR siempre termine
+ * antes de la siguiente comparacion.
+ */
+#define INTERVALO_MINIMO_TIMER 60
+
+/**
+ * @brief Tasa maxima de eventos de paso (eventos/s)
+ * 
+ * Es la de una interrupcion cada INTERVALO_MINIMO_TIMER cuentas sin
+ * sobremuestreo (~33 kHz), y queda por debajo del maximo de una tasa en
+ * Q16.16 (65535). En ningun eje los pasos/mm por la velocidad maxima pueden
+ * pasar de aqui (M92/M203).
+ */
+#define TASA_MAXIMA_EVENTOS (F_CPU / 8UL / INTERVALO_MINIMO_TIMER)
+
+/**
+ * @brief Pasos por milimetro de cada eje por defecto (ajustar segun la mecanica)
+ * 
+ * Los valores vigentes son los de la configuracion guardada en EEPROM
+ * (M92); estos solo se usan si no hay una valida.
+ */
+#define PASOS_POR_MM_X 80.0f
+#define PASOS_POR_MM_Y 80.0f
+#define PASOS_POR_MM_Z 80.0f
+
+/**
+ * @brief Posicion de la configuracion de la maquina en la EEPROM
+ * 
+ * Debe quedar por debajo de DIRECCION_EEPROM_MALLA.
+ */
+#define DIRECCION_EEPROM_AJUSTES 0
+
+/**
+ * @brief Version del formato de la configuracion en EEPROM
+ * 
+ * Subirla al cambiar AjustesMaquina: la configuracion guardada deja de ser
+ * valida y se arranca con los valores por defecto.
+ */
+#define VERSION_EEPROM_AJUSTES 1
+
+/**
+ * @brief Holgura (backlash) medida en el husillo de cada eje (mm)
+ * 
+ * Cuando un eje invierte su sentido se intercala un micro-movimiento de esta
+ * longitud que recoge el juego sin cambiar la posicion de maquina.
+ * 0 = sin compensacion en ese eje.
+ */
+#define HOLGURA_X_MM 0.0f
+#define HOLGURA_Y_MM 0.0f
+#define HOLGURA_Z_MM 0.0f
+
+/**
+ * @brief Error de escuadra entre ejes (tangente del angulo fuera de 90 grados)
+ * 
+ * ESCUADRA_XY es lo que X avanza por cada mm de Y; ESCUADRA_XZ y ESCUADRA_YZ,
+ * lo que avanzan X e Y por cada mm de Z. Se miden fresando un cuadrado de
+ * lado L: con las diagonales AC (de la esquina de origen a la opuesta) y BD,
+ * ESCUADRA_XY = (AC^2 - BD^2) / (4 L^2). Igual en los planos XZ e YZ.
+ * 
+ * El controlador resta el error al destino de cada bloque. 0 = ejes a escuadra.
+ */
+#define ESCUADRA_XY 0.0f
+#define ESCUADRA_XZ 0.0f
+#define ESCUADRA_YZ 0.0f
+
+/**
+ * @brief Velocidad maxima de cada eje por defecto en mm/min (M203)
+ * 
+ * Los G00 van a la velocidad maxima que permiten los ejes que se mueven, y
+ * ningun avance la supera. 750 equivale al antiguo retardo fijo de 1 ms por
+ * paso con 80 pasos/mm.
+ */
+#define VELOCIDAD_MAXIMA_X_MM_MIN 750.0f
+#define VELOCIDAD_MAXIMA_Y_MM_MIN 750.0f
+#define VELOCIDAD_MAXIMA_Z_MM_MIN 750.0f
+
+/**
+ * @brief Intervalo entre pasos cuando el comando no trae avance (F) valido
+ */
+#define INTERVALO_PASO_DEFECTO_US 1000
+
+/**
+ * @brief Aceleracion maxima de cada eje por defecto en mm/s^2 (M201)
+ * 
+ * El planificador limita la aceleracion sobre la trayectoria para que ningun
+ * eje supere su valor. Ajustar segun el par de los motores y la masa del eje.
+ */
+#define ACELERACION_X_MM_S2 200.0f
+#define ACELERACION_Y_MM_S2 200.0f
+#define ACELERACION_Z_MM_S2 100.0f
+
+/**
+ * @brief Perfil de velocidad de las rampas
+ * 
+ * - 0: Trapezoidal (la aceleracion cambia de golpe al inicio y fin de cada rampa)
+ * - 1: Curva S de 7 fases con sobreaceleracion (jerk) limitada
+ * 
+ * La curva S evita los saltos de aceleracion que excitan la resonancia de los
+ * porticos ligeros, lo que permite subir ACELERACION_*_MM_S2. Cada rampa tarda
+ * un poco mas que la trapezoidal con la misma aceleracion maxima.
+ */
+#define PERFIL_CURVA_S 0
+
+/**
+ * @brief Sobreaceleracion (jerk) maxima de cada eje en mm/s^3 (solo con PERFIL_CURVA_S)
+ * 
+ * Con aceleracion a y sobreaceleracion j cada rampa dedica a/j segundos a
+ * subir y otros tantos a bajar la aceleracion.
+ */
+#define SOBREACELERACION_X_MM_S3 4000.0f
+#define SOBREACELERACION_Y_MM_S3 4000.0f
+#define SOBREACELERACION_Z_MM_S3 2000.0f
+
+/**
+ * @brief Desviacion de union (junction deviation) en mm
+ * 
+ * Distancia maxima entre el vertice programado y el arco virtual con el que
+ * la anticipacion calcula la velocidad de paso por cada esquina. Valores
+ * mayores permiten tomar las esquinas mas rapido a costa de redondearlas.
+ */
+#define DESVIACION_UNION_MM 0.01f
+
+/**
+ * @brief Limite de union al cuadrado para movimientos colineales (sin restriccion practica)
+ */
+#define VELOCIDAD_UNION_RECTA_CUADRADO 1.0e10f
+
+/**
+ * @brief Veces por segundo que cambia la tasa durante las rampas
+ * 
+ * Tambien fija la duracion de cada segmento de pasos (1 / TICKS segundos).
+ */
+#define TICKS_ACELERACION_POR_SEGUNDO 100
+
+/**
+ * @brief Numero de segmentos de pasos preparados por delante de la ISR
+ * 
+ * Cada segmento ocupa 9 bytes y dura 1 / TICKS_ACELERACION_POR_SEGUNDO, asi
+ * que el loop() puede tardar hasta ~150 ms (redibujado del TFT, lectura de la
+ * SD) sin que la maquina se quede sin segmentos.
+ */
+#define TAMANO_BUFFER_SEGMENTOS 16
+
+/**
+ * @brief Correcciones de la tasa pico de un bloque corto
+ * 
+ * El pico con el que caben la subida y la bajada se busca con una estimacion
+ * en forma cerrada de las rampas y se comprueba reproduciendolas tick a tick;
+ * cada correccion es una comprobacion mas. Asi la busqueda reproduce a lo
+ * sumo 2 * (CORRECCIONES_MAXIMAS_PICO + 2) rampas, sea cual sea la
+ * aceleracion, en lugar de dos por cada paso de una biseccion exacta.
+ */
+#define CORRECCIONES_MAXIMAS_PICO 3
+
+/**
+ * @brief Nivel maximo de sobremuestreo adaptativo (AMASS)
+ * 
+ * Con nivel n la ISR corre 2^n veces mas rapido que la tasa de eventos y los
+ * ejes secundarios pasan con esa resolucion en lugar de alinearse a los pasos
+ * del eje dominante.
+ */
+#define NIVEL_MAXIMO_AMASS 3
+
+/**
+ * @brief Periodo minimo de la ISR (cuentas de 0.5 us) al que sube el sobremuestreo
+ * 
+ * 250 cuentas = 125 us: el sobremuestreo nunca lleva la ISR por encima de ~8 kHz.
+ */
+#define PERIODO_MINIMO_AMASS 250
+
+/**
+ * @brief Tasa minima de eventos de paso (eventos/s) al arrancar o detenerse
+ * 
+ * Los motores paso a paso pueden arrancar sin rampa desde esta tasa.
+ */
+#define TASA_MINIMA_EVENTOS 100
+
+/**
+ * @brief Tasa de eventos de una pausa G04 (eventos/s)
+ * 
+ * Una pausa es un bloque sin pasos que la ISR recorre a esta tasa: cada
+ * evento es un milisegundo de espera.
+ */
+#define TASA_EVENTOS_PAUSA 1000
+
+/**
+ * @brief Error maximo de cuerda al aproximar arcos G02/G03 con rectas (mm)
+ * 
+ * Cada segmento se aleja del arco real como mucho esta distancia; menos
+ * tolerancia da mas segmentos y mas trabajo para el planificador.
+ */
+#define TOLERANCIA_ARCO_MM 0.002f
+
+/**
+ * @brief Segmentos de arco entre correcciones exactas con sin/cos
+ * 
+ * Entre correcciones el punto se gira con una aproximacion de la matriz de
+ * rotacion, cuyo error crece con cada segmento.
+ */
+#define SEGMENTOS_CORRECCION_ARCO 12
+
+// =============================================================================
+// CALIBRACION DE EJES (HOMING)
+// =============================================================================
+
+/**
+ * @brief Nivel de los finales de carrera cuando estan activados
+ * 
+ * 1 = activo en bajo (contacto normalmente abierto a GND con pull-up).
+ */
+#define FINAL_CARRERA_ACTIVO_BAJO 1
+
+/**
+ * @brief Limites fisicos: cualquier final activado fuera de la calibracion
+ * detiene los motores desde la interrupcion y deja la maquina en alarma
+ * 
+ * 1 = habilitados, 0 = los finales solo se usan para calibrar.
+ */
+#define LIMITES_FISICOS_HABILITADOS 1
+
+/**
+ * @brief Recorrido maximo de cada eje (mm)
+ * 
+ * La busqueda del final de carrera avanza hasta 1.5 veces este recorrido
+ * antes de dar la calibracion por fallida.
+ */
+#define RECORRIDO_MAXIMO_X_MM 300.0f
+#define RECORRIDO_MAXIMO_Y_MM 300.0f
+#define RECORRIDO_MAXIMO_Z_MM 100.0f
+
+/**
+ * @brief Velocidad de la busqueda rapida del final de carrera (mm/min)
+ * 
+ * El eje se detiene sin rampa al tocar el final, asi que no debe pasar de
+ * la velocidad a la que el motor puede parar en seco.
+ */
+#define VELOCIDAD_BUSQUEDA_CALIBRACION_MM_MIN 300.0f
+
+/**
+ * @brief Velocidad de la localizacion lenta que fija el punto de disparo (mm/min)
+ */
+#define VELOCIDAD_LOCALIZACION_CALIBRACION_MM_MIN 30.0f
+
+/**
+ * @brief Distancia que se separa el eje del final tras cada disparo (mm)
+ * 
+ * Al terminar, cada eje queda a esta distancia de su cero de maquina.
+ */
+#define RETROCESO_CALIBRACION_MM 2.0f
+
+/**
+ * @brief Limites por software: cada movimiento se comprueba al planificarlo
+ * contra el area de trabajo [RETROCESO_CALIBRACION_MM, RECORRIDO_MAXIMO_*_MM]
+ * 
+ * Solo actuan con la maquina calibrada. 1 = habilitados, 0 = deshabilitados.
+ */
+#define LIMITES_SOFTWARE_HABILITADOS 1
+
+// =============================================================================
+// SONDA Y MALLA DE ALTURAS
+// =============================================================================
+
+/**
+ * @brief Nivel de la sonda al hacer contacto: 1 = contacto a GND
+ */
+#define SONDA_ACTIVA_BAJO 1
+
+/**
+ * @brief Avance de G38.2 cuando el programa no ha dado F (mm/min)
+ */
+#define VELOCIDAD_SONDEO_MM_MIN 100.0f
+
+/**
+ * @brief Avance de la bajada en cada punto de la malla G29 (mm/min)
+ */
+#define VELOCIDAD_SONDEO_MALLA_MM_MIN 100.0f
+
+/**
+ * @brief Bajada maxima desde la altura de partida en cada punto de la malla (mm)
+ * 
+ * Si la sonda no toca en este recorrido la malla se da por fallida.
+ */
+#define PROFUNDIDAD_SONDEO_MALLA_MM 5.0f
+
+/**
+ * @brief Maximo de puntos por lado de la malla de alturas
+ * 
+ * Cada punto ocupa 2 bytes de RAM y de EEPROM.
+ */
+#define MAXIMO_PUNTOS_MALLA 7
+
+/**
+ * @brief Posicion de la malla de alturas en la EEPROM
+ * 
+ * El principio de la EEPROM queda para la configuracion de la maquina.
+ */
+#define DIRECCION_EEPROM_MALLA 512
+
+/**
+ * @brief Marca que identifica una malla guardada (cambiarla invalida las anteriores)
+ */
+#define MARCA_EEPROM_MALLA 0x4D41
+
+// =============================================================================
+// CORTADORA (HUSILLO / LASER)
+// =============================================================================
+
+/**
+ * @brief Valor de S que corresponde al ciclo de trabajo completo
+ * 
+ * Los S mayores se recortan a este valor.
+ */
+#define VELOCIDAD_CORTADORA_MAXIMA 1000.0f
+
+/**
+ * @brief Frecuencia del PWM de la cortadora (Hz)
+ */
+#define FRECUENCIA_PWM_CORTADORA_HZ 1000UL
+
+/**
+ * @brief Tope del Timer5 (ICR5) con prescaler 8: cuentas de un periodo de PWM
+ */
+#define PWM_CORTADORA_MAXIMO ((uint16_t)(F_CPU / 8UL / FRECUENCIA_PWM_CORTADORA_HZ - 1))
+
+/**
+ * @brief Modo laser: M4 es potencia dinamica en vez de giro antihorario
+ * 
+ * Con potencia dinamica el ciclo de cada segmento se escala por la velocidad
+ * del segmento frente al F programado, para que las esquinas (donde la
+ * maquina frena) no se quemen. 1 = laser, 0 = husillo.
+ */
+#define MODO_LASER 1
+
+/**
+ * @brief Pixeles de grabado que caben por delante de la ISR
+ * 
+ * Las lineas de grabado (G01 con palabra D) dejan aqui la potencia de cada
+ * pixel al planificarse. Debe ser 256: los indices son uint8_t y dan la
+ * vuelta solos.
+ */
+#define TAMANO_BUFFER_PIXELES 256
+
+/**
+ * @brief Maximo de pixeles por linea de grabado
+ * 
+ * En base64 son 4/3 caracteres por pixel: 120 pixeles ocupan 160 caracteres
+ * y caben en TAMANO_BUFFER_LINEA con los ejes, F y S. El buffer de pixeles
+ * admite dos lineas completas.
+ */
+#define MAXIMO_PIXELES_RASTER 120
+
+// =============================================================================
+// AJUSTES DE VELOCIDAD Y RETENCION EN TIEMPO REAL
+// =============================================================================
+
+/**
+ * @brief Limites del ajuste de avance (porcentaje del F programado)
+ */
+#define AJUSTE_AVANCE_MINIMO 10
+#define AJUSTE_AVANCE_MAXIMO 200
+
+/**
+ * @brief Cambio del ajuste de avance por pulsacion (porcentaje)
+ */
+#define AJUSTE_AVANCE_PASO_GRUESO 10
+#define AJUSTE_AVANCE_PASO_FINO 1
+
+/**
+ * @brief Niveles reducidos del ajuste de rapidos (porcentaje de la velocidad maxima)
+ */
+#define AJUSTE_RAPIDO_MEDIO 50
+#define AJUSTE_RAPIDO_BAJO 25
+
+/**
+ * @brief Bytes de tiempo real por el puerto serie (mismos valores que Grbl)
+ * 
+ * Se atienden en cuanto llegan, sin esperar a un fin de linea.
+ */
+#define BYTE_AVANCE_RESTABLECER 0x90
+#define BYTE_AVANCE_MAS_GRUESO  0x91
+#define BYTE_AVANCE_MENOS_GRUESO 0x92
+#define BYTE_AVANCE_MAS_FINO    0x93
+#define BYTE_AVANCE_MENOS_FINO  0x94
+#define BYTE_RAPIDO_COMPLETO    0x95
+#define BYTE_RAPIDO_MEDIO       0x96
+#define BYTE_RAPIDO_BAJO        0x97
+#define BYTE_RETENCION          '!'
+#define BYTE_REANUDAR           '~'
+
+/**
+ * @brief Teclas del teclado matricial para los ajustes durante la ejecucion
+ */
+#define TECLA_AVANCE_MENOS '4'
+#define TECLA_AVANCE_RESTABLECER '5'
+#define TECLA_AVANCE_MAS '6'
+#define TECLA_RAPIDO_BAJO '7'
+#define TECLA_RAPIDO_MEDIO '8'
+#define TECLA_RAPIDO_COMPLETO '9'
+#define TECLA_RETENCION '1'
+
+// =============================================================================
+// MOVIMIENTO MANUAL (JOG)
+// =============================================================================
+
+/**
+ * @brief Avance del movimiento manual (mm/min)
+ *
+ * Se recorta a la velocidad maxima del eje que se mueve.
+ */
+#define VELOCIDAD_MOVIMIENTO_MANUAL_MM_MIN 600.0f
+
+/**
+ * @brief Bloques del movimiento manual en vuelo (planificador y generador)
+ *
+ * Cola corta: lo planificado por delante de la maquina es solo lo que hace
+ * falta para frenar desde el avance manual, y cabe entero en la cola del
+ * generador para que la retencion frene sobre todo ello.
+ */
+#define BLOQUES_MOVIMIENTO_MANUAL 3
+
+/**
+ * @brief Segmentos de pasos preparados por delante de la ISR durante el movimiento manual
+ *
+ * Al soltar la tecla el frenado empieza tras estos segmentos, que ya tienen
+ * su tasa fijada; con 3 son como mucho 30 ms.
+ */
+#define SEGMENTOS_MOVIMIENTO_MANUAL 3
+
+/**
+ * @brief Teclas del movimiento manual (se mueve mientras estan pulsadas)
+ */
+#define TECLA_MANUAL_X_MENOS '4'
+#define TECLA_MANUAL_X_MAS '6'
+#define TECLA_MANUAL_Y_MAS '2'
+#define TECLA_MANUAL_Y_MENOS '8'
+#define TECLA_MANUAL_Z_MAS '3'
+#define TECLA_MANUAL_Z_MENOS '9'
+
 // =============================================================================
 // SISTEMA DE ARCHIVOS
 // =============================================================================
@@ -347,6 +818,25 @@
     #warning "MAX_ARCHIVOS > 64 puede consumir mucha RAM"
 #endif
 
+// El movimiento manual necesita un segmento en curso y otro preparado
+#if SEGMENTOS_MOVIMIENTO_MANUAL < 2 || SEGMENTOS_MOVIMIENTO_MANUAL >= TAMANO_BUFFER_SEGMENTOS
+    #error "SEGMENTOS_MOVIMIENTO_MANUAL debe estar entre 2 y TAMANO_BUFFER_SEGMENTOS - 1"
+#endif
+
+// Con un solo bloque la maquina frenaria al final de cada uno
+#if BLOQUES_MOVIMIENTO_MANUAL < 2 || BLOQUES_MOVIMIENTO_MANUAL > TAMANO_COLA_PASOS - 1
+    #error "BLOQUES_MOVIMIENTO_MANUAL debe estar entre 2 y TAMANO_COLA_PASOS - 1"
+#endif
+
+// Los indices del buffer de pixeles son uint8_t
+#if TAMANO_BUFFER_PIXELES != 256
+    #error "TAMANO_BUFFER_PIXELES debe ser 256"
+#endif
+
+#if MAXIMO_PIXELES_RASTER * 2 > TAMANO_BUFFER_PIXELES - 1
+    #error "MAXIMO_PIXELES_RASTER demasiado grande para TAMANO_BUFFER_PIXELES"
+#endif
+
 // Verificar que el buffer de línea sea razonable
 #if TAMANO_BUFFER_LINEA > 512
     #warning "TAMANO_BUFFER_LINEA > 512 puede ser excesivo"
@@ -391,6 +881,25 @@
 #define RAM_ESTIMADA_GESTOR \
     (130 + 80 + (MAX_ARCHIVOS * MAX_LONGITUD_NOMBRE_ARCHIVO) + TAMANO_BUFFER_LINEA)
 
+/**
+ * @brief Uso estimado de RAM estatica del control de movimiento
+ * 
+ * Calculo (ATmega2560, sin relleno entre campos):
+ * - Planificador: 16 bloques x 54 = 864 bytes
+ * - Cola de pasos: 4 bloques x 54 = 216 bytes
+ * - Segmentos de pasos: 16 x 9 = 144 bytes
+ * - Buffer de pixeles del GeneradorPasos: 256 bytes
+ * - pixeles_ del InterpreteGcode: 120 bytes
+ * - Malla de alturas: 7 x 7 x 2 = 98 bytes
+ * - Resto (arco, holgura, calibracion, sondeo, movimiento manual, ajustes de
+ *   maquina, cortadora, estado del GeneradorPasos, pantallas): ~660 bytes
+ * - Total: ~2360 bytes. Antes, ControladorCNC e InterpreteGcode ocupaban ~50
+ *   bytes (sin contar el objeto MultiStepperLite, que ya no existe)
+ */
+#define RAM_ESTIMADA_MOVIMIENTO \
+    (TAMANO_BUFFER_PLANIFICADOR * 54 + TAMANO_COLA_PASOS * 54 + TAMANO_BUFFER_SEGMENTOS * 9 + \
+     TAMANO_BUFFER_PIXELES + MAXIMO_PIXELES_RASTER + MAXIMO_PUNTOS_MALLA * MAXIMO_PUNTOS_MALLA * 2 + 660)
+
 // Mostrar información en compilación
 #if MODO_DESARROLLADOR
     #pragma message "=========================================="
@@ -18,6 +18,31 @@
 #define PIN_MOTOR_Z_DIR 56
 #define PIN_MOTOR_Z_EN 55
 
+/**
+ * FINALES DE CARRERA (PUERTO K: A12 - A14)
+ * Deben estar en el puerto K para compartir la interrupcion PCINT2, que
+ * sirve tanto a la calibracion como a los limites fisicos.
+ * Contacto normalmente abierto a GND, con pull-up interno.
+ */
+#define PIN_FINAL_CARRERA_X 66
+#define PIN_FINAL_CARRERA_Y 67
+#define PIN_FINAL_CARRERA_Z 68
+
+/**
+ * CORTADORA (HUSILLO O LASER)
+ * El PWM sale por OC5A (pin 46), asi que depende del Timer5.
+ */
+#define PIN_CORTADORA_PWM 46
+#define PIN_CORTADORA_DIR 47
+#define PIN_CORTADORA_EN 48
+
+/**
+ * SONDA DE CONTACTO (PUERTO B)
+ * Tiene para ella sola la interrupcion PCINT0. Contacto a GND con pull-up
+ * interno (la pinza en la herramienta y la placa a GND).
+ */
+#define PIN_SONDA 12
+
 
 #define PIN_TECLADO_FILA_1 2
 #define PIN_TECLADO_FILA_2 3
@@ -2,21 +2,89 @@
 #define COMANDO_GCODE_H
 
 #include <Arduino.h>
+
+/**
+ * @brief Valor de ComandoGcode::comando cuando la linea no contiene un codigo G
+ * 
+ * G00 usa el codigo 0, por eso "sin comando" necesita su propio valor.
+ */
+#define COMANDO_GCODE_NINGUNO 0xFF
+
+/**
+ * @brief Valor de ComandoGcode::comando en una linea M92, M201 o M203
+ * 
+ * Cambia la configuracion de la maquina (TipoAjusteMaquina en tipo_ajuste)
+ * cuando termina lo que ya esta en cola.
+ */
+#define COMANDO_AJUSTE_MAQUINA 0xFE
+
+/**
+ * @brief Plano de los arcos G02/G03, elegido con G17, G18 o G19
+ */
+enum PlanoArco : uint8_t {
+    PLANO_XY = 0, ///< G17: gira en XY, Z lineal
+    PLANO_ZX = 1, ///< G18: gira en ZX, Y lineal
+    PLANO_YZ = 2  ///< G19: gira en YZ, X lineal
+};
+
+/**
+ * @brief Eje (0 = X, 1 = Y, 2 = Z) que ocupa el lugar n de un plano de arco
+ * @param plano PlanoArco
+ * @param n 0 y 1 son los ejes del giro, en el orden que fija su sentido; 2 es el eje lineal
+ * 
+ * Los planos son rotaciones de XYZ: XY -> (X, Y, Z), ZX -> (Z, X, Y) y
+ * YZ -> (Y, Z, X).
+ */
+inline uint8_t ejePlano(uint8_t plano, uint8_t n) {
+    return (3 - plano + n) % 3;
+}
+
 /**
  * @struct ComandoGcode
  * @brief Estructura para almacenar los datos de un comando G-code
+ * 
+ * Las coordenadas son el destino absoluto en coordenadas de maquina (mm): el
+ * interprete ya aplico G90/G91 y el origen de G92. En G02/G03 el centro se
+ * entrega siempre como desplazamiento I/J/K desde inicio, la posicion programada
+ * antes de la linea, aunque el programa lo haya dado con R; plano indica los
+ * dos ejes en los que gira.
+ * 
+ * El estado de la cortadora (M3/M4/M5 y S) es modal y viaja en cada comando;
+ * una linea que solo lo cambia llega como una pausa G04 de duracion cero.
+ * 
+ * Una linea de grabado es un G01 con la palabra D: pixeles apunta a sus
+ * potencias ya decodificadas, que solo son validas hasta la siguiente linea.
+ * 
+ * G38.2 llega como comando 38; el resto de variantes de G38 se rechazan.
  */
 struct ComandoGcode {
-    float x; ///< Valor del eje X
-    float y; ///< Valor del eje Y  
-    float z; ///< Valor del eje Z
-    float velocidad; ///< Velocidad de la cortadora
+    float x; ///< Destino del eje X
+    float y; ///< Destino del eje Y  
+    float z; ///< Destino del eje Z
+    float i; ///< Desplazamiento X del centro del arco respecto al inicio
+    float j; ///< Desplazamiento Y del centro del arco respecto al inicio
+    float k; ///< Desplazamiento Z del centro del arco respecto al inicio
+    float velocidad; ///< Avance F en mm/min
+    float pausa_s; ///< Duracion de la pausa G04 en segundos
+    float velocidad_cortadora; ///< Valor S de la cortadora
     uint8_t comando; ///< Codigo G del comando
+    uint8_t modo_cortadora; ///< 3 (M3), 4 (M4) o 5 (M5, apagada)
+    uint8_t plano; ///< Plano del arco G02/G03 (PlanoArco)
+    const uint8_t *pixeles; ///< Potencias de grabado (0-255, fraccion de S) o nullptr
+    uint8_t num_pixeles; ///< Pixeles repartidos a lo largo del movimiento (0 = sin grabado)
+    uint8_t puntos_malla; ///< Nodos por lado de la malla G29 (P); I y J llevan su ancho y alto
+    uint8_t tipo_ajuste; ///< Valor de la configuracion que cambia (TipoAjusteMaquina)
+    float valores_ajuste[3]; ///< X, Y, Z del cambio de configuracion (0 = sin cambio)
+    float inicio[3]; ///< Posicion programada X, Y, Z antes de la linea (origen de I/J/K)
     
     /**
-     * @brief Constructor que inicializa todos los valores a cero
+     * @brief Constructor que inicializa todos los valores a cero, sin comando y
+     * con la cortadora apagada
      */
-    ComandoGcode() : x(0.0f), y(0.0f), z(0.0f), velocidad(0.0f), comando(0) {}
+    ComandoGcode() : x(0.0f), y(0.0f), z(0.0f), i(0.0f), j(0.0f), k(0.0f), velocidad(0.0f), pausa_s(0.0f),
+                     velocidad_cortadora(0.0f), comando(COMANDO_GCODE_NINGUNO), modo_cortadora(5),
+                     plano(PLANO_XY), pixeles(nullptr), num_pixeles(0), puntos_malla(0), tipo_ajuste(0),
+                     valores_ajuste{0.0f, 0.0f, 0.0f}, inicio{0.0f, 0.0f, 0.0f} {}
 };
 
 #endif // COMANDO_GCODE_H
\ No newline at end of file
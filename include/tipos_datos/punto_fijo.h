@@ -0,0 +1,35 @@
+#ifndef PUNTO_FIJO_H
+#define PUNTO_FIJO_H
+
+#include <stdint.h>
+
+/**
+ * @file punto_fijo.h
+ * @brief Formatos de punto fijo usados en la cadena de movimiento
+ *
+ * @details El ATmega2560 no tiene FPU: cada operacion en float cuesta del orden
+ * de cien ciclos. Los flotantes solo se usan al interpretar el G-code; desde
+ * ahi las posiciones van en pasos enteros y las tasas en Q16.16.
+ *
+ * - Q16.16: 16 bits enteros y 16 fraccionarios. Tasas en eventos/s (hasta 65535)
+ *   y sus incrementos por tick de aceleracion.
+ */
+
+#define BITS_Q16 16
+#define UNO_Q16 (1UL << BITS_Q16)
+
+/**
+ * @brief Convierte un valor no negativo a Q16.16 redondeando
+ */
+inline uint32_t flotanteAQ16(float valor) {
+    return static_cast<uint32_t>(valor * UNO_Q16 + 0.5f);
+}
+
+/**
+ * @brief Parte entera de un valor Q16.16
+ */
+inline uint32_t enteroQ16(uint32_t valor) {
+    return valor >> BITS_Q16;
+}
+
+#endif // PUNTO_FIJO_H
@@ -14,6 +14,16 @@
 #define TXT_ESTADO_EJE_ORIGEN F("Origen")
 #define TXT_ESTADO_EJE_POSICION F("Posicion")
 #define TXT_ESTADO_EJE_DESTINO F("Destino")
+
+#define TXT_CALIBRANDO F("Calibrando ejes...")
+#define TXT_CALIBRACION_FALLIDA F("Calibracion fallida: revise los finales de carrera")
+#define TXT_ALARMA_LIMITE_FISICO F("ALARMA: final de carrera activado. Recalibre los ejes")
+#define TXT_ALARMA_LIMITE_SOFTWARE F("ALARMA: el programa sale del area de trabajo")
+#define TXT_ALARMA_SONDEO F("ALARMA: la sonda no hizo contacto")
+#define TXT_ALARMA_INSTRUCCIONES F("Pulse 0 para restablecer")
+#define TXT_MOVIMIENTO_MANUAL F("Movimiento manual de ejes")
+#define TXT_MOVIMIENTO_MANUAL_TECLAS F("Mantenga pulsado: X 4/6, Y 8/2, Z 9/3")
+#define TXT_MOVIMIENTO_MANUAL_SALIR F("Pulse 0 para volver al menu")
 //NOTA; DEBO ARREGLAR LA IMPLEMENTACION DE TEXTO PARA QUE SOLO LO TOME DE LA ROM Y NO DE LA RAM
 
 // Opciones del menú en PROGMEM...
@@ -21,16 +31,20 @@
 const char OP_ABRIR_LOCAL[] PROGMEM = "Abrir archivo local";
 const char OP_IMPORTAR_USB[] PROGMEM = "Importar archivo desde USB";
 const char OP_IMPORTAR_RED[] PROGMEM = "Importar archivo desde la red";
-const char OP_CALIBRAR[] PROGMEM = "Calibrar ejes";
+const char OP_CONFIGURACION[] PROGMEM = "Configuracion";
 const char OP_OTROS[] PROGMEM = "Otros";
+const char OP_MOVER_EJES[] PROGMEM = "Mover ejes";
+const char OP_CALIBRAR[] PROGMEM = "Calibrar ejes";
 
 // Array de punteros en PROGMEM - VERIFICA QUE TENGA 'PROGMEM'
 const char* const OPCIONES_MENU[] PROGMEM = {
     OP_ABRIR_LOCAL,
     OP_IMPORTAR_USB, 
     OP_IMPORTAR_RED,
-    OP_CALIBRAR,
-    OP_OTROS
+    OP_CONFIGURACION,
+    OP_OTROS,
+    OP_MOVER_EJES,
+    OP_CALIBRAR
 };
 
 #endif
\ No newline at end of file
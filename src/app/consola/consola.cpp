@@ -1,4 +1,5 @@
 #include "consola.h"
+#include "textos.h"
 
 /**
  * @file consola.cpp
@@ -15,6 +16,7 @@ Consola::Consola(GestorArchivos &miGestorArchivos_ref)
       contexto_actual(MENU_INICIO),
       contexto_anterior(MENU_INICIO),
       primer_actualizacion(true),
+      motivo_alarma(nullptr),
       archivos_cargados(false),
       array_nombres_archivos(nullptr),
       cantidad_archivos_actual(0)
@@ -48,7 +50,7 @@ void Consola::actualizar(char tecla,
                         const float &origen_x, const float &posicion_x, const float &destino_x,
                         const float &origen_y, const float &posicion_y, const float &destino_y,
                         const float &origen_z, const float &posicion_z, const float &destino_z, 
-                        const char* comando_gcode) {
+                        const char* comando_gcode, const char* estado_cortadora) {
 
     // Procesar entrada de teclado
     if (tecla != '\0') {
@@ -102,11 +104,17 @@ void Consola::actualizar(char tecla,
                 origen_x, posicion_x, destino_x,
                 origen_y, posicion_y, destino_y,
                 origen_z, posicion_z, destino_z,
-                comando_gcode
+                comando_gcode, estado_cortadora
             );
             break;
             
+        case MOVIMIENTO_MANUAL:
+            mostrarPosicionManual(posicion_x, posicion_y, posicion_z);
+            break;
+            
         case CONFIGURACION:
+        case CALIBRACION:
+        case ALARMA:
             // Sin actualizaciones dinámicas
             break;
     }
@@ -168,6 +176,78 @@ void Consola::mostrarInterfazContexto() {
                 Serial.println(F("[Consola] Mostrando CONFIGURACION"));
             #endif
             break;
+            
+        case CALIBRACION:
+            miDisplay.fillScreen(COLOR_BLANCO);
+            miDisplay.setTextColor(COLOR_NEGRO);
+            miDisplay.setCursor(10, 10);
+            miDisplay.print(TXT_CALIBRANDO);
+            #if MODO_DESARROLLADOR
+                Serial.println(F("[Consola] Mostrando CALIBRACION"));
+            #endif
+            break;
+            
+        case ALARMA:
+            miDisplay.fillScreen(COLOR_BLANCO);
+            miDisplay.setTextColor(COLOR_NEGRO);
+            miDisplay.setCursor(10, 10);
+            miDisplay.print(motivo_alarma);
+            miDisplay.setCursor(10, 40);
+            miDisplay.print(TXT_ALARMA_INSTRUCCIONES);
+            #if MODO_DESARROLLADOR
+                Serial.println(F("[Consola] Mostrando ALARMA"));
+            #endif
+            break;
+            
+        case MOVIMIENTO_MANUAL:
+            miDisplay.fillScreen(COLOR_BLANCO);
+            miDisplay.setTextColor(COLOR_NEGRO);
+            miDisplay.setCursor(10, 10);
+            miDisplay.print(TXT_MOVIMIENTO_MANUAL);
+            miDisplay.setCursor(10, 40);
+            miDisplay.print(TXT_MOVIMIENTO_MANUAL_TECLAS);
+            miDisplay.setCursor(10, 60);
+            miDisplay.print(TXT_MOVIMIENTO_MANUAL_SALIR);
+            #if MODO_DESARROLLADOR
+                Serial.println(F("[Consola] Mostrando MOVIMIENTO_MANUAL"));
+            #endif
+            break;
+    }
+}
+
+void Consola::mostrarPosicionManual(const float &posicion_x, const float &posicion_y, const float &posicion_z) {
+    const float posiciones[3] = {posicion_x, posicion_y, posicion_z};
+    const char nombres[3] = {'X', 'Y', 'Z'};
+    miDisplay.fillRect(10, 90, 200, 90, COLOR_BLANCO);
+    miDisplay.setTextColor(COLOR_NEGRO);
+    for (uint8_t i = 0; i < 3; i++) {
+        miDisplay.setCursor(10, 110 + i * 30);
+        miDisplay.print(nombres[i]);
+        miDisplay.print(F(": "));
+        miDisplay.print(posiciones[i], 3);
+    }
+}
+
+void Consola::mostrarAlarma(const __FlashStringHelper *motivo) {
+    motivo_alarma = motivo;
+    cambiarContexto(ALARMA);
+}
+
+void Consola::finalizarCalibracion(bool exito) {
+    #if MODO_DESARROLLADOR
+        Serial.print(F("[Consola::finalizarCalibracion] Exito: "));
+        Serial.println(exito);
+    #endif
+    if (contexto_actual != CALIBRACION) {
+        return;
+    }
+    if (exito) {
+        cambiarContexto(MENU_INICIO);
+    } else {
+        // Se queda en pantalla hasta que el usuario salga con '0' o '*'
+        miDisplay.setTextColor(COLOR_NEGRO);
+        miDisplay.setCursor(10, 40);
+        miDisplay.print(TXT_CALIBRACION_FALLIDA);
     }
 }
 
@@ -398,6 +478,12 @@ void Consola::procesarTecla(char tecla) {
                 case '4':
                     cambiarContexto(CONFIGURACION);
                     break;
+                case '6':
+                    cambiarContexto(MOVIMIENTO_MANUAL);
+                    break;
+                case '7':
+                    cambiarContexto(CALIBRACION);
+                    break;
             }
             break;
             
@@ -409,7 +495,7 @@ void Consola::procesarTecla(char tecla) {
         case EJECUCION:
             switch (tecla) {
                 case '1':  // Pausar/Reanudar
-                    // TODO: Implementar control de pausa
+                    // La retencion la atiende main.cpp sobre el ControladorCNC
                     break;
                 case '2':  // Detener
                     // TODO: Implementar detención
@@ -422,6 +508,10 @@ void Consola::procesarTecla(char tecla) {
             break;
             
         case CONFIGURACION:
+        case CALIBRACION:
+        case ALARMA:
+        case MOVIMIENTO_MANUAL:
+            // Salir de la calibracion la cancela desde main.cpp; los ejes los mueve main.cpp
             switch (tecla) {
                 case '0':
                 case '*':
@@ -28,7 +28,10 @@ enum CONTEXTO_APP : uint8_t {
     MENU_ARCHIVOS_SD,   ///< Browser de archivos SD
     MENU_ARCHIVOS_USB,  ///< Browser de archivos USB
     EJECUCION,          ///< Pantalla de ejecución G-code
-    CONFIGURACION       ///< Pantalla de configuración
+    CONFIGURACION,      ///< Pantalla de configuración
+    CALIBRACION,        ///< Calibración de ejes en curso
+    ALARMA,             ///< Máquina detenida por un límite físico
+    MOVIMIENTO_MANUAL   ///< Movimiento de ejes con el teclado (jog)
 };
 
 /**
@@ -59,6 +62,8 @@ private:
     CONTEXTO_APP contexto_anterior;
     bool primer_actualizacion;
     
+    const __FlashStringHelper *motivo_alarma; ///< Texto de la alarma en pantalla
+    
     // Variables para browser de archivos
     bool archivos_cargados;              ///< Indica si hay archivos cargados en memoria
     const char** array_nombres_archivos; ///< Array de punteros a nombres de archivo
@@ -88,6 +93,14 @@ private:
      */
     void limpiarPantallaContextoAnterior();
     
+    /**
+     * @brief Escribe la posicion de los ejes en la pantalla de movimiento manual
+     * 
+     * Solo borra la zona de los numeros: mientras un eje se mueve el loop no
+     * debe tardar mas que los segmentos que el generador tiene preparados.
+     */
+    void mostrarPosicionManual(const float &posicion_x, const float &posicion_y, const float &posicion_z);
+    
     // Métodos privados - Browser de archivos
     
     /**
@@ -168,12 +181,13 @@ public:
      * @param posicion_z Posición actual Z
      * @param destino_z Destino Z del movimiento
      * @param comando_gcode Comando G-code actual
+     * @param estado_cortadora Modo y velocidad aplicados a la cortadora
      */
     void actualizar(char tecla, 
                    const float &origen_x, const float &posicion_x, const float &destino_x,
                    const float &origen_y, const float &posicion_y, const float &destino_y,
                    const float &origen_z, const float &posicion_z, const float &destino_z, 
-                   const char* comando_gcode);
+                   const char* comando_gcode, const char* estado_cortadora);
     
     /**
      * @brief Obtiene el contexto actual de la aplicación
@@ -181,6 +195,21 @@ public:
      */
     CONTEXTO_APP obtenerContextoActual() const { return contexto_actual; }
     
+    /**
+     * @brief Cierra la pantalla de calibración al terminar el ciclo
+     * @param exito false si algún eje no encontró su final de carrera;
+     *              en ese caso se muestra el error y no se cambia de pantalla
+     */
+    void finalizarCalibracion(bool exito);
+    
+    /**
+     * @brief Muestra la pantalla de alarma
+     * @param motivo Texto de la alarma (textos.h)
+     * 
+     * Se sale con '0' o '*'; main.cpp restablece la alarma en el controlador.
+     */
+    void mostrarAlarma(const __FlashStringHelper *motivo);
+    
     // Métodos de prueba
     void pruebaLecturaSD();
     void pruebaLecturaUSB();
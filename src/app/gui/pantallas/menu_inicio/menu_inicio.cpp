@@ -33,7 +33,7 @@ MenuInicio::MenuInicio(MCUFRIEND_kbv &display_ref, Lista &lista_ref, GestorWidge
       miGestorWidgets(gestor_ref),
       listaOpciones(lista_ref)
 {
-    listaOpciones.inicializar(opciones_menu, 5);
+    listaOpciones.inicializar(opciones_menu, 7);
 }
 
 /**
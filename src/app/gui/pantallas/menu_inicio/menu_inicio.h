@@ -12,12 +12,14 @@ private:
     GestorWidgets &miGestorWidgets;
     Lista &listaOpciones;    
    
-    const char* opciones_menu[5] = {
+    const char* opciones_menu[7] = {
         "Abrir archivo local",
         "Importar archivo desde USB", 
         "Importar archivo desde la red",
-        "Calibrar ejes",
-        "Otros"
+        "Configuracion",
+        "Otros",
+        "Mover ejes",
+        "Calibrar ejes"
     };
 
 public: 
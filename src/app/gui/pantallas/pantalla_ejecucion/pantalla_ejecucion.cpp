@@ -46,6 +46,7 @@ PantallaEjecucion::PantallaEjecucion(MCUFRIEND_kbv &display_ref, GestorWidgets &
     , destino_x_anterior(0)
     , destino_y_anterior(0)
     , destino_z_anterior(0)
+    , estado_cortadora_anterior{0}
 {
     // Constructor vacio - configuraciones se inicializan en lista
 }
@@ -55,6 +56,8 @@ PantallaEjecucion::PantallaEjecucion(MCUFRIEND_kbv &display_ref, GestorWidgets &
  */
 void PantallaEjecucion::mostrar() {
     display.fillScreen(COLOR_BLANCO);
+    // La barra de la cortadora se redibuja con el primer estado que llegue
+    estado_cortadora_anterior[0] = '\0';
 
     // Configurar elementos estaticos
     const WidgetBarraEstatica barra_superior = {
@@ -126,10 +129,13 @@ void PantallaEjecucion::mostrar() {
  * @param origen_z Valor de origen del eje Z
  * @param posicion_z Posicion actual del eje Z
  * @param destino_z Valor de destino del eje Z
+ * @param comando_gcode Linea en ejecucion
+ * @param estado_cortadora Modo y velocidad aplicados a la cortadora (ej: "M3 S1000")
  */
 void PantallaEjecucion::actualizarDatos(const float &origen_x, const float &posicion_x, const float &destino_x,
     const float &origen_y, const float &posicion_y, const float &destino_y,
-    const float &origen_z, const float &posicion_z, const float &destino_z, const char* comando_gcode) {
+    const float &origen_z, const float &posicion_z, const float &destino_z, const char* comando_gcode,
+    const char* estado_cortadora) {
     
     const WidgetBarraDinamica barra_gcode = {
         cuadro_gcode,
@@ -138,7 +144,7 @@ void PantallaEjecucion::actualizarDatos(const float &origen_x, const float &posi
 
      const WidgetBarraDinamica barra_cortadora = {
         cuadro_cortadora,
-        {COLOR_NEGRO, comando_gcode,nullptr}        
+        {COLOR_NEGRO, estado_cortadora,nullptr}        
     };
 
     if(origen_x != origen_x_anterior || posicion_x != posicion_x_anterior || destino_x != destino_x_anterior){
@@ -187,7 +193,6 @@ void PantallaEjecucion::actualizarDatos(const float &origen_x, const float &posi
     // Actualizar comando G-code si hay cambios
     if(comando_gcode != nullptr && strcmp(comando_gcode, comando_gcode_anterior) != 0){
         miGestorWidgets.dibujarBarraDinamica(barra_gcode);
-        miGestorWidgets.dibujarBarraDinamica(barra_cortadora);
         strncpy(comando_gcode_anterior, comando_gcode, sizeof(comando_gcode_anterior) - 1);
         comando_gcode_anterior[sizeof(comando_gcode_anterior) - 1] = '\0'; // Asegurar terminación
         
@@ -196,6 +201,13 @@ void PantallaEjecucion::actualizarDatos(const float &origen_x, const float &posi
         Serial.println(comando_gcode);
         #endif
     }
+    
+    // La cortadora cambia al empezar su bloque, no con la linea leida
+    if(estado_cortadora != nullptr && strcmp(estado_cortadora, estado_cortadora_anterior) != 0){
+        miGestorWidgets.dibujarBarraDinamica(barra_cortadora);
+        strncpy(estado_cortadora_anterior, estado_cortadora, sizeof(estado_cortadora_anterior) - 1);
+        estado_cortadora_anterior[sizeof(estado_cortadora_anterior) - 1] = '\0';
+    }
 
     
     
@@ -17,6 +17,7 @@ private:
     const ConfigWidget cuadro_cortadora;
     float origen_x_anterior,origen_y_anterior,origen_z_anterior,posicion_x_anterior,posicion_y_anterior,posicion_z_anterior,destino_x_anterior,destino_y_anterior,destino_z_anterior;
     char comando_gcode_anterior[256];
+    char estado_cortadora_anterior[24];
     const uint16_t color_texto_valores;
     
 public: 
@@ -24,7 +25,8 @@ public:
     void mostrar();
     void actualizarDatos(const float &origen_x, const float &posicion_x, const float &destino_x,
                         const float &origen_y, const float &posicion_y, const float &destino_y,
-                        const float &origen_z, const float &posicion_z, const float &destino_z, const char* comando_gcode);
+                        const float &origen_z, const float &posicion_z, const float &destino_z, const char* comando_gcode,
+                        const char* estado_cortadora);
 };
 
 #endif
\ No newline at end of file
@@ -10,10 +10,61 @@
 #include "constantes.h"
 #include "comando_gcode.h"
 
-InterpreteGcode::InterpreteGcode() {
+static const char LETRAS_EJES[3] = {'X', 'Y', 'Z'};
+static const char LETRAS_CENTRO[3] = {'I', 'J', 'K'};
+
+InterpreteGcode::InterpreteGcode():
+    posicionamiento_absoluto_(true),
+    modo_movimiento_(0),
+    plano_(PLANO_XY),
+    velocidad_modal_(0.0f),
+    modo_cortadora_(5),
+    velocidad_cortadora_(0.0f),
+    posicion_{0.0f, 0.0f, 0.0f},
+    origen_g92_{0.0f, 0.0f, 0.0f}
+{
     reiniciarValores();
 }
 
+bool InterpreteGcode::contienePalabra(const String& cadena, char letra) const {
+    return cadena.indexOf(letra) != -1;
+}
+
+/**
+ * @brief En G90 el valor es relativo al origen de trabajo; en G91 se suma a la
+ * posicion programada. Los ejes ausentes conservan su posicion.
+ */
+void InterpreteGcode::calcularDestino(const String& cadena) {
+    for (uint8_t i = 0; i < 3; i++) {
+        if (!contienePalabra(cadena, LETRAS_EJES[i])) {
+            continue;
+        }
+        float valor = extraerValor(cadena, String(LETRAS_EJES[i]));
+        if (posicionamiento_absoluto_) {
+            posicion_[i] = origen_g92_[i] + valor;
+        } else {
+            posicion_[i] += valor;
+        }
+    }
+}
+
+/**
+ * @brief G92 X0 hace que la posicion actual pase a ser X0 en coordenadas de
+ * trabajo; la maquina no se mueve.
+ */
+void InterpreteGcode::procesarOrigenTrabajo(const String& cadena) {
+    for (uint8_t i = 0; i < 3; i++) {
+        if (contienePalabra(cadena, LETRAS_EJES[i])) {
+            origen_g92_[i] = posicion_[i] - extraerValor(cadena, String(LETRAS_EJES[i]));
+        }
+    }
+#if MODO_DESARROLLADOR
+    Serial.print(F("Origen G92 X:")); Serial.print(origen_g92_[0]);
+    Serial.print(F(" Y:")); Serial.print(origen_g92_[1]);
+    Serial.print(F(" Z:")); Serial.println(origen_g92_[2]);
+#endif
+}
+
 float InterpreteGcode::extraerValor(const String& cadena, const String& prefijo) {
     int indice = cadena.indexOf(prefijo);
     if (indice == -1) {
@@ -52,17 +103,207 @@ void InterpreteGcode::procesarInterpolacionLineal() {
 #endif
 }
 
-void InterpreteGcode::procesarInterpolacionCircular() {
+/**
+ * @brief Con R el centro queda sobre la mediatriz de la cuerda, a una
+ * distancia h del punto medio: h = sqrt(r^2 - (d/2)^2). El signo de h elige
+ * el centro que da el sentido de giro pedido; R negativo pide el arco mayor.
+ * 
+ * Los calculos se hacen en los dos ejes del plano vigente, en el orden de
+ * ejePlano(), que es el que da el sentido de giro de G02/G03 en cada plano.
+ */
+bool InterpreteGcode::procesarInterpolacionCircular(const String& cadena, const float *inicio) {
+    uint8_t eje_0 = ejePlano(plano_, 0);
+    uint8_t eje_1 = ejePlano(plano_, 1);
+    uint8_t eje_lineal = ejePlano(plano_, 2);
+    float centro[3] = {0.0f, 0.0f, 0.0f};
+    
+    if (contienePalabra(cadena, LETRAS_CENTRO[eje_lineal])) {
+        // El centro no puede salir del plano: una K en G17 suele ser un
+        // programa escrito para G18/G19
+#if MODO_DESARROLLADOR
+        Serial.println(F("Arco invalido: desplazamiento del centro en el eje lineal del plano"));
+#endif
+        return false;
+    }
+    
+    if (contienePalabra(cadena, 'R')) {
+        float radio = extraerValor(cadena, "R");
+        float d0 = posicion_[eje_0] - inicio[eje_0];
+        float d1 = posicion_[eje_1] - inicio[eje_1];
+        float h_cuadrado_4 = 4.0f * radio * radio - d0 * d0 - d1 * d1;
+        float cuerda = sqrt(d0 * d0 + d1 * d1);
+        if (cuerda == 0.0f || h_cuadrado_4 < -4.0f * TOLERANCIA_ARCO_MM * fabs(radio)) {
+#if MODO_DESARROLLADOR
+            Serial.println(F("Arco R invalido: el radio no alcanza el destino"));
+#endif
+            return false;
+        }
+        // h/(d/2) sobre la cuerda; un radio apenas corto se trata como semicirculo
+        float h_relativo = (h_cuadrado_4 > 0.0f) ? -sqrt(h_cuadrado_4) / cuerda : 0.0f;
+        if (comando_actual_.comando == 3) {
+            h_relativo = -h_relativo;
+        }
+        if (radio < 0.0f) {
+            h_relativo = -h_relativo;
+        }
+        centro[eje_0] = 0.5f * (d0 - d1 * h_relativo);
+        centro[eje_1] = 0.5f * (d1 + d0 * h_relativo);
+    } else if (contienePalabra(cadena, LETRAS_CENTRO[eje_0]) || contienePalabra(cadena, LETRAS_CENTRO[eje_1])) {
+        centro[eje_0] = extraerValor(cadena, String(LETRAS_CENTRO[eje_0]));
+        centro[eje_1] = extraerValor(cadena, String(LETRAS_CENTRO[eje_1]));
+    } else {
+#if MODO_DESARROLLADOR
+        Serial.println(F("Arco sin centro: faltan los desplazamientos del plano o R"));
+#endif
+        return false;
+    }
+    comando_actual_.i = centro[0];
+    comando_actual_.j = centro[1];
+    comando_actual_.k = centro[2];
+    comando_actual_.plano = plano_;
+    
 #if MODO_DESARROLLADOR
     Serial.print(F("Ejecutando interpolacion circular G"));
-    Serial.println(comando_actual_.comando);
+    Serial.print(comando_actual_.comando);
+    Serial.print(F(" plano G"));
+    Serial.print(17 + plano_);
+    Serial.print(F(" - I:"));
+    Serial.print(comando_actual_.i);
+    Serial.print(F(" J:"));
+    Serial.print(comando_actual_.j);
+    Serial.print(F(" K:"));
+    Serial.println(comando_actual_.k);
+#endif
+    return true;
+}
+
+void InterpreteGcode::procesarParadaProgramada(const String& cadena) {
+    if (contienePalabra(cadena, 'P')) {
+        comando_actual_.pausa_s = extraerValor(cadena, "P");
+    } else if (contienePalabra(cadena, 'S')) {
+        comando_actual_.pausa_s = extraerValor(cadena, "S");
+    }
+#if MODO_DESARROLLADOR
+    Serial.print(F("Ejecutando parada programada G04 de "));
+    Serial.print(comando_actual_.pausa_s);
+    Serial.println(F(" s"));
+#endif
+}
+
+bool InterpreteGcode::procesarCortadora(const String& cadena) {
+    bool presente = false;
+    if (contienePalabra(cadena, 'M')) {
+        uint8_t codigo_m = (uint8_t)extraerValor(cadena, "M");
+        switch (codigo_m) {
+            case 3:
+            case 4:
+            case 5:
+                modo_cortadora_ = codigo_m;
+                presente = true;
+                break;
+            case 2:  // Fin de programa
+            case 30:
+                modo_cortadora_ = 5;
+                presente = true;
+                break;
+            default:
+                break;
+        }
+    }
+    if (comando_actual_.comando != 4 && contienePalabra(cadena, 'S')) {
+        velocidad_cortadora_ = extraerValor(cadena, "S");
+        presente = true;
+    }
+    comando_actual_.modo_cortadora = modo_cortadora_;
+    comando_actual_.velocidad_cortadora = velocidad_cortadora_;
+    
+#if MODO_DESARROLLADOR
+    if (presente) {
+        Serial.print(F("Cortadora M"));
+        Serial.print(modo_cortadora_);
+        Serial.print(F(" S"));
+        Serial.println(velocidad_cortadora_);
+    }
 #endif
+    return presente;
 }
 
-void InterpreteGcode::procesarParadaProgramada() {
+bool InterpreteGcode::procesarConfiguracion(const String& cadena) {
+    if (!contienePalabra(cadena, 'M')) {
+        return false;
+    }
+    switch ((uint8_t)extraerValor(cadena, "M")) {
+        case 92:  comando_actual_.tipo_ajuste = AJUSTE_PASOS_POR_MM; break;
+        case 201: comando_actual_.tipo_ajuste = AJUSTE_ACELERACION; break;
+        case 203: comando_actual_.tipo_ajuste = AJUSTE_VELOCIDAD_MAXIMA; break;
+        default: return false;
+    }
+    for (uint8_t i = 0; i < 3; i++) {
+        comando_actual_.valores_ajuste[i] = extraerValor(cadena, String(LETRAS_EJES[i]));
+    }
+    comando_actual_.comando = COMANDO_AJUSTE_MAQUINA;
 #if MODO_DESARROLLADOR
-    Serial.println(F("Ejecutando parada programada G04"));
+    Serial.print(F("Configuracion ")); Serial.print(comando_actual_.tipo_ajuste);
+    Serial.print(F(" X:")); Serial.print(comando_actual_.valores_ajuste[0]);
+    Serial.print(F(" Y:")); Serial.print(comando_actual_.valores_ajuste[1]);
+    Serial.print(F(" Z:")); Serial.println(comando_actual_.valores_ajuste[2]);
 #endif
+    return true;
+}
+
+int InterpreteGcode::buscarPalabraRaster(const String& linea) const {
+    for (unsigned int i = 0; i < linea.length(); i++) {
+        char c = linea[i];
+        if (c == ';' || c == '(') {
+            return -1;
+        }
+        if (c == 'D') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Valor de 6 bits de un caracter base64, o -1 si no pertenece al alfabeto
+ */
+static int8_t valorBase64(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+/**
+ * @brief Cada caracter aporta 6 bits; en cuanto se juntan 8 sale un pixel. El
+ * relleno '=' o un espacio terminan los datos.
+ */
+int16_t InterpreteGcode::decodificarBase64(const String& datos) {
+    uint16_t acumulado = 0;
+    uint8_t bits = 0;
+    int16_t cantidad = 0;
+    for (unsigned int i = 0; i < datos.length(); i++) {
+        char c = datos[i];
+        if (c == '=' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            break;
+        }
+        int8_t valor = valorBase64(c);
+        if (valor < 0) {
+            return -1;
+        }
+        acumulado = (acumulado << 6) | valor;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (cantidad >= MAXIMO_PIXELES_RASTER) {
+                return -1;
+            }
+            pixeles_[cantidad++] = (acumulado >> bits) & 0xFF;
+        }
+    }
+    return cantidad;
 }
 
 void InterpreteGcode::procesarSeleccionUnidades() {
@@ -76,8 +317,17 @@ bool InterpreteGcode::procesarComando(const String& comando) {
     // Reiniciar valores para nuevo comando
     reiniciarValores();
     
-    // Convertir a mayusculas para procesamiento case-insensitive
+    // La palabra D cierra la linea y su base64 distingue mayusculas: se
+    // separa antes de convertir el resto
     String comando_upper = comando;
+    String datos_raster = "";
+    int indice_d = buscarPalabraRaster(comando);
+    if (indice_d != -1) {
+        datos_raster = comando.substring(indice_d + 1);
+        comando_upper = comando.substring(0, indice_d);
+    }
+    
+    // Convertir a mayusculas para procesamiento case-insensitive
     comando_upper.toUpperCase();
     
     // Eliminar espacios y tabulaciones
@@ -93,11 +343,15 @@ bool InterpreteGcode::procesarComando(const String& comando) {
     Serial.println(comando_upper);
 #endif
 
-    // Extraer codigo G
+    // Extraer codigo G. G17/G18/G19 solo cambian el plano modal de los arcos
+    // y pueden ir en la misma linea que el movimiento ("G18 G2 ...")
     int indice_g = comando_upper.indexOf('G');
-    if (indice_g != -1) {
+    int subcodigo_g = -1;
+    bool hay_codigo_g = false;
+    while (indice_g != -1 && !hay_codigo_g) {
         String codigo_str = "";
-        for (int i = indice_g + 1; i < comando_upper.length(); i++) {
+        unsigned int i = indice_g + 1;
+        for (; i < comando_upper.length(); i++) {
             char c = comando_upper[i];
             if (c >= '0' && c <= '9') {
                 codigo_str += c;
@@ -105,14 +359,47 @@ bool InterpreteGcode::procesarComando(const String& comando) {
                 break;
             }
         }
-        comando_actual_.comando = codigo_str.toInt();
+        int codigo = codigo_str.toInt();
+        if (codigo >= 17 && codigo <= 19) {
+            plano_ = codigo - 17;
+            indice_g = comando_upper.indexOf('G', i);
+            continue;
+        }
+        comando_actual_.comando = codigo;
+        hay_codigo_g = true;
+        // Subcodigo de un solo digito (G38.2)
+        if (i + 1 < comando_upper.length() && comando_upper[i] == '.' &&
+            comando_upper[i + 1] >= '0' && comando_upper[i + 1] <= '9') {
+            subcodigo_g = comando_upper[i + 1] - '0';
+        }
+    }
+    if (!hay_codigo_g) {
+        if (procesarConfiguracion(comando_upper)) {
+            // Sus X/Y/Z son valores de configuracion, no un movimiento
+            return true;
+        }
+        if (contienePalabra(comando_upper, 'X') || contienePalabra(comando_upper, 'Y') ||
+            contienePalabra(comando_upper, 'Z')) {
+            // Solo ejes: se repite el ultimo modo de movimiento
+            comando_actual_.comando = modo_movimiento_;
+        }
     }
 
-    // Extraer valores de ejes y parametros
-    comando_actual_.x = extraerValor(comando_upper, "X");
-    comando_actual_.y = extraerValor(comando_upper, "Y"); 
-    comando_actual_.z = extraerValor(comando_upper, "Z");
-    comando_actual_.velocidad = extraerValor(comando_upper, "F");
+    // El avance es modal: se conserva hasta la siguiente palabra F
+    if (contienePalabra(comando_upper, 'F')) {
+        velocidad_modal_ = extraerValor(comando_upper, "F");
+    }
+    comando_actual_.velocidad = velocidad_modal_;
+    
+    bool cambia_cortadora = procesarCortadora(comando_upper);
+
+    if (comando_actual_.comando == COMANDO_GCODE_NINGUNO) {
+        if (cambia_cortadora) {
+            // Pausa nula: el cambio de la cortadora espera su turno en la cola
+            comando_actual_.comando = 4;
+        }
+        return true; // Linea sin movimiento ni codigo G (M, S, F sueltos)
+    }
 
 #if MODO_DESARROLLADOR
     Serial.print(F("Parametros extraidos - G"));
@@ -131,16 +418,56 @@ bool InterpreteGcode::procesarComando(const String& comando) {
     switch (comando_actual_.comando) {
         case 0:  // Movimiento rapido
         case 1:  // Interpolacion lineal
+            if (indice_d != -1) {
+                int16_t cantidad = (comando_actual_.comando == 1) ? decodificarBase64(datos_raster) : -1;
+                if (cantidad <= 0) {
+#if MODO_DESARROLLADOR
+                    Serial.println(F("Linea de grabado invalida: D solo en G01 con base64 de 1 a MAXIMO_PIXELES_RASTER pixeles"));
+#endif
+                    return false;
+                }
+                comando_actual_.pixeles = pixeles_;
+                comando_actual_.num_pixeles = cantidad;
+            }
+            modo_movimiento_ = comando_actual_.comando;
+            calcularDestino(comando_upper);
             procesarInterpolacionLineal();
             break;
             
         case 2:  // Interpolacion circular horaria
         case 3:  // Interpolacion circular antihoraria
-            procesarInterpolacionCircular();
+            {
+                float inicio[3] = {posicion_[0], posicion_[1], posicion_[2]};
+                calcularDestino(comando_upper);
+                if (!procesarInterpolacionCircular(comando_upper, inicio)) {
+                    // Arco descartado: la posicion programada no cambia
+                    for (uint8_t i = 0; i < 3; i++) {
+                        posicion_[i] = inicio[i];
+                    }
+                    return false;
+                }
+                modo_movimiento_ = comando_actual_.comando;
+            }
             break;
             
         case 4:  // Parada programada
-            procesarParadaProgramada();
+            procesarParadaProgramada(comando_upper);
+            break;
+            
+        case 29: // Malla de alturas: I ancho, J alto, P nodos por lado (P0 la borra)
+            comando_actual_.i = extraerValor(comando_upper, "I");
+            comando_actual_.j = extraerValor(comando_upper, "J");
+            comando_actual_.puntos_malla = (uint8_t)extraerValor(comando_upper, "P");
+            break;
+            
+        case 38: // Sondeo hacia la pieza hasta contacto
+            if (subcodigo_g != 2) {
+#if MODO_DESARROLLADOR
+                Serial.println(F("Solo se admite el sondeo G38.2"));
+#endif
+                return false;
+            }
+            calcularDestino(comando_upper);
             break;
             
         case 20: // Unidades en pulgadas
@@ -149,17 +476,23 @@ bool InterpreteGcode::procesarComando(const String& comando) {
             break;
             
         case 90: // Posicionamiento absoluto
+            posicionamiento_absoluto_ = true;
 #if MODO_DESARROLLADOR
             Serial.println(F("Estableciendo posicionamiento absoluto G90"));
 #endif
             break;
             
         case 91: // Posicionamiento relativo
+            posicionamiento_absoluto_ = false;
 #if MODO_DESARROLLADOR
             Serial.println(F("Estableciendo posicionamiento relativo G91"));
 #endif
             break;
             
+        case 92: // Origen de trabajo
+            procesarOrigenTrabajo(comando_upper);
+            break;
+            
         default:
 #if MODO_DESARROLLADOR
             Serial.print(F("Codigo G no reconocido: G"));
@@ -168,6 +501,9 @@ bool InterpreteGcode::procesarComando(const String& comando) {
             return false;
     }
     
+    comando_actual_.x = posicion_[0];
+    comando_actual_.y = posicion_[1];
+    comando_actual_.z = posicion_[2];
     return true;
 }
 
@@ -179,14 +515,35 @@ void InterpreteGcode::establecerComandoActual(const ComandoGcode& comando) {
     comando_actual_ = comando;
 }
 
+void InterpreteGcode::establecerPosicion(const float *posicion_mm) {
+    for (uint8_t i = 0; i < 3; i++) {
+        posicion_[i] = posicion_mm[i];
+    }
+    reiniciarValores();
+}
+
 void InterpreteGcode::reiniciarValores() {
-    comando_actual_.x = 0.0f;
-    comando_actual_.y = 0.0f; 
-    comando_actual_.z = 0.0f;
-    comando_actual_.velocidad = 0.0f;
-    comando_actual_.comando = 0;
+    comando_actual_.x = posicion_[0];
+    comando_actual_.y = posicion_[1]; 
+    comando_actual_.z = posicion_[2];
+    for (uint8_t i = 0; i < 3; i++) {
+        comando_actual_.inicio[i] = posicion_[i];
+    }
+    comando_actual_.i = 0.0f;
+    comando_actual_.j = 0.0f;
+    comando_actual_.k = 0.0f;
+    comando_actual_.plano = plano_;
+    comando_actual_.velocidad = velocidad_modal_;
+    comando_actual_.pausa_s = 0.0f;
+    comando_actual_.velocidad_cortadora = velocidad_cortadora_;
+    comando_actual_.modo_cortadora = modo_cortadora_;
+    comando_actual_.pixeles = nullptr;
+    comando_actual_.num_pixeles = 0;
+    comando_actual_.puntos_malla = 0;
+    comando_actual_.tipo_ajuste = AJUSTE_NINGUNO;
+    comando_actual_.comando = COMANDO_GCODE_NINGUNO;
 }
 
 bool InterpreteGcode::hayComandoValido() const {
-    return comando_actual_.comando != 0;
+    return comando_actual_.comando != COMANDO_GCODE_NINGUNO;
 }
\ No newline at end of file
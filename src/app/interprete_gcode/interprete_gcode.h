@@ -19,11 +19,48 @@
  * 
  * Esta clase se encarga de parsear comandos G-code y almacenar los datos
  * en una estructura ComandoGcode para su posterior uso.
+ * 
+ * Guarda el estado modal entre lineas (G90/G91, G00/G01, G17/G18/G19, F,
+ * M3/M4/M5, S y el origen de G92) y entrega siempre destinos absolutos en coordenadas de maquina, de
+ * modo que el ControladorCNC solo resta posiciones enteras en pasos.
+ * 
+ * Grabado raster: "G1 X.. D<base64>" reparte a lo largo del movimiento un
+ * pixel por byte decodificado (0-255, fraccion del S vigente). La palabra D
+ * va siempre al final de la linea.
  */
 class InterpreteGcode {
 private:
     ComandoGcode comando_actual_; ///< Estructura con los datos del comando actual
     
+    bool posicionamiento_absoluto_; ///< true con G90, false con G91
+    uint8_t modo_movimiento_;       ///< Ultimo G00/G01 programado (las lineas solo con ejes lo repiten)
+    uint8_t plano_;                 ///< Plano de los arcos (PlanoArco) elegido con G17/G18/G19
+    float velocidad_modal_;         ///< Ultimo avance F programado (mm/min)
+    uint8_t modo_cortadora_;        ///< Ultimo M3/M4/M5 programado
+    float velocidad_cortadora_;     ///< Ultimo valor S programado
+    float posicion_[3];             ///< Posicion programada en coordenadas de maquina (mm)
+    float origen_g92_[3];           ///< Origen de trabajo fijado con G92, en coordenadas de maquina (mm)
+    uint8_t pixeles_[MAXIMO_PIXELES_RASTER]; ///< Potencias decodificadas de la ultima linea de grabado
+    
+    /**
+     * @brief Indica si la linea contiene la palabra indicada
+     * @param cadena Linea en mayusculas
+     * @param letra Letra de la palabra (ej: 'X')
+     */
+    bool contienePalabra(const String& cadena, char letra) const;
+    
+    /**
+     * @brief Aplica G90/G91 y G92 a los ejes presentes y actualiza la posicion programada
+     * @param cadena Linea en mayusculas
+     */
+    void calcularDestino(const String& cadena);
+    
+    /**
+     * @brief Fija el origen de trabajo (G92) de los ejes presentes en la posicion actual
+     * @param cadena Linea en mayusculas
+     */
+    void procesarOrigenTrabajo(const String& cadena);
+    
     /**
      * @brief Extrae valor numerico de una cadena
      * @param cadena Cadena de texto a procesar
@@ -39,13 +76,57 @@ private:
     
     /**
      * @brief Procesa comando de interpolacion circular (G02, G03)  
+     * @param cadena Linea en mayusculas
+     * @param inicio Posicion programada antes de la linea (mm)
+     * @return false si el arco no es valido (sin centro, radio demasiado corto
+     *         o desplazamiento del centro en el eje lineal del plano)
+     * 
+     * Deja en comando_actual_ el centro como desplazamiento I/J/K desde el
+     * inicio en el plano vigente; el formato R se convierte aqui.
      */
-    void procesarInterpolacionCircular();
+    bool procesarInterpolacionCircular(const String& cadena, const float *inicio);
     
     /**
      * @brief Procesa comando de parada programada (G04)
+     * @param cadena Linea en mayusculas
+     * 
+     * La duracion se da con P o con S, ambas en segundos como en grbl y
+     * LinuxCNC; si aparecen las dos manda P.
      */
-    void procesarParadaProgramada();
+    void procesarParadaProgramada(const String& cadena);
+    
+    /**
+     * @brief Actualiza el estado modal de la cortadora con las palabras M y S
+     * @param cadena Linea en mayusculas
+     * @return true si la linea trae M3/M4/M5, M2/M30 o S
+     * 
+     * M2 y M30 (fin de programa) apagan la cortadora. En una linea G04 la S es
+     * la duracion de la pausa, no la velocidad.
+     */
+    bool procesarCortadora(const String& cadena);
+    
+    /**
+     * @brief Reconoce un cambio de configuracion de la maquina
+     * @param cadena Linea en mayusculas, sin codigo G
+     * @return true si la linea es M92 (pasos/mm), M203 (velocidad maxima,
+     *         mm/min) o M201 (aceleracion, mm/s^2); los ejes ausentes no cambian
+     */
+    bool procesarConfiguracion(const String& cadena);
+    
+    /**
+     * @brief Posicion de la palabra D de grabado
+     * @param linea Linea tal como llega (el base64 distingue mayusculas)
+     * @return Indice de la D, o -1 si no hay (las de los comentarios no cuentan)
+     */
+    int buscarPalabraRaster(const String& linea) const;
+    
+    /**
+     * @brief Decodifica los pixeles de una linea de grabado en pixeles_
+     * @param datos Texto base64 que sigue a la D
+     * @return Numero de pixeles, o -1 si el texto no es base64 valido o pasa
+     *         de MAXIMO_PIXELES_RASTER
+     */
+    int16_t decodificarBase64(const String& datos);
     
     /**
      * @brief Procesa comando de seleccion de unidades (G20, G21)
@@ -79,9 +160,20 @@ public:
     
     /**
      * @brief Reinicia los valores de la estructura comando_actual_
+     * 
+     * Las coordenadas y el inicio quedan en la posicion programada actual; el
+     * estado modal no cambia.
      */
     void reiniciarValores();
     
+    /**
+     * @brief Sustituye la posicion programada por la posicion real de la maquina
+     * @param posicion_mm Coordenadas de maquina X, Y, Z
+     * 
+     * Se usa tras la calibracion, cuando la maquina se ha movido sin pasar por el interprete.
+     */
+    void establecerPosicion(const float *posicion_mm);
+    
     /**
      * @brief Verifica si hay un comando G-code valido almacenado
      * @return true si hay un comando valido, false en caso contrario
@@ -0,0 +1,145 @@
+#include "configuracion_maquina.h"
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+/**
+ * @brief Formato de la configuracion en EEPROM
+ */
+struct RegistroAjustes {
+    uint8_t version;         ///< VERSION_EEPROM_AJUSTES
+    AjustesMaquina ajustes;
+    uint16_t crc;            ///< CRC-16 de version y ajustes
+};
+
+// validar() recorre los ajustes como una tabla de float
+static_assert(sizeof(AjustesMaquina) == 4 * NUM_EJES * sizeof(float),
+              "ConfiguracionMaquina: AjustesMaquina solo debe tener tablas de float");
+static_assert(DIRECCION_EEPROM_AJUSTES + sizeof(RegistroAjustes) <= DIRECCION_EEPROM_MALLA,
+              "ConfiguracionMaquina: la configuracion pisa la malla de alturas en EEPROM");
+static_assert(PASOS_POR_MM_X * VELOCIDAD_MAXIMA_X_MM_MIN / 60.0f <= TASA_MAXIMA_EVENTOS &&
+              PASOS_POR_MM_Y * VELOCIDAD_MAXIMA_Y_MM_MIN / 60.0f <= TASA_MAXIMA_EVENTOS &&
+              PASOS_POR_MM_Z * VELOCIDAD_MAXIMA_Z_MM_MIN / 60.0f <= TASA_MAXIMA_EVENTOS,
+              "ConfiguracionMaquina: la velocidad maxima por defecto supera TASA_MAXIMA_EVENTOS");
+
+AjustesMaquina ConfiguracionMaquina::ajustes = {
+    {PASOS_POR_MM_X, PASOS_POR_MM_Y, PASOS_POR_MM_Z},
+    {VELOCIDAD_MAXIMA_X_MM_MIN, VELOCIDAD_MAXIMA_Y_MM_MIN, VELOCIDAD_MAXIMA_Z_MM_MIN},
+    {ACELERACION_X_MM_S2, ACELERACION_Y_MM_S2, ACELERACION_Z_MM_S2},
+    {SOBREACELERACION_X_MM_S3, SOBREACELERACION_Y_MM_S3, SOBREACELERACION_Z_MM_S3}
+};
+
+// Derivados de los valores por defecto, validos antes de cargar()
+float ConfiguracionMaquina::mm_por_paso[NUM_EJES] = {
+    1.0f / PASOS_POR_MM_X, 1.0f / PASOS_POR_MM_Y, 1.0f / PASOS_POR_MM_Z
+};
+float ConfiguracionMaquina::velocidad_maxima_mm_s[NUM_EJES] = {
+    VELOCIDAD_MAXIMA_X_MM_MIN / 60.0f, VELOCIDAD_MAXIMA_Y_MM_MIN / 60.0f, VELOCIDAD_MAXIMA_Z_MM_MIN / 60.0f
+};
+
+void ConfiguracionMaquina::derivar() {
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        mm_por_paso[i] = 1.0f / ajustes.pasos_por_mm[i];
+        velocidad_maxima_mm_s[i] = ajustes.velocidad_maxima_mm_min[i] / 60.0f;
+    }
+}
+
+uint16_t ConfiguracionMaquina::calcularCrc(const AjustesMaquina &datos) {
+    uint16_t crc = _crc16_update(0xFFFF, VERSION_EEPROM_AJUSTES);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&datos);
+    for (uint8_t i = 0; i < sizeof(AjustesMaquina); i++) {
+        crc = _crc16_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+/**
+ * @brief Un valor no positivo dividiria por cero al derivar o pararia el
+ * planificador. Con mas eventos/s que TASA_MAXIMA_EVENTOS las tasas en Q16.16
+ * desbordarian y la ISR no llegaria a tiempo.
+ */
+bool ConfiguracionMaquina::validar(const AjustesMaquina &datos) {
+    const float *valores = reinterpret_cast<const float *>(&datos);
+    for (uint8_t i = 0; i < sizeof(AjustesMaquina) / sizeof(float); i++) {
+        if (!(valores[i] > 0.0f)) {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        if (datos.pasos_por_mm[i] * datos.velocidad_maxima_mm_min[i] / 60.0f > TASA_MAXIMA_EVENTOS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ConfiguracionMaquina::cargar() {
+    RegistroAjustes registro;
+    EEPROM.get(DIRECCION_EEPROM_AJUSTES, registro);
+    if (registro.version != VERSION_EEPROM_AJUSTES || registro.crc != calcularCrc(registro.ajustes)) {
+#if MODO_DESARROLLADOR
+        Serial.println(F("[ConfiguracionMaquina::cargar] Sin configuracion en EEPROM: valores por defecto"));
+#endif
+        return false;
+    }
+    if (!validar(registro.ajustes)) {
+#if MODO_DESARROLLADOR
+        Serial.println(F("[ConfiguracionMaquina::cargar] Configuracion en EEPROM fuera de rango: valores por defecto"));
+#endif
+        return false;
+    }
+    ajustes = registro.ajustes;
+    derivar();
+    return true;
+}
+
+void ConfiguracionMaquina::guardar() {
+    RegistroAjustes registro;
+    registro.version = VERSION_EEPROM_AJUSTES;
+    registro.ajustes = ajustes;
+    registro.crc = calcularCrc(ajustes);
+    // put() solo reescribe los bytes que cambian
+    EEPROM.put(DIRECCION_EEPROM_AJUSTES, registro);
+}
+
+/**
+ * @brief El cambio se prueba sobre una copia: unos pasos/mm validos pueden
+ * dejar fuera de rango la velocidad maxima que ya habia, y al reves.
+ */
+bool ConfiguracionMaquina::establecer(TipoAjusteMaquina tipo, const float *valores) {
+    AjustesMaquina nuevos = ajustes;
+    float *destino;
+    switch (tipo) {
+        case AJUSTE_PASOS_POR_MM:     destino = nuevos.pasos_por_mm; break;
+        case AJUSTE_VELOCIDAD_MAXIMA: destino = nuevos.velocidad_maxima_mm_min; break;
+        case AJUSTE_ACELERACION:      destino = nuevos.aceleracion_mm_s2; break;
+        default: return false;
+    }
+    bool cambio = false;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        if (valores[i] > 0.0f && valores[i] != destino[i]) {
+            destino[i] = valores[i];
+            cambio = true;
+        }
+    }
+    if (!cambio) {
+        return false;
+    }
+    if (!validar(nuevos)) {
+#if MODO_DESARROLLADOR
+        Serial.print(F("[ConfiguracionMaquina::establecer] Ajuste ")); Serial.print(tipo);
+        Serial.println(F(" rechazado: pasos/mm por velocidad maxima supera TASA_MAXIMA_EVENTOS"));
+#endif
+        return false;
+    }
+    ajustes = nuevos;
+    derivar();
+    guardar();
+
+#if MODO_DESARROLLADOR
+    Serial.print(F("[ConfiguracionMaquina::establecer] Ajuste ")); Serial.print(tipo);
+    Serial.print(F(" X: ")); Serial.print(destino[EJE_X]);
+    Serial.print(F(" Y: ")); Serial.print(destino[EJE_Y]);
+    Serial.print(F(" Z: ")); Serial.println(destino[EJE_Z]);
+#endif
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef CONFIGURACION_MAQUINA_H
+#define CONFIGURACION_MAQUINA_H
+
+#include <Arduino.h>
+#include "constantes.h"
+#include "generador_pasos.h"
+
+/**
+ * @file configuracion_maquina.h
+ * @brief Configuracion por eje de la maquina, guardada en EEPROM con CRC
+ *
+ * @details Pasos por mm, velocidad maxima, aceleracion y sobreaceleracion de
+ * cada eje se leen de la EEPROM al arrancar; si el registro no existe, es de
+ * otra version o su CRC no cuadra, se usan los valores de constantes.h. Lo que
+ * el planificador necesita por bloque (reciprocos, velocidades en mm/s) se
+ * calcula una vez al cargar o cambiar la configuracion.
+ *
+ * Se cambia desde el G-code con M92 (pasos/mm), M203 (velocidad maxima,
+ * mm/min) y M201 (aceleracion, mm/s^2); cada cambio se guarda al momento.
+ */
+
+/**
+ * @enum TipoAjusteMaquina
+ * @brief Valor de la configuracion que cambia una linea M92/M201/M203
+ */
+enum TipoAjusteMaquina : uint8_t {
+    AJUSTE_NINGUNO,            ///< La linea no cambia la configuracion
+    AJUSTE_PASOS_POR_MM,       ///< M92
+    AJUSTE_VELOCIDAD_MAXIMA,   ///< M203
+    AJUSTE_ACELERACION         ///< M201
+};
+
+/**
+ * @struct AjustesMaquina
+ * @brief Configuracion tal como se guarda en EEPROM
+ */
+struct AjustesMaquina {
+    float pasos_por_mm[NUM_EJES];             ///< Pasos por milimetro
+    float velocidad_maxima_mm_min[NUM_EJES];  ///< Velocidad maxima (mm/min)
+    float aceleracion_mm_s2[NUM_EJES];        ///< Aceleracion maxima (mm/s^2)
+    float sobreaceleracion_mm_s3[NUM_EJES];   ///< Sobreaceleracion maxima (mm/s^3)
+};
+
+/**
+ * @class ConfiguracionMaquina
+ * @brief Configuracion estatica de la maquina (solo hay una)
+ */
+class ConfiguracionMaquina {
+private:
+    static AjustesMaquina ajustes;
+    static float mm_por_paso[NUM_EJES];          ///< Reciproco de pasos_por_mm
+    static float velocidad_maxima_mm_s[NUM_EJES]; ///< velocidad_maxima_mm_min / 60
+
+    /**
+     * @brief Recalcula los valores derivados
+     */
+    static void derivar();
+
+    /**
+     * @brief CRC-16 de la version y los ajustes
+     */
+    static uint16_t calcularCrc(const AjustesMaquina &datos);
+
+    /**
+     * @brief Comprueba que una configuracion se pueda usar
+     * @return false si algun valor no es positivo o algun eje pasaria de TASA_MAXIMA_EVENTOS
+     */
+    static bool validar(const AjustesMaquina &datos);
+
+public:
+    /**
+     * @brief Lee la configuracion de la EEPROM
+     * @return false si no habia una valida (se quedan los valores por defecto)
+     */
+    static bool cargar();
+
+    /**
+     * @brief Guarda la configuracion actual en EEPROM
+     */
+    static void guardar();
+
+    /**
+     * @brief Cambia un valor de la configuracion y la guarda
+     * @param tipo Valor que se cambia
+     * @param valores Nuevo valor de cada eje; 0 o negativo lo deja como esta
+     * @return false si ningun eje cambio o el resultado no pasa validar()
+     */
+    static bool establecer(TipoAjusteMaquina tipo, const float *valores);
+
+    static float pasosPorMm(uint8_t eje) { return ajustes.pasos_por_mm[eje]; }
+    static float mmPorPaso(uint8_t eje) { return mm_por_paso[eje]; }
+
+    /**
+     * @brief Velocidades maximas de los tres ejes en mm/s
+     */
+    static const float *velocidadesMaximas() { return velocidad_maxima_mm_s; }
+
+    /**
+     * @brief Aceleraciones maximas de los tres ejes en mm/s^2
+     */
+    static const float *aceleraciones() { return ajustes.aceleracion_mm_s2; }
+
+    /**
+     * @brief Sobreaceleraciones maximas de los tres ejes en mm/s^3
+     */
+    static const float *sobreaceleraciones() { return ajustes.sobreaceleracion_mm_s3; }
+};
+
+#endif // CONFIGURACION_MAQUINA_H
@@ -1,16 +1,74 @@
 
-#include <MultiStepperLite.h>
-
 #include "controlador_cnc.h"
 #include "constantes.h"
 #include "comando_gcode.h"
 #include "pines.h"
+#include "pin_rapido.h"
+
+/**
+ * @brief Recorrido angular por debajo del cual un arco con inicio y final
+ * iguales se toma como circulo completo
+ */
+static const float EPSILON_ANGULO_ARCO = 5.0e-7f;
+
+/**
+ * @brief Z primero, para que la herramienta se aleje de la pieza antes de mover X e Y
+ */
+static const uint8_t ORDEN_CALIBRACION[NUM_EJES] = {EJE_Z, EJE_X, EJE_Y};
+
+static const float RECORRIDO_MAXIMO_MM[NUM_EJES] = {RECORRIDO_MAXIMO_X_MM, RECORRIDO_MAXIMO_Y_MM, RECORRIDO_MAXIMO_Z_MM};
+
+static const float HOLGURA_MM[NUM_EJES] = {HOLGURA_X_MM, HOLGURA_Y_MM, HOLGURA_Z_MM};
+
+static_assert(ESCUADRA_XY > -0.1f && ESCUADRA_XY < 0.1f && ESCUADRA_XZ > -0.1f && ESCUADRA_XZ < 0.1f &&
+              ESCUADRA_YZ > -0.1f && ESCUADRA_YZ < 0.1f,
+              "ControladorCNC: un error de escuadra de mas de 0.1 desborda la correccion en Q16");
+
+/**
+ * @brief Indices de escuadra_q16
+ */
+enum : uint8_t { ESCUADRA_PLANO_XY, ESCUADRA_PLANO_XZ, ESCUADRA_PLANO_YZ };
 
-ControladorCNC::ControladorCNC(MultiStepperLite &miControladorMotores_ref):
-    controlador_motores(miControladorMotores_ref),
-    ejecutando_comando(false)
+ControladorCNC::ControladorCNC(GeneradorPasos &miGeneradorPasos_ref, FinalesCarrera &misFinalesCarrera_ref, Sonda &miSonda_ref):
+    posicion_pasos{0, 0, 0},
+    correccion_pasos{0, 0, 0},
+    escuadra_q16{lroundf(ESCUADRA_XY * UNO_Q16), lroundf(ESCUADRA_XZ * UNO_Q16), lroundf(ESCUADRA_YZ * UNO_Q16)},
+    ciclo_cortadora_planificado(0),
+    estado_cortadora_planificado(0),
+    sentido_holgura(0),
+    ajuste_pendiente(AJUSTE_NINGUNO),
+    valores_ajuste{0.0f, 0.0f, 0.0f},
+    fase_calibracion(CALIBRACION_INACTIVA),
+    orden_calibracion(0),
+    alarma(ALARMA_NINGUNA),
+    maquina_calibrada(false),
+    fase_sondeo(SONDEO_INACTIVO),
+    destino_sondeo{0.0f, 0.0f, 0.0f},
+    velocidad_sondeo(0.0f),
+    midiendo_malla(false),
+    punto_malla(0),
+    z_seguro_mm(0.0f),
+    fase_manual(MANUAL_INACTIVO),
+    eje_manual(EJE_X),
+    manual_positivo(true),
+    incremento_manual_mm(0.0f),
+    generador_pasos(miGeneradorPasos_ref),
+    finales_carrera(misFinalesCarrera_ref),
+    sonda(miSonda_ref)
 {
-   
+    arco.activo = false;
+    tramo.activo = false;
+    aplicarConfiguracion();
+}
+
+void ControladorCNC::aplicarConfiguracion() {
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        // Tras calibrar cada eje queda a RETROCESO_CALIBRACION_MM del final; el
+        // cero de maquina es el punto de disparo y no se debe volver a el
+        limite_minimo_pasos[i] = convertirMmAPasos(RETROCESO_CALIBRACION_MM, i);
+        limite_maximo_pasos[i] = convertirMmAPasos(RECORRIDO_MAXIMO_MM[i], i);
+        holgura_pasos[i] = convertirMmAPasos(HOLGURA_MM[i], i);
+    }
 }
 
 
@@ -21,48 +79,57 @@ ControladorCNC::ControladorCNC(MultiStepperLite &miControladorMotores_ref):
  */
 void ControladorCNC::configurarPinesMotores() {
     // Configurar pines de enable y direccion
-    pinMode(PIN_MOTOR_X_EN, OUTPUT);
-    pinMode(PIN_MOTOR_X_DIR, OUTPUT);
-    digitalWrite(PIN_MOTOR_X_EN, LOW);
-    digitalWrite(PIN_MOTOR_X_DIR, LOW);
+    PinRapido<PIN_MOTOR_X_EN>::salida();
+    PinRapido<PIN_MOTOR_X_DIR>::salida();
+    PinRapido<PIN_MOTOR_X_EN>::bajo();
+    PinRapido<PIN_MOTOR_X_DIR>::bajo();
     
-    pinMode(PIN_MOTOR_Y_EN, OUTPUT);
-    pinMode(PIN_MOTOR_Y_DIR, OUTPUT);
-    digitalWrite(PIN_MOTOR_Y_EN, LOW);
-    digitalWrite(PIN_MOTOR_Y_DIR, LOW);
+    PinRapido<PIN_MOTOR_Y_EN>::salida();
+    PinRapido<PIN_MOTOR_Y_DIR>::salida();
+    PinRapido<PIN_MOTOR_Y_EN>::bajo();
+    PinRapido<PIN_MOTOR_Y_DIR>::bajo();
     
-    pinMode(PIN_MOTOR_Z_EN, OUTPUT);
-    pinMode(PIN_MOTOR_Z_DIR, OUTPUT);
-    digitalWrite(PIN_MOTOR_Z_EN, LOW);
-    digitalWrite(PIN_MOTOR_Z_DIR, LOW);
+    PinRapido<PIN_MOTOR_Z_EN>::salida();
+    PinRapido<PIN_MOTOR_Z_DIR>::salida();
+    PinRapido<PIN_MOTOR_Z_EN>::bajo();
+    PinRapido<PIN_MOTOR_Z_DIR>::bajo();
 }
 
 /**
- * @brief Llama a la referencia de la clase MultiStepper para inicializar los motores
+ * @brief Llama a la referencia del generador de pasos para inicializar los pines de paso
  * 
  */
 void ControladorCNC::inicializarMotores() {
-    // Inicializar cada motor con su indice y pin de step
-    controlador_motores.init_stepper(EJE_X, PIN_MOTOR_X_PUL); 
-    controlador_motores.init_stepper(EJE_Y, PIN_MOTOR_Y_PUL); 
-    controlador_motores.init_stepper(EJE_Z, PIN_MOTOR_Z_PUL);
+    // La malla y los limites se pasan a pasos con la configuracion cargada
+    ConfiguracionMaquina::cargar();
+    aplicarConfiguracion();
+    generador_pasos.inicializar();
+    finales_carrera.inicializar();
+    sonda.inicializar();
+    Cortadora::inicializar();
+    mapa.cargar();
 }
 
-long ControladorCNC::convertirMmAPasos(float distancia_mm, float pasos_por_mm) {
-    return static_cast<long>(distancia_mm * pasos_por_mm);
+int32_t ControladorCNC::convertirMmAPasos(float posicion_mm, uint8_t eje) const {
+    return lroundf(posicion_mm * ConfiguracionMaquina::pasosPorMm(eje));
 }
 
-unsigned long ControladorCNC::calcularDelayVelocidad(float velocidad_mm_min, float pasos_por_mm) {
-    if (velocidad_mm_min <= 0) {
-        return 1000; // Velocidad por defecto lenta
+/**
+ * @brief Cada eje i recibe la fraccion |delta_i| / distancia de la aceleracion
+ * (o sobreaceleracion) sobre la trayectoria; se toma el minimo que respeta el
+ * limite de todos.
+ */
+float ControladorCNC::calcularLimiteBloque(const float *limite_eje, const float *inverso_unitario) const {
+    float limite_bloque = 0;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        if (inverso_unitario[i] > 0) {
+            float limite = limite_eje[i] * inverso_unitario[i];
+            if (limite_bloque == 0 || limite < limite_bloque) {
+                limite_bloque = limite;
+            }
+        }
     }
-    
-    // Convertir velocidad de mm/min a microsegundos/paso
-    float mm_por_segundo = velocidad_mm_min / 60.0f;
-    float pasos_por_segundo = mm_por_segundo * pasos_por_mm;
-    float microsegundos_por_paso = 1000000.0f / pasos_por_segundo;
-    
-    return static_cast<unsigned long>(microsegundos_por_paso);
+    return limite_bloque;
 }
 
 /**
@@ -72,7 +139,6 @@ unsigned long ControladorCNC::calcularDelayVelocidad(float velocidad_mm_min, flo
  */
 void ControladorCNC::establecerComando(const ComandoGcode& comando) {
     comando_actual = comando;
-    ejecutando_comando = false;
 }
 
 /**
@@ -82,16 +148,12 @@ void ControladorCNC::establecerComando(const ComandoGcode& comando) {
  * @return false El comando establecido no es valido o no existe
  */
 bool ControladorCNC::ejecutarComando() {
-    if (ejecutando_comando) {
-#if MODO_DESARROLLADOR
-        Serial.println(F("Error: Ya hay un comando en ejecucion"));
-#endif
-        return false;
-    }
-    
-    if (comando_actual.comando == 0) {
+    if (comando_actual.comando == COMANDO_GCODE_NINGUNO) {
         return false; // Comando no valido
     }
+    if (alarma != ALARMA_NINGUNA) {
+        return false; // Sin movimientos hasta restablecer la alarma
+    }
     
 #if MODO_DESARROLLADOR
     Serial.print(F("[ControladorCNC::ejecutarComando]Ejecutando comando G"));
@@ -104,69 +166,80 @@ bool ControladorCNC::ejecutarComando() {
         case 0: // Movimiento rapido (G00)
         case 1: // Interpolacion lineal (G01)
             {
-                // Calcular pasos para cada eje
-                long pasos_x = convertirMmAPasos(comando_actual.x, pasos_por_mm_x);
-                long pasos_y = convertirMmAPasos(comando_actual.y, pasos_por_mm_y);
-                long pasos_z = convertirMmAPasos(comando_actual.z, pasos_por_mm_z);
-                
-                // Calcular delays basados en velocidad
-                unsigned long delay_x, delay_y, delay_z;
-                
-                if (comando_actual.comando == 0) {
-                    // G00: Movimiento rapido - velocidad fija rapida
-                    delay_x = 1000; // 1ms entre pasos para movimiento rapido
-                    delay_y = 1000;
-                    delay_z = 1000;
-                } else {
-                    // G01: Movimiento a velocidad especificada
-                    delay_x = calcularDelayVelocidad(comando_actual.velocidad, pasos_por_mm_x);
-                    delay_y = calcularDelayVelocidad(comando_actual.velocidad, pasos_por_mm_y);
-                    delay_z = calcularDelayVelocidad(comando_actual.velocidad, pasos_por_mm_z);
-                }
-                
-                // Configurar direcciones
-                digitalWrite(PIN_MOTOR_X_DIR, pasos_x >= 0 ? LOW : HIGH);
-                digitalWrite(PIN_MOTOR_Y_DIR, pasos_y >= 0 ? LOW : HIGH);
-                digitalWrite(PIN_MOTOR_Z_DIR, pasos_z >= 0 ? LOW : HIGH);
-                
-                // Tomar valores absolutos para los pasos
-                pasos_x = abs(pasos_x);
-                pasos_y = abs(pasos_y);
-                pasos_z = abs(pasos_z);
-                
-                // Iniciar movimientos finitos para cada eje que tenga movimiento
-                if (pasos_x > 0) {
-                    controlador_motores.start_finite(EJE_X, delay_x, pasos_x);
-                }
-                if (pasos_y > 0) {
-                    controlador_motores.start_finite(EJE_Y, delay_y, pasos_y);
+                float destino[NUM_EJES] = {comando_actual.x, comando_actual.y, comando_actual.z};
+                comando_aceptado = comando_actual.num_pixeles <= generador_pasos.espacioPixeles() &&
+                                   comprobarLimitesSoftware(destino, destino) &&
+                                   planificarMovimientoLineal(destino);
+            }
+            break;
+            
+        case 2: // Interpolacion circular horaria (G02)
+        case 3: // Interpolacion circular antihoraria (G03)
+            comando_aceptado = iniciarArco();
+            if (comando_aceptado) {
+                continuarArco();
+            }
+            break;
+            
+        case 4: // Parada programada (G04)
+            comando_aceptado = planificarPausa();
+            break;
+            
+        case 29: // Medida de la malla de alturas (G29)
+            {
+                // La rejilla empieza en el XY actual; el Z actual es la altura segura
+                float origen[2] = {posicion_pasos[EJE_X] * ConfiguracionMaquina::mmPorPaso(EJE_X), posicion_pasos[EJE_Y] * ConfiguracionMaquina::mmPorPaso(EJE_Y)};
+                float tamano[2] = {comando_actual.i, comando_actual.j};
+                z_seguro_mm = posicion_pasos[EJE_Z] * ConfiguracionMaquina::mmPorPaso(EJE_Z);
+                if (comando_actual.puntos_malla == 0) {
+                    // G29 P0: deja de compensar y borra la malla guardada
+                    mapa.borrar();
+                    comando_aceptado = true;
+                    break;
                 }
-                if (pasos_z > 0) {
-                    controlador_motores.start_finite(EJE_Z, delay_z, pasos_z);
+                float minimo[NUM_EJES] = {origen[0], origen[1], z_seguro_mm - PROFUNDIDAD_SONDEO_MALLA_MM};
+                float maximo[NUM_EJES] = {origen[0] + tamano[0], origen[1] + tamano[1], z_seguro_mm};
+                comando_aceptado = mapa.preparar(origen, tamano, comando_actual.puntos_malla) &&
+                                   comprobarLimitesSoftware(minimo, maximo);
+                if (comando_aceptado) {
+                    midiendo_malla = true;
+                    punto_malla = 0;
+                    velocidad_sondeo = VELOCIDAD_SONDEO_MALLA_MM_MIN;
+                    prepararPuntoMalla();
+                } else {
+                    mapa.cargar(); // Se conserva la malla anterior
                 }
-                #if MODO_DESARROLLADOR
-                Serial.print(F("[ ControladorCNC::ejecutarComando] Start finite - EjeX pasos: ")); Serial.print(pasos_x); Serial.print(" delayX: "); Serial.println(delay_x);
-                Serial.print(F("[ ControladorCNC::ejecutarComando] Start finite - EjeY pasos: ")); Serial.print(pasos_y); Serial.print(" delayY: "); Serial.println(delay_y);
-                Serial.print(F("[ ControladorCNC::ejecutarComando] Start finite - EjeZ pasos: ")); Serial.print(pasos_z); Serial.print(" delayZ: "); Serial.println(delay_z);
-                #endif
-                
-                comando_aceptado = true;
             }
             break;
             
-        case 4: // Parada programada (G04)
+        case 38: // Sondeo hasta contacto (G38.2)
             {
-                // Para G04, podriamos implementar un delay
-                // Por ahora simplemente marcamos como completado inmediatamente
-                comando_aceptado = true;
+                float destino[NUM_EJES] = {comando_actual.x, comando_actual.y, comando_actual.z};
+                comando_aceptado = comprobarLimitesSoftware(destino, destino);
+                if (comando_aceptado) {
+                    for (uint8_t i = 0; i < NUM_EJES; i++) {
+                        destino_sondeo[i] = destino[i];
+                    }
+                    velocidad_sondeo = (comando_actual.velocidad > 0.0f) ? comando_actual.velocidad : VELOCIDAD_SONDEO_MM_MIN;
+                    midiendo_malla = false;
+                    fase_sondeo = SONDEO_ESPERA;
+                }
+            }
+            break;
+            
+        case COMANDO_AJUSTE_MAQUINA: // M92, M201, M203
+            ajuste_pendiente = static_cast<TipoAjusteMaquina>(comando_actual.tipo_ajuste);
+            for (uint8_t i = 0; i < NUM_EJES; i++) {
+                valores_ajuste[i] = comando_actual.valores_ajuste[i];
             }
+            comando_aceptado = true;
             break;
             
         case 90: // Posicionamiento absoluto (G90)
         case 91: // Posicionamiento relativo (G91)
+        case 92: // Origen de trabajo (G92)
             {
-                // Estos comandos afectan como se interpretan las coordenadas
-                // Por ahora solo los registramos
+                // El interprete ya los aplico al calcular los destinos absolutos
                 comando_aceptado = true;
             }
             break;
@@ -180,61 +253,1068 @@ bool ControladorCNC::ejecutarComando() {
             break;
     }
     
-    if (comando_aceptado) {
-        ejecutando_comando = true;
+    return comando_aceptado;
+}
+
+bool ControladorCNC::planificadorConEspacio() const {
+    return planificador.cantidadBloques() + 2 <= TAMANO_BUFFER_PLANIFICADOR;
+}
+
+/**
+ * @brief Las lineas de grabado no se cortan: sus pixeles van repartidos sobre
+ * un unico bloque. Solo se corrige su destino.
+ */
+bool ControladorCNC::planificarMovimientoLineal(const float *destino_mm) {
+    if (!planificadorConEspacio()) {
+#if MODO_DESARROLLADOR
+        Serial.println(F("[ControladorCNC::planificarMovimientoLineal] Planificador lleno"));
+#endif
+        return false;
+    }
+    if (!compensacionActiva() || comando_actual.num_pixeles > 0 ||
+        (convertirMmAPasos(destino_mm[EJE_X], EJE_X) == posicion_pasos[EJE_X] &&
+         convertirMmAPasos(destino_mm[EJE_Y], EJE_Y) == posicion_pasos[EJE_Y])) {
+        return planificarRecta(destino_mm);
     }
     
-    return comando_aceptado;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        tramo.inicio[i] = posicion_pasos[i] * ConfiguracionMaquina::mmPorPaso(i);
+        tramo.destino[i] = destino_mm[i];
+    }
+    tramo.t = 0.0f;
+    tramo.activo = true;
+    continuarTramoMalla();
+    return true;
 }
 
-void ControladorCNC::actualizar(uint32_t tiempo_actual,float *posicion_motor) {
-    if (ejecutando_comando) {
-        // Actualizar el estado de todos los motores
-        #if MODO_DESARROLLADOR
-        Serial.print(F("[ControladorCNC::actualizar] Status is_running X:")); Serial.print(controlador_motores.is_running(EJE_X));
-        Serial.print(" Y:"); Serial.print(controlador_motores.is_running(EJE_Y));
-        Serial.print(" Z:"); Serial.println(controlador_motores.is_running(EJE_Z));
-        static uint32_t last_time = 0;
-        Serial.print(F("[ControladorCNC::actualizar] delta_t: "));
-        Serial.println(tiempo_actual - last_time);
-        last_time = tiempo_actual;
-        #endif
-        controlador_motores.do_tasks(tiempo_actual);
-        
-        // Verificar si todos los motores han terminado
-        bool todos_terminados = true;
-        for (int i = 0; i < 3; i++) {
-            if (controlador_motores.is_running(i)) {
-                todos_terminados = false;
-                break;
+/**
+ * @brief posicion_pasos sigue siendo la posicion programada; las correcciones
+ * solo entran en los pasos del bloque. Como el bloque anterior ya llevaba las
+ * suyas, cada bloque mueve la diferencia entre ambas.
+ */
+bool ControladorCNC::planificarRecta(const float *destino_mm) {
+    if (!planificadorConEspacio()) {
+        return false;
+    }
+    
+    // Destino absoluto en pasos; el desplazamiento es una resta entera
+    int32_t destino_pasos[NUM_EJES];
+    int32_t pasos[NUM_EJES];
+    bool movimiento_nulo = true;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        destino_pasos[i] = convertirMmAPasos(destino_mm[i], i);
+    }
+    int32_t correccion[NUM_EJES] = {0, 0, 0};
+    if (escuadraActiva()) {
+        corregirEscuadra(destino_pasos, correccion);
+    }
+    if (compensacionActiva()) {
+        correccion[EJE_Z] = mapa.correccion(destino_pasos[EJE_X], destino_pasos[EJE_Y]);
+    }
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        pasos[i] = destino_pasos[i] + correccion[i] - posicion_pasos[i] - correccion_pasos[i];
+        if (pasos[i] != 0) {
+            movimiento_nulo = false;
+        }
+    }
+    if (movimiento_nulo) {
+        // Movimiento nulo: se da por completado sin mover motores
+        return true;
+    }
+    
+    compensarHolgura(pasos);
+    agregarBloque(pasos, false);
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        posicion_pasos[i] = destino_pasos[i];
+        correccion_pasos[i] = correccion[i];
+    }
+    
+#if MODO_DESARROLLADOR
+    Serial.print(F("[ControladorCNC::planificarRecta] Pasos X: ")); Serial.print(pasos[EJE_X]);
+    Serial.print(F(" Y: ")); Serial.print(pasos[EJE_Y]);
+    Serial.print(F(" Z: ")); Serial.print(pasos[EJE_Z]);
+    Serial.print(F(" en cola: ")); Serial.println(planificador.cantidadBloques());
+#endif
+    return true;
+}
+
+/**
+ * @brief El siguiente corte es la linea de la rejilla mas cercana en X o en Y,
+ * pasada a fraccion de la recta; Z avanza en proporcion.
+ */
+void ControladorCNC::continuarTramoMalla() {
+    while (tramo.activo && planificadorConEspacio()) {
+        float siguiente = 1.0f;
+        for (uint8_t eje = EJE_X; eje <= EJE_Y; eje++) {
+            float delta = tramo.destino[eje] - tramo.inicio[eje];
+            float linea;
+            if (delta == 0.0f ||
+                !mapa.siguienteLinea(eje, tramo.inicio[eje] + tramo.t * delta, delta > 0.0f, linea)) {
+                continue;
+            }
+            float t_linea = (linea - tramo.inicio[eje]) / delta;
+            if (t_linea > tramo.t && t_linea < siguiente) {
+                siguiente = t_linea;
             }
         }
         
-        if (todos_terminados && ejecutando_comando) {
+        float punto[NUM_EJES];
+        if (siguiente >= 1.0f) {
+            // El ultimo trozo va al destino exacto
+            for (uint8_t i = 0; i < NUM_EJES; i++) {
+                punto[i] = tramo.destino[i];
+            }
+            tramo.activo = false;
+        } else {
+            for (uint8_t i = 0; i < NUM_EJES; i++) {
+                punto[i] = tramo.inicio[i] + siguiente * (tramo.destino[i] - tramo.inicio[i]);
+            }
+            tramo.t = siguiente;
+        }
+        planificarRecta(punto);
+    }
+}
+
+bool ControladorCNC::compensacionActiva() const {
+    return mapa.esValido() && fase_sondeo == SONDEO_INACTIVO && !calibrando();
+}
+
+bool ControladorCNC::escuadraActiva() const {
+    return !calibrando();
+}
+
+/**
+ * @brief Un eje inclinado hace que mover Y (o Z) desplace tambien X: se resta
+ * ese desplazamiento del destino. Con Y y Z por debajo de 2^31 / 6554 pasos
+ * el producto en Q16 cabe en 32 bits.
+ */
+void ControladorCNC::corregirEscuadra(const int32_t *destino_pasos, int32_t *correccion) const {
+    correccion[EJE_X] = -((destino_pasos[EJE_Y] * escuadra_q16[ESCUADRA_PLANO_XY] +
+                           destino_pasos[EJE_Z] * escuadra_q16[ESCUADRA_PLANO_XZ] + 0x8000) >> BITS_Q16);
+    correccion[EJE_Y] = -((destino_pasos[EJE_Z] * escuadra_q16[ESCUADRA_PLANO_YZ] + 0x8000) >> BITS_Q16);
+    correccion[EJE_Z] = 0;
+}
+
+/**
+ * @brief La correccion de X depende de Y y Z programados, que se recuperan
+ * antes: Z no lleva escuadra e Y solo depende de Z. La malla se evalua en X e
+ * Y fisicos; lo que los separa la escuadra cambia su correccion mucho menos
+ * de un paso.
+ */
+void ControladorCNC::recuperarPosicion() {
+    int32_t fisica[NUM_EJES];
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        fisica[i] = generador_pasos.obtenerPosicion(i);
+        posicion_pasos[i] = fisica[i];
+    }
+    if (compensacionActiva()) {
+        posicion_pasos[EJE_Z] -= mapa.correccion(fisica[EJE_X], fisica[EJE_Y]);
+    }
+    if (escuadraActiva()) {
+        int32_t correccion[NUM_EJES];
+        corregirEscuadra(posicion_pasos, correccion);
+        posicion_pasos[EJE_Y] = fisica[EJE_Y] - correccion[EJE_Y];
+        corregirEscuadra(posicion_pasos, correccion);
+        posicion_pasos[EJE_X] = fisica[EJE_X] - correccion[EJE_X];
+    }
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        correccion_pasos[i] = fisica[i] - posicion_pasos[i];
+    }
+}
+
+/**
+ * @brief Con distancia y velocidad nula el planificador fija a 0 la salida del
+ * bloque anterior y la entrada del siguiente, asi que no hace falta tratarla
+ * aparte en la anticipacion.
+ */
+bool ControladorCNC::planificarPausa() {
+    if (!planificadorConEspacio()) {
+        return false;
+    }
+    uint32_t milisegundos = (comando_actual.pausa_s > 0.0f) ? lround(comando_actual.pausa_s * 1000.0f) : 0;
+    
+    BloquePlanificador pausa = {};
+    asignarCortadora(pausa, false);
+    if (milisegundos == 0) {
+        if (pausa.ciclo_cortadora == ciclo_cortadora_planificado &&
+            pausa.estado_cortadora == estado_cortadora_planificado) {
+            return true;
+        }
+        // El cambio de cortadora necesita un bloque que lo lleve
+        milisegundos = 1;
+    }
+    ciclo_cortadora_planificado = pausa.ciclo_cortadora;
+    estado_cortadora_planificado = pausa.estado_cortadora;
+    pausa.eventos = milisegundos;
+    pausa.comando = 4;
+    const float unitario[NUM_EJES] = {0, 0, 0};
+    planificador.agregarBloque(pausa, unitario);
+    
+#if MODO_DESARROLLADOR
+    Serial.print(F("[ControladorCNC::planificarPausa] Pausa de "));
+    Serial.print(milisegundos);
+    Serial.println(F(" ms"));
+#endif
+    return true;
+}
+
+/**
+ * @brief La compensacion es un bloque normal del planificador, con el avance
+ * del movimiento al que precede, asi que entra en la anticipacion y se enlaza
+ * con el perfil en vez de frenar la maquina. Solo se cuentan los ejes que se
+ * mueven: un eje parado conserva el sentido de su ultimo movimiento.
+ */
+void ControladorCNC::compensarHolgura(const int32_t *pasos) {
+    int32_t compensacion[NUM_EJES] = {0, 0, 0};
+    bool hay_compensacion = false;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        if (pasos[i] == 0) {
+            continue;
+        }
+        uint8_t bit_eje = 1 << i;
+        bool negativo = pasos[i] < 0;
+        if (negativo != ((sentido_holgura & bit_eje) != 0)) {
+            sentido_holgura ^= bit_eje;
+            if (holgura_pasos[i] > 0) {
+                compensacion[i] = negativo ? -holgura_pasos[i] : holgura_pasos[i];
+                hay_compensacion = true;
+            }
+        }
+    }
+    if (hay_compensacion) {
+        agregarBloque(compensacion, true);
+    }
+}
+
+void ControladorCNC::agregarBloque(const int32_t *pasos, bool compensacion) {
+    BloquePlanificador bloque;
+    bloque.compensacion = compensacion;
+    
+    // El eje dominante marca el ritmo; los demas se interpolan con Bresenham
+    bloque.eventos = 0;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        bloque.pasos[i] = pasos[i];
+        bloque.eventos = max(bloque.eventos, static_cast<uint32_t>(labs(pasos[i])));
+    }
+    
+    // La geometria se toma de los pasos que realmente se van a dar
+    float delta_mm[NUM_EJES];
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        delta_mm[i] = bloque.pasos[i] * ConfiguracionMaquina::mmPorPaso(i);
+    }
+    bloque.distancia_mm = sqrt(delta_mm[EJE_X] * delta_mm[EJE_X] +
+                               delta_mm[EJE_Y] * delta_mm[EJE_Y] +
+                               delta_mm[EJE_Z] * delta_mm[EJE_Z]);
+    // Un cociente por eje en movimiento y otro para el vector unitario; los
+    // tres limites del bloque salen despues solo con productos
+    float inverso_distancia = 1.0f / bloque.distancia_mm;
+    float unitario[NUM_EJES];
+    float inverso_unitario[NUM_EJES];
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        unitario[i] = delta_mm[i] * inverso_distancia;
+        inverso_unitario[i] = (bloque.pasos[i] != 0) ? bloque.distancia_mm / fabs(delta_mm[i]) : 0.0f;
+    }
+    // Los G00 van a la velocidad maxima de los ejes que se mueven
+    bloque.velocidad_maxima = calcularLimiteBloque(ConfiguracionMaquina::velocidadesMaximas(), inverso_unitario);
+    float velocidad_mm_s = (comando_actual.comando == 0) ? bloque.velocidad_maxima : comando_actual.velocidad * (1.0f / 60.0f);
+    if (velocidad_mm_s <= 0) {
+        // Sin avance valido: velocidad por defecto lenta equivalente a INTERVALO_PASO_DEFECTO_US
+        velocidad_mm_s = (1000000.0f / INTERVALO_PASO_DEFECTO_US) * bloque.distancia_mm / bloque.eventos;
+    }
+    bloque.velocidad_nominal = min(velocidad_mm_s, bloque.velocidad_maxima);
+    bloque.aceleracion = calcularLimiteBloque(ConfiguracionMaquina::aceleraciones(), inverso_unitario);
+    bloque.sobreaceleracion = calcularLimiteBloque(ConfiguracionMaquina::sobreaceleraciones(), inverso_unitario);
+    bloque.comando = comando_actual.comando;
+    asignarCortadora(bloque, compensacion);
+    bloque.pixeles = 0;
+    if (!compensacion && comando_actual.num_pixeles > 0 &&
+        generador_pasos.encolarPixeles(comando_actual.pixeles, comando_actual.num_pixeles)) {
+        bloque.pixeles = comando_actual.num_pixeles;
+    }
+    ciclo_cortadora_planificado = bloque.ciclo_cortadora;
+    estado_cortadora_planificado = bloque.estado_cortadora;
+    
+    planificador.agregarBloque(bloque, unitario);
+}
+
+/**
+ * @brief La compensacion de holgura no mueve la herramienta, asi que conserva
+ * la cortadora del bloque anterior en vez de adelantar el cambio del siguiente.
+ */
+void ControladorCNC::asignarCortadora(BloquePlanificador &bloque, bool mantener) {
+    if (mantener) {
+        bloque.ciclo_cortadora = ciclo_cortadora_planificado;
+        bloque.estado_cortadora = estado_cortadora_planificado;
+        return;
+    }
+    bloque.estado_cortadora = Cortadora::estadoDeModo(comando_actual.modo_cortadora);
+    bloque.ciclo_cortadora = Cortadora::cicloDeVelocidad(comando_actual.velocidad_cortadora, bloque.estado_cortadora);
+}
+
+/**
+ * @brief Una cuerda de un arco de radio r que abarca el angulo t se separa del
+ * arco una flecha r(1 - cos(t/2)); despejando con la tolerancia como flecha
+ * maxima sale la longitud de cuerda 2*sqrt(tol(2r - tol)).
+ * 
+ * La rotacion aproximada usa los primeros terminos de Taylor:
+ * cos(t) ~ 1 - t^2/2 y sin(t) ~ t(1 - t^2/6), suficientes para los angulos
+ * pequenos de cada segmento.
+ */
+bool ControladorCNC::iniciarArco() {
+    // I/J/K son relativos a la posicion programada del interprete, no a la de
+    // posicion_pasos, que esta redondeada a pasos
+    const float *inicio = comando_actual.inicio;
+    const float desplazamiento[NUM_EJES] = {comando_actual.i, comando_actual.j, comando_actual.k};
+    for (uint8_t n = 0; n < 3; n++) {
+        arco.ejes[n] = ejePlano(comando_actual.plano, n);
+    }
+    const uint8_t eje_0 = arco.ejes[0];
+    const uint8_t eje_1 = arco.ejes[1];
+    const uint8_t eje_lineal = arco.ejes[2];
+    arco.destino[EJE_X] = comando_actual.x;
+    arco.destino[EJE_Y] = comando_actual.y;
+    arco.destino[EJE_Z] = comando_actual.z;
+    arco.centro[0] = inicio[eje_0] + desplazamiento[eje_0];
+    arco.centro[1] = inicio[eje_1] + desplazamiento[eje_1];
+    arco.radio_inicio[0] = -desplazamiento[eje_0];
+    arco.radio_inicio[1] = -desplazamiento[eje_1];
+    
+    float radio = sqrt(arco.radio_inicio[0] * arco.radio_inicio[0] + arco.radio_inicio[1] * arco.radio_inicio[1]);
+    if (radio <= 0.0f) {
 #if MODO_DESARROLLADOR
-            Serial.println("Comando ControladorCNC completado");
+        Serial.println(F("[ControladorCNC::iniciarArco] Arco de radio cero"));
 #endif
-            ejecutando_comando = false;
+        return false;
+    }
+    
+    // Angulo con signo entre el vector al inicio y el vector al destino
+    float final_0 = arco.destino[eje_0] - arco.centro[0];
+    float final_1 = arco.destino[eje_1] - arco.centro[1];
+    float angulo = atan2(arco.radio_inicio[0] * final_1 - arco.radio_inicio[1] * final_0,
+                         arco.radio_inicio[0] * final_0 + arco.radio_inicio[1] * final_1);
+    if (comando_actual.comando == 2) {
+        if (angulo >= -EPSILON_ANGULO_ARCO) {
+            angulo -= 2.0f * M_PI;
         }
+    } else if (angulo <= EPSILON_ANGULO_ARCO) {
+        angulo += 2.0f * M_PI;
+    }
+    
+    if (limitesSoftwareActivos()) {
+        // Caja del arco: sus extremos mas los puntos cardinales que barre. Se
+        // comprueba entero antes del primer segmento para no dejarlo a medias.
+        static const int8_t CARDINAL_0[4] = {1, 0, -1, 0};
+        static const int8_t CARDINAL_1[4] = {0, 1, 0, -1};
+        float minimo[NUM_EJES], maximo[NUM_EJES];
+        for (uint8_t i = 0; i < NUM_EJES; i++) {
+            minimo[i] = min(inicio[i], arco.destino[i]);
+            maximo[i] = max(inicio[i], arco.destino[i]);
+        }
+        float angulo_inicio = atan2(arco.radio_inicio[1], arco.radio_inicio[0]);
+        for (uint8_t k = 0; k < 4; k++) {
+            float barrido = (angulo > 0.0f) ? k * 0.5f * M_PI - angulo_inicio : angulo_inicio - k * 0.5f * M_PI;
+            barrido = fmod(barrido, 2.0f * M_PI);
+            if (barrido < 0.0f) {
+                barrido += 2.0f * M_PI;
+            }
+            if (barrido <= fabs(angulo)) {
+                float p0 = arco.centro[0] + CARDINAL_0[k] * radio;
+                float p1 = arco.centro[1] + CARDINAL_1[k] * radio;
+                minimo[eje_0] = min(minimo[eje_0], p0);
+                maximo[eje_0] = max(maximo[eje_0], p0);
+                minimo[eje_1] = min(minimo[eje_1], p1);
+                maximo[eje_1] = max(maximo[eje_1], p1);
+            }
+        }
+        if (!comprobarLimitesSoftware(minimo, maximo)) {
+            return false;
+        }
+    }
+    
+    // Con un radio menor que la tolerancia cualquier cuerda cumple; acotarla
+    // deja 1 - tol/r en [0, 1] y la raiz nunca es de un negativo ni nula
+    float tolerancia = min((float)TOLERANCIA_ARCO_MM, radio);
+    float segmentos = floor(fabs(0.5f * angulo * radio) /
+                            sqrt(tolerancia * (2.0f * radio - tolerancia)));
+    arco.segmentos = (segmentos < 1.0f) ? 1 : (segmentos > 65535.0f) ? 65535 : static_cast<uint16_t>(segmentos);
+    arco.segmento_actual = 0;
+    arco.desde_correccion = 0;
+    arco.angulo_segmento = angulo / arco.segmentos;
+    arco.coseno_segmento = 2.0f - arco.angulo_segmento * arco.angulo_segmento;
+    arco.seno_segmento = arco.angulo_segmento * 0.16666667f * (arco.coseno_segmento + 4.0f);
+    arco.coseno_segmento *= 0.5f;
+    arco.radio_actual[0] = arco.radio_inicio[0];
+    arco.radio_actual[1] = arco.radio_inicio[1];
+    arco.lineal = inicio[eje_lineal];
+    arco.incremento_lineal = (arco.destino[eje_lineal] - inicio[eje_lineal]) / arco.segmentos;
+    arco.activo = true;
+    
+#if MODO_DESARROLLADOR
+    Serial.print(F("[ControladorCNC::iniciarArco] Plano G")); Serial.print(17 + comando_actual.plano);
+    Serial.print(F(" radio: ")); Serial.print(radio);
+    Serial.print(F(" angulo: ")); Serial.print(angulo);
+    Serial.print(F(" segmentos: ")); Serial.println(arco.segmentos);
+#endif
+    return true;
+}
+
+void ControladorCNC::continuarArco() {
+    while (arco.activo && !tramo.activo && planificadorConEspacio()) {
+        float punto[NUM_EJES];
+        if (arco.segmento_actual + 1 >= arco.segmentos) {
+            // El ultimo segmento va al destino exacto, sin error acumulado
+            punto[EJE_X] = arco.destino[EJE_X];
+            punto[EJE_Y] = arco.destino[EJE_Y];
+            punto[EJE_Z] = arco.destino[EJE_Z];
+            arco.activo = false;
+        } else {
+            arco.segmento_actual++;
+            float r0 = arco.radio_actual[0];
+            float r1 = arco.radio_actual[1];
+            if (arco.desde_correccion < SEGMENTOS_CORRECCION_ARCO) {
+                arco.radio_actual[0] = r0 * arco.coseno_segmento - r1 * arco.seno_segmento;
+                arco.radio_actual[1] = r0 * arco.seno_segmento + r1 * arco.coseno_segmento;
+                arco.desde_correccion++;
+            } else {
+                float angulo = arco.segmento_actual * arco.angulo_segmento;
+                float coseno = cos(angulo);
+                float seno = sin(angulo);
+                arco.radio_actual[0] = arco.radio_inicio[0] * coseno - arco.radio_inicio[1] * seno;
+                arco.radio_actual[1] = arco.radio_inicio[0] * seno + arco.radio_inicio[1] * coseno;
+                arco.desde_correccion = 0;
+            }
+            arco.lineal += arco.incremento_lineal;
+            punto[arco.ejes[0]] = arco.centro[0] + arco.radio_actual[0];
+            punto[arco.ejes[1]] = arco.centro[1] + arco.radio_actual[1];
+            punto[arco.ejes[2]] = arco.lineal;
+        }
+        planificarMovimientoLineal(punto);
     }
 }
 
+/**
+ * @brief Un bloque entregado al generador ya no se puede replanificar, asi que
+ * se retiene el ultimo bloque del planificador mientras la ISR tenga trabajo:
+ * cuando llegue el siguiente se conocera la velocidad con la que puede unirse.
+ */
+void ControladorCNC::transferirBloques(bool completo) {
+    if (generador_pasos.estaDetenido()) {
+        return; // Un final o la sonda pararon la maquina: se vacia al atender el disparo
+    }
+    BloquePlanificador *planificado;
+    while (generador_pasos.hayEspacioEnCola() && (planificado = planificador.obtenerBloqueActual()) != nullptr) {
+        if (!completo && planificador.cantidadBloques() < 2 && generador_pasos.bloquesPendientes() > 1) {
+            break;
+        }
+        
+        BloquePasos bloque;
+        bloque.direccion = 0;
+        bloque.compensacion = planificado->compensacion;
+        bloque.ciclo_cortadora = planificado->ciclo_cortadora;
+        bloque.estado_cortadora = planificado->estado_cortadora;
+        bloque.pixeles = planificado->pixeles;
+        for (uint8_t i = 0; i < NUM_EJES; i++) {
+            // Bit a 1 = sentido negativo
+            if (planificado->pasos[i] < 0) {
+                bloque.direccion |= (1 << i);
+            }
+            bloque.pasos[i] = labs(planificado->pasos[i]);
+        }
+        planificador.calcularTrapecio(*planificado,
+                                       sqrt(planificado->velocidad_entrada_cuadrado),
+                                       planificador.obtenerVelocidadSalidaActual(),
+                                       bloque);
+        
+        generador_pasos.encolarBloque(bloque);
+        planificador.descartarBloqueActual();
+    }
+}
+
+/**
+ * @brief Los pasos los genera la ISR del Timer1; aqui solo se mantienen llenos
+ * la cola de bloques y el buffer de segmentos
+ */
+void ControladorCNC::actualizar() {
+    if (finales_carrera.consumirDisparoLimite()) {
+        // El Timer1 ya se paro en la interrupcion; aqui se vacian las colas y se descarta lo planificado
+        detenerEmergencia();
+        alarma = ALARMA_LIMITE_FISICO;
+        maquina_calibrada = false;
+#if MODO_DESARROLLADOR
+        Serial.println(F("[ControladorCNC::actualizar] ALARMA: final de carrera activado"));
+#endif
+    }
+    actualizarCalibracion();
+    actualizarSondeo();
+    actualizarAjuste();
+    actualizarMovimientoManual();
+    continuarTramoMalla();
+    continuarArco();
+    transferirBloques(false);
+    generador_pasos.prepararSegmentos();
+}
+
+void ControladorCNC::establecerAjusteAvance(int16_t porcentaje) {
+    porcentaje = CONSTRAIN(porcentaje, (int16_t)AJUSTE_AVANCE_MINIMO, (int16_t)AJUSTE_AVANCE_MAXIMO);
+    planificador.establecerAjustes(porcentaje, planificador.obtenerAjusteRapido());
+}
+
+void ControladorCNC::establecerAjusteRapido(uint8_t porcentaje) {
+    planificador.establecerAjustes(planificador.obtenerAjusteAvance(), porcentaje);
+}
+
+uint8_t ControladorCNC::obtenerAjusteAvance() const {
+    return planificador.obtenerAjusteAvance();
+}
+
+uint8_t ControladorCNC::obtenerAjusteRapido() const {
+    return planificador.obtenerAjusteRapido();
+}
+
+bool ControladorCNC::hayEspacioEnCola() const {
+    return !arco.activo && !tramo.activo && !calibrando() && !sondeando() && ajuste_pendiente == AJUSTE_NINGUNO &&
+           fase_manual == MANUAL_INACTIVO && alarma == ALARMA_NINGUNA && planificadorConEspacio() &&
+           generador_pasos.espacioPixeles() >= MAXIMO_PIXELES_RASTER;
+}
+
+bool ControladorCNC::movimientoPendiente() const {
+    return arco.activo || tramo.activo || !planificador.estaVacio() || generador_pasos.enMovimiento();
+}
+
 bool ControladorCNC::comandoEnEjecucion() const {
-    return ejecutando_comando;
+    return movimientoPendiente() || sondeando() || ajuste_pendiente != AJUSTE_NINGUNO ||
+           fase_manual != MANUAL_INACTIVO;
+}
+
+/**
+ * @brief Los pasos de Z de la malla dejan de valer si cambian los pasos/mm de
+ * Z; con otros de X o Y basta con volver a pasar la rejilla a pasos.
+ */
+void ControladorCNC::actualizarAjuste() {
+    if (ajuste_pendiente == AJUSTE_NINGUNO || movimientoPendiente()) {
+        return;
+    }
+    float posicion_mm[NUM_EJES];
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        posicion_mm[i] = generador_pasos.obtenerPosicion(i) * ConfiguracionMaquina::mmPorPaso(i);
+    }
+    float pasos_por_mm_z = ConfiguracionMaquina::pasosPorMm(EJE_Z);
+    
+    if (ConfiguracionMaquina::establecer(ajuste_pendiente, valores_ajuste) &&
+        ajuste_pendiente == AJUSTE_PASOS_POR_MM) {
+        for (uint8_t i = 0; i < NUM_EJES; i++) {
+            generador_pasos.establecerPosicion(i, convertirMmAPasos(posicion_mm[i], i));
+        }
+        recuperarPosicion();
+        aplicarConfiguracion();
+        if (ConfiguracionMaquina::pasosPorMm(EJE_Z) != pasos_por_mm_z) {
+            mapa.borrar();
+        } else {
+            mapa.cargar();
+        }
+    }
+    ajuste_pendiente = AJUSTE_NINGUNO;
 }
 
 void ControladorCNC::detenerEmergencia() {
-    // Detener todos los motores
-    for (int i = 0; i < 3; i++) {
-        controlador_motores.stop(i);
+    // Detener todos los motores y descartar lo planificado
+    generador_pasos.detener();
+    planificador.reiniciar();
+    arco.activo = false;
+    tramo.activo = false;
+    ajuste_pendiente = AJUSTE_NINGUNO;
+    if (fase_manual != MANUAL_INACTIVO) {
+        fase_manual = MANUAL_INACTIVO;
+        generador_pasos.limitarSegmentos(TAMANO_BUFFER_SEGMENTOS - 1);
+    }
+    if (sondeando()) {
+        sonda.desarmar();
+        fase_sondeo = SONDEO_INACTIVO;
+        if (midiendo_malla) {
+            mapa.cargar(); // La malla a medias no vale
+            midiendo_malla = false;
+        }
     }
-    ejecutando_comando = false;
+    // El generador apago la cortadora al detenerse
+    ciclo_cortadora_planificado = 0;
+    estado_cortadora_planificado = 0;
+    if (calibrando()) {
+        terminarCalibracion(CALIBRACION_INACTIVA);
+    }
+    
+    // Lo planificado se descarto: la posicion vuelve a ser la que alcanzaron los motores
+    recuperarPosicion();
     
 #if MODO_DESARROLLADOR
     Serial.println("EMERGENCIA: Todos los motores detenidos");
 #endif
 }
 
+void ControladorCNC::retenerAvance() {
+    generador_pasos.retener();
+#if MODO_DESARROLLADOR
+    Serial.println(F("[ControladorCNC::retenerAvance] Retencion de avance"));
+#endif
+}
+
+void ControladorCNC::reanudarAvance() {
+    if (!generador_pasos.retencionCompleta()) {
+        return; // Todavia frenando: se reanuda cuando este detenida
+    }
+    generador_pasos.reanudar();
+#if MODO_DESARROLLADOR
+    Serial.println(F("[ControladorCNC::reanudarAvance] Reanudando"));
+#endif
+}
+
+bool ControladorCNC::enRetencion() const {
+    return generador_pasos.enRetencion();
+}
+
+bool ControladorCNC::iniciarCalibracion() {
+    if (comandoEnEjecucion()) {
+        return false;
+    }
+    orden_calibracion = 0;
+    maquina_calibrada = false;
+    // La calibracion busca los finales a proposito
+    finales_carrera.habilitarLimites(false);
+    iniciarFaseCalibracion(CALIBRACION_BUSQUEDA);
+    return true;
+}
+
+/**
+ * @brief Una calibracion completa es la unica forma de salir de una alarma
+ * con los finales aun pisados, y deja la posicion de maquina de nuevo fiable.
+ */
+void ControladorCNC::terminarCalibracion(FaseCalibracion resultado) {
+    fase_calibracion = resultado;
+    finales_carrera.armar(0);
+    generador_pasos.desbloquearEjes();
+    finales_carrera.habilitarLimites(true);
+    if (resultado == CALIBRACION_COMPLETA) {
+        alarma = ALARMA_NINGUNA;
+        maquina_calibrada = true;
+    }
+}
+
+bool ControladorCNC::calibrando() const {
+    return fase_calibracion >= CALIBRACION_BUSQUEDA && fase_calibracion <= CALIBRACION_SEPARACION;
+}
+
+FaseCalibracion ControladorCNC::obtenerFaseCalibracion() const {
+    return fase_calibracion;
+}
+
+bool ControladorCNC::enAlarma() const {
+    return alarma != ALARMA_NINGUNA;
+}
+
+TipoAlarma ControladorCNC::obtenerAlarma() const {
+    return alarma;
+}
+
+bool ControladorCNC::restablecerAlarma() {
+    if (finales_carrera.leer() != 0) {
+        return false; // Un final sigue pisado: solo la calibracion puede liberarlo
+    }
+    if (generador_pasos.enRetencion() && !generador_pasos.retencionCompleta()) {
+        return false; // Se descarta lo retenido solo con los motores parados
+    }
+    if (alarma == ALARMA_LIMITE_SOFTWARE) {
+        detenerEmergencia();
+    }
+    alarma = ALARMA_NINGUNA;
+    return true;
+}
+
+bool ControladorCNC::limitesSoftwareActivos() const {
+    return LIMITES_SOFTWARE_HABILITADOS && maquina_calibrada && !calibrando();
+}
+
+/**
+ * @brief Se comprueba al planificar y no en la ISR: un programa que se sale
+ * se detiene con una retencion normal, sin perder pasos, antes de que el
+ * movimiento culpable entre en la cola. Lo ya encolado queda retenido.
+ */
+bool ControladorCNC::comprobarLimitesSoftware(const float *minimo_mm, const float *maximo_mm) {
+    if (!limitesSoftwareActivos()) {
+        return true;
+    }
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        if (convertirMmAPasos(minimo_mm[i], i) < limite_minimo_pasos[i] ||
+            convertirMmAPasos(maximo_mm[i], i) > limite_maximo_pasos[i]) {
+            alarma = ALARMA_LIMITE_SOFTWARE;
+            generador_pasos.retener();
+#if MODO_DESARROLLADOR
+            Serial.print(F("[ControladorCNC::comprobarLimitesSoftware] Fuera del area de trabajo en eje "));
+            Serial.println(i);
+#endif
+            return false;
+        }
+    }
+    return true;
+}
+
+void ControladorCNC::moverEjeCalibracion(uint8_t eje, float distancia_mm, float velocidad_mm_min) {
+    float destino[NUM_EJES];
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        destino[i] = posicion_pasos[i] * ConfiguracionMaquina::mmPorPaso(i);
+    }
+    destino[eje] += distancia_mm;
+    comando_actual = ComandoGcode();
+    comando_actual.comando = 1;
+    comando_actual.velocidad = velocidad_mm_min;
+    planificarMovimientoLineal(destino);
+}
+
+/**
+ * @brief Los finales estan en el extremo negativo de cada eje. Si al empezar
+ * la busqueda el final ya esta activado no habra flanco, asi que se da por
+ * disparado y se pasa directamente al retroceso.
+ */
+void ControladorCNC::iniciarFaseCalibracion(FaseCalibracion fase) {
+    uint8_t eje = ORDEN_CALIBRACION[orden_calibracion];
+    uint8_t bit_eje = 1 << eje;
+    fase_calibracion = fase;
+    
+#if MODO_DESARROLLADOR
+    Serial.print(F("[ControladorCNC::iniciarFaseCalibracion] Eje: ")); Serial.print(eje);
+    Serial.print(F(" fase: ")); Serial.println(fase);
+#endif
+    
+    switch (fase) {
+        case CALIBRACION_BUSQUEDA:
+        case CALIBRACION_LOCALIZACION:
+            if (finales_carrera.leer() & bit_eje) {
+                if (fase == CALIBRACION_BUSQUEDA) {
+                    iniciarFaseCalibracion(CALIBRACION_RETROCESO);
+                } else {
+                    terminarCalibracion(CALIBRACION_FALLIDA); // No se libero en el retroceso
+                }
+                return;
+            }
+            finales_carrera.limpiar();
+            finales_carrera.armar(bit_eje);
+            if (fase == CALIBRACION_BUSQUEDA) {
+                moverEjeCalibracion(eje, -1.5f * RECORRIDO_MAXIMO_MM[eje], VELOCIDAD_BUSQUEDA_CALIBRACION_MM_MIN);
+            } else {
+                moverEjeCalibracion(eje, -2.0f * RETROCESO_CALIBRACION_MM, VELOCIDAD_LOCALIZACION_CALIBRACION_MM_MIN);
+            }
+            break;
+            
+        case CALIBRACION_RETROCESO:
+        case CALIBRACION_SEPARACION:
+            moverEjeCalibracion(eje, RETROCESO_CALIBRACION_MM, VELOCIDAD_BUSQUEDA_CALIBRACION_MM_MIN);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+void ControladorCNC::detenerTrasDisparo() {
+    generador_pasos.detener();
+    planificador.reiniciar();
+    finales_carrera.armar(0);
+    generador_pasos.desbloquearEjes();
+    recuperarPosicion();
+}
+
+/**
+ * @brief El eje se bloquea en el flanco dentro de la ISR de los finales; aqui
+ * solo se detiene el resto del movimiento y se decide la fase siguiente.
+ */
+void ControladorCNC::actualizarCalibracion() {
+    if (!calibrando()) {
+        return;
+    }
+    uint8_t eje = ORDEN_CALIBRACION[orden_calibracion];
+    uint8_t bit_eje = 1 << eje;
+    
+    switch (fase_calibracion) {
+        case CALIBRACION_BUSQUEDA:
+        case CALIBRACION_LOCALIZACION:
+            if (finales_carrera.obtenerDisparados() & bit_eje) {
+                detenerTrasDisparo();
+                if (fase_calibracion == CALIBRACION_BUSQUEDA) {
+                    iniciarFaseCalibracion(CALIBRACION_RETROCESO);
+                } else {
+                    // El punto de disparo es el cero de maquina del eje
+                    generador_pasos.establecerPosicion(eje, 0);
+                    posicion_pasos[eje] = 0;
+                    iniciarFaseCalibracion(CALIBRACION_SEPARACION);
+                }
+            } else if (!comandoEnEjecucion()) {
+                // Recorrido completo sin tocar el final
+                terminarCalibracion(CALIBRACION_FALLIDA);
+            }
+            break;
+            
+        case CALIBRACION_RETROCESO:
+            if (!comandoEnEjecucion()) {
+                iniciarFaseCalibracion(CALIBRACION_LOCALIZACION);
+            }
+            break;
+            
+        case CALIBRACION_SEPARACION:
+            if (!comandoEnEjecucion()) {
+                if (++orden_calibracion < NUM_EJES) {
+                    iniciarFaseCalibracion(CALIBRACION_BUSQUEDA);
+                } else {
+                    terminarCalibracion(CALIBRACION_COMPLETA);
+                }
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+#if MODO_DESARROLLADOR
+    if (fase_calibracion == CALIBRACION_FALLIDA) {
+        Serial.print(F("[ControladorCNC::actualizarCalibracion] Calibracion fallida en eje "));
+        Serial.println(eje);
+    }
+#endif
+}
+
+bool ControladorCNC::sondeando() const {
+    return fase_sondeo != SONDEO_INACTIVO;
+}
+
+bool ControladorCNC::mallaValida() const {
+    return mapa.esValido();
+}
+
+void ControladorCNC::prepararPuntoMalla() {
+    float xy[2];
+    mapa.coordenadasPunto(punto_malla, xy);
+    destino_sondeo[EJE_X] = xy[0];
+    destino_sondeo[EJE_Y] = xy[1];
+    destino_sondeo[EJE_Z] = z_seguro_mm - PROFUNDIDAD_SONDEO_MALLA_MM;
+    fase_sondeo = SONDEO_ESPERA;
+}
+
+/**
+ * @brief Se conserva la cortadora del comando actual: el sondeo no debe
+ * encenderla ni apagarla por su cuenta.
+ */
+void ControladorCNC::moverSondeo(const float *destino_mm, bool rapido, float velocidad_mm_min) {
+    comando_actual.comando = rapido ? 0 : 1;
+    comando_actual.velocidad = velocidad_mm_min;
+    comando_actual.num_pixeles = 0;
+    planificarRecta(destino_mm);
+}
+
+/**
+ * @brief La sonda solo se arma con la maquina parada, para que ningun
+ * movimiento anterior la dispare. En la malla el desplazamiento al nodo va a
+ * la altura segura y la busqueda baja en vertical desde ella.
+ */
+void ControladorCNC::actualizarSondeo() {
+    switch (fase_sondeo) {
+        case SONDEO_ESPERA:
+            if (movimientoPendiente()) {
+                break;
+            }
+            if (midiendo_malla && (posicion_pasos[EJE_X] != convertirMmAPasos(destino_sondeo[EJE_X], EJE_X) ||
+                                   posicion_pasos[EJE_Y] != convertirMmAPasos(destino_sondeo[EJE_Y], EJE_Y))) {
+                float nodo[NUM_EJES] = {destino_sondeo[EJE_X], destino_sondeo[EJE_Y], z_seguro_mm};
+                moverSondeo(nodo, true, 0.0f);
+                break;
+            }
+            if (sonda.leer()) {
+                fallarSondeo(); // Ya tocaba: no habria flanco
+                break;
+            }
+            sonda.armar();
+            fase_sondeo = SONDEO_BUSQUEDA;
+            moverSondeo(destino_sondeo, false, velocidad_sondeo);
+            break;
+            
+        case SONDEO_BUSQUEDA:
+            if (sonda.consumirContacto()) {
+                // La interrupcion solo paro el Timer1; aqui se vacian las colas
+                generador_pasos.detener();
+                planificador.reiniciar();
+                recuperarPosicion();
+#if MODO_DESARROLLADOR
+                Serial.print(F("[ControladorCNC::actualizarSondeo] Contacto en Z: "));
+                Serial.println(posicion_pasos[EJE_Z] * ConfiguracionMaquina::mmPorPaso(EJE_Z));
+#endif
+                if (!midiendo_malla) {
+                    fase_sondeo = SONDEO_INACTIVO;
+                    break;
+                }
+                mapa.registrarAltura(punto_malla++, posicion_pasos[EJE_Z]);
+                float retirada[NUM_EJES] = {posicion_pasos[EJE_X] * ConfiguracionMaquina::mmPorPaso(EJE_X),
+                                            posicion_pasos[EJE_Y] * ConfiguracionMaquina::mmPorPaso(EJE_Y), z_seguro_mm};
+                fase_sondeo = SONDEO_RETIRADA;
+                moverSondeo(retirada, true, 0.0f);
+            } else if (!movimientoPendiente()) {
+                fallarSondeo(); // Recorrido completo sin contacto
+            }
+            break;
+            
+        case SONDEO_RETIRADA:
+            if (movimientoPendiente()) {
+                break;
+            }
+            if (punto_malla < mapa.totalPuntos()) {
+                prepararPuntoMalla();
+            } else {
+                mapa.completar();
+                midiendo_malla = false;
+                fase_sondeo = SONDEO_INACTIVO;
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+
+void ControladorCNC::fallarSondeo() {
+    sonda.desarmar();
+    fase_sondeo = SONDEO_INACTIVO;
+    if (midiendo_malla) {
+        mapa.cargar();
+        midiendo_malla = false;
+    }
+    alarma = ALARMA_SONDEO;
+#if MODO_DESARROLLADOR
+    Serial.println(F("[ControladorCNC::fallarSondeo] ALARMA: la sonda no hizo contacto"));
+#endif
+}
+
+/**
+ * @brief Con BLOQUES_MOVIMIENTO_MANUAL bloques de longitud L en vuelo el
+ * planificador solo alcanza el avance v si (BLOQUES - 1) * L cubre el frenado
+ * v^2 / 2a; L no baja de lo que se recorre en SEGMENTOS_MOVIMIENTO_MANUAL
+ * segmentos para no planificar un bloque por vuelta del loop.
+ * 
+ * Como moverSondeo(), conserva la cortadora del comando actual.
+ */
+bool ControladorCNC::iniciarMovimientoManual(uint8_t eje, bool positivo) {
+    if (fase_manual == MANUAL_AVANCE) {
+        return eje == eje_manual && positivo == manual_positivo;
+    }
+    if (eje >= NUM_EJES || comandoEnEjecucion() || calibrando() || alarma != ALARMA_NINGUNA) {
+        return false;
+    }
+    float velocidad_mm_s = min(VELOCIDAD_MOVIMIENTO_MANUAL_MM_MIN / 60.0f, ConfiguracionMaquina::velocidadesMaximas()[eje]);
+    float frenado_mm = velocidad_mm_s * velocidad_mm_s / (2.0f * ConfiguracionMaquina::aceleraciones()[eje]);
+    incremento_manual_mm = max(frenado_mm / (BLOQUES_MOVIMIENTO_MANUAL - 1),
+                               velocidad_mm_s * SEGMENTOS_MOVIMIENTO_MANUAL / TICKS_ACELERACION_POR_SEGUNDO);
+    
+    comando_actual.comando = 1;
+    comando_actual.velocidad = velocidad_mm_s * 60.0f;
+    comando_actual.num_pixeles = 0;
+    eje_manual = eje;
+    manual_positivo = positivo;
+    fase_manual = MANUAL_AVANCE;
+    generador_pasos.limitarSegmentos(SEGMENTOS_MOVIMIENTO_MANUAL);
+    actualizarMovimientoManual();
+    
+#if MODO_DESARROLLADOR
+    Serial.print(F("[ControladorCNC::iniciarMovimientoManual] Eje: ")); Serial.print(eje);
+    Serial.print(F(" positivo: ")); Serial.print(positivo);
+    Serial.print(F(" bloque (mm): ")); Serial.println(incremento_manual_mm, 3);
+#endif
+    return true;
+}
+
+/**
+ * @brief La retencion solo frena sobre lo que ya tiene el generador, asi que
+ * antes se le entrega todo lo planificado; con la cola corta siempre cabe.
+ */
+void ControladorCNC::cancelarMovimientoManual() {
+    if (fase_manual != MANUAL_AVANCE) {
+        return;
+    }
+    fase_manual = MANUAL_FRENADO;
+    transferirBloques(true);
+    generador_pasos.retener();
+}
+
+bool ControladorCNC::movimientoManualActivo() const {
+    return fase_manual != MANUAL_INACTIVO;
+}
+
+/**
+ * @brief Los bloques terminan en las lineas de la malla, como los tramos de
+ * planificarMovimientoLineal(), pero de uno en uno para no pasarse de la cola
+ * corta. En el borde del area de trabajo no se planifica mas y la maquina
+ * frena al final de lo que ya estaba en vuelo.
+ * 
+ * Tras el frenado se descarta lo que quedo en cola. El generador apaga la
+ * cortadora al detenerse; se vuelve a aplicar lo que tenia la maquina parada.
+ */
+void ControladorCNC::actualizarMovimientoManual() {
+    switch (fase_manual) {
+        case MANUAL_AVANCE:
+            while (planificador.cantidadBloques() + generador_pasos.bloquesPendientes() < BLOQUES_MOVIMIENTO_MANUAL) {
+                float destino[NUM_EJES];
+                for (uint8_t i = 0; i < NUM_EJES; i++) {
+                    destino[i] = posicion_pasos[i] * ConfiguracionMaquina::mmPorPaso(i);
+                }
+                float objetivo = destino[eje_manual] + (manual_positivo ? incremento_manual_mm : -incremento_manual_mm);
+                float linea;
+                if (eje_manual != EJE_Z && compensacionActiva() &&
+                    mapa.siguienteLinea(eje_manual, destino[eje_manual], manual_positivo, linea) &&
+                    (manual_positivo ? linea < objetivo : linea > objetivo)) {
+                    objetivo = linea;
+                }
+                if (limitesSoftwareActivos()) {
+                    objetivo = manual_positivo ?
+                        min(objetivo, limite_maximo_pasos[eje_manual] * ConfiguracionMaquina::mmPorPaso(eje_manual)) :
+                        max(objetivo, limite_minimo_pasos[eje_manual] * ConfiguracionMaquina::mmPorPaso(eje_manual));
+                }
+                int32_t avance = convertirMmAPasos(objetivo, eje_manual) - posicion_pasos[eje_manual];
+                if (manual_positivo ? avance <= 0 : avance >= 0) {
+                    break; // En el limite
+                }
+                destino[eje_manual] = objetivo;
+                planificarRecta(destino);
+            }
+            break;
+            
+        case MANUAL_FRENADO:
+            if (generador_pasos.retencionCompleta()) {
+                uint16_t ciclo = Cortadora::obtenerCiclo();
+                uint8_t estado = Cortadora::obtenerEstado();
+                generador_pasos.detener();
+                Cortadora::aplicar(ciclo, estado);
+                planificador.reiniciar();
+                recuperarPosicion();
+                generador_pasos.limitarSegmentos(TAMANO_BUFFER_SEGMENTOS - 1);
+                fase_manual = MANUAL_INACTIVO;
+#if MODO_DESARROLLADOR
+                Serial.println(F("[ControladorCNC::actualizarMovimientoManual] Movimiento manual terminado"));
+#endif
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+
 const ComandoGcode& ControladorCNC::obtenerComandoActual() const {
     return comando_actual;
-}
\ No newline at end of file
+}
+
+int32_t ControladorCNC::obtenerPosicionPasos(uint8_t eje) const {
+    if (eje >= NUM_EJES) {
+        return 0;
+    }
+    return posicion_pasos[eje];
+}
+
+float ControladorCNC::obtenerPosicionActualMm(uint8_t eje) const {
+    if (eje >= NUM_EJES) {
+        return 0.0f;
+    }
+    return (generador_pasos.obtenerPosicion(eje) - correccion_pasos[eje]) * ConfiguracionMaquina::mmPorPaso(eje);
+}
@@ -1,68 +1,421 @@
 #ifndef CONTROLADOR_CNC_H
 #define CONTROLADOR_CNC_H
 
-#include "MultiStepperLite.h"
+#include "generador_pasos.h"
+#include "planificador.h"
+#include "finales_carrera.h"
+#include "cortadora.h"
+#include "sonda.h"
+#include "mapa_alturas.h"
+#include "configuracion_maquina.h"
 #include "comando_gcode.h"
+#include "constantes.h"
+#include "punto_fijo.h"
 
-enum Motor: uint8_t{
-    EJE_X,
-    EJE_Y,
-    EJE_Z
+/**
+ * @enum FaseCalibracion
+ * @brief Fases de la calibracion (homing) de un eje
+ */
+enum FaseCalibracion : uint8_t {
+    CALIBRACION_INACTIVA,      ///< Sin calibracion en curso
+    CALIBRACION_BUSQUEDA,      ///< Avance rapido hasta el final de carrera
+    CALIBRACION_RETROCESO,     ///< Separacion del final tras la busqueda
+    CALIBRACION_LOCALIZACION,  ///< Avance lento que fija el punto de disparo
+    CALIBRACION_SEPARACION,    ///< Separacion final desde el cero de maquina
+    CALIBRACION_COMPLETA,      ///< Todos los ejes calibrados
+    CALIBRACION_FALLIDA        ///< No se encontro o no se libero un final
+};
+
+/**
+ * @enum TipoAlarma
+ * @brief Motivo por el que la maquina esta en alarma
+ */
+enum TipoAlarma : uint8_t {
+    ALARMA_NINGUNA,          ///< Sin alarma
+    ALARMA_LIMITE_FISICO,    ///< Un final de carrera paro los motores en seco
+    ALARMA_LIMITE_SOFTWARE,  ///< Un movimiento salia del area de trabajo y se rechazo
+    ALARMA_SONDEO            ///< La sonda no toco nada en todo el recorrido (o ya tocaba al empezar)
+};
+
+/**
+ * @enum FaseSondeo
+ * @brief Fases de un sondeo G38.2 o de la medida de la malla G29
+ */
+enum FaseSondeo : uint8_t {
+    SONDEO_INACTIVO,   ///< Sin sondeo en curso
+    SONDEO_ESPERA,     ///< Esperando a que la maquina pare para armar la sonda
+    SONDEO_BUSQUEDA,   ///< Avanzando hacia destino_sondeo con la sonda armada
+    SONDEO_RETIRADA    ///< Malla: subiendo a la altura segura tras un contacto
+};
+
+/**
+ * @enum FaseMovimientoManual
+ * @brief Fases del movimiento manual (jog) con el teclado
+ */
+enum FaseMovimientoManual : uint8_t {
+    MANUAL_INACTIVO,   ///< Sin movimiento manual
+    MANUAL_AVANCE,     ///< Tecla pulsada: se mantiene la cola corta llena
+    MANUAL_FRENADO     ///< Tecla soltada: retencion hasta parar, luego se descarta la cola
 };
 
 /**
  * @class ControladorCNC
- * @brief Controlador ControladorCNC que ejecuta comandos G-code usando MultiStepperLite
+ * @brief Controlador ControladorCNC que ejecuta comandos G-code usando GeneradorPasos
+ * 
+ * Esta clase recibe comandos G-code estructurados, los guarda en el buffer
+ * del planificador y los entrega al generador de pasos coordinado a medida
+ * que este tiene espacio, sin esperar a que termine el movimiento anterior.
+ * 
+ * Los arcos G02/G03 se trocean en rectas a medida que el planificador tiene
+ * sitio; mientras quedan segmentos del arco no se acepta la siguiente linea.
+ * 
+ * La calibracion de ejes tambien avanza desde actualizar(), sin bloquear el
+ * loop: Z, X e Y buscan su final de carrera uno tras otro. El sondeo G38.2 y
+ * la medida de la malla G29 funcionan igual.
  * 
- * Esta clase recibe comandos G-code estructurados y los ejecuta controlando
- * los motores paso a paso mediante la libreria MultiStepperLite.
+ * Con una malla de alturas valida cada recta se corta en las lineas de la
+ * rejilla y a Z se le suma la correccion bilineal de cada extremo; dentro de
+ * una celda la correccion es lineal a lo largo del tramo y la interpolan los
+ * propios pasos de Z, sin coste en la ISR.
+ * 
+ * El movimiento manual con el teclado planifica bloques cortos mientras la
+ * tecla sigue pulsada, con solo BLOQUES_MOVIMIENTO_MANUAL en vuelo: al
+ * soltarla una retencion frena sobre ellos y el resto no llega a planificarse.
  */
 class ControladorCNC {
 private:
     
+    /**
+     * @struct ArcoEnCurso
+     * @brief Estado de un arco G02/G03 que se esta troceando en rectas
+     * 
+     * El punto actual se gira segmento a segmento con una matriz de rotacion
+     * aproximada (sin llamar a sin/cos); cada SEGMENTOS_CORRECCION_ARCO
+     * segmentos se recalcula de forma exacta desde el vector inicial.
+     */
+    struct ArcoEnCurso {
+        bool activo;                ///< true mientras quedan segmentos por planificar
+        uint8_t ejes[3];            ///< Ejes del giro y eje lineal del plano (ejePlano)
+        float centro[2];            ///< Centro del arco en los ejes del giro (mm)
+        float radio_inicio[2];      ///< Vector centro->inicio, base de las correcciones exactas
+        float radio_actual[2];      ///< Vector centro->ultimo punto planificado
+        float angulo_segmento;      ///< Angulo recorrido por segmento (rad, positivo = antihorario)
+        float coseno_segmento;      ///< Aproximacion de cos(angulo_segmento)
+        float seno_segmento;        ///< Aproximacion de sin(angulo_segmento)
+        float lineal;               ///< Eje lineal del ultimo punto planificado (arco helicoidal)
+        float incremento_lineal;    ///< Avance del eje lineal por segmento
+        float destino[3];           ///< Punto final exacto del arco
+        uint16_t segmentos;         ///< Numero total de segmentos
+        uint16_t segmento_actual;   ///< Segmentos ya planificados
+        uint8_t desde_correccion;   ///< Segmentos girados desde la ultima correccion exacta
+    } arco;
+    
+    /**
+     * @struct TramoMalla
+     * @brief Recta que se esta cortando en las lineas de la malla de alturas
+     */
+    struct TramoMalla {
+        bool activo;                ///< true mientras quedan trozos por planificar
+        float inicio[3];            ///< Punto de partida (mm, sin correccion)
+        float destino[3];           ///< Punto final (mm, sin correccion)
+        float t;                    ///< Fraccion de la recta ya planificada
+    } tramo;
+    
     ComandoGcode comando_actual; 
-    bool ejecutando_comando;
+    Planificador planificador;
     
     
-    // Configuracion de pasos por milimetro (ajustar segun tu mecanica)
-    const float pasos_por_mm_x = 80.0f;
-    const float pasos_por_mm_y = 80.0f;
-    const float pasos_por_mm_z = 80.0f;
+    /**
+     * @brief Posicion de maquina al final del ultimo bloque planificado, en pasos
+     */
+    int32_t posicion_pasos[NUM_EJES];
     
     /**
-     * @brief Convierte distancia en mm a pasos de motor
-     * @param distancia_mm Distancia en milimetros
-     * @param pasos_por_mm Pasos por milimetro del eje
-     * @return Numero de pasos a ejecutar
+     * @brief Convierte una coordenada de maquina en mm a la posicion de paso mas cercana
+     * @param posicion_mm Coordenada absoluta en milimetros
+     * @param eje Eje al que pertenece la coordenada
+     * @return Posicion absoluta en pasos
+     *
+     * Es el unico punto de la cadena de movimiento que recibe flotantes. Como
+     * se redondea el destino absoluto y no cada desplazamiento, el error de
+     * redondeo nunca supera medio paso ni se acumula entre movimientos.
      */
-    long convertirMmAPasos(float distancia_mm, float pasos_por_mm);
+    int32_t convertirMmAPasos(float posicion_mm, uint8_t eje) const;
     
     /**
-     * @brief Calcula el delay entre pasos en microsegundos basado en la velocidad
-     * @param velocidad_mm_min Velocidad en mm/minuto
-     * @param pasos_por_mm Pasos por milimetro del eje
-     * @return Delay en microsegundos entre pasos
+     * @brief Limite sobre la trayectoria que no excede el limite de ningun eje
+     * @param limite_eje Limite de cada eje (velocidad, aceleracion o sobreaceleracion)
+     * @param inverso_unitario Distancia / |delta| de cada eje (0 si el eje no se mueve)
+     * @return Limite en las mismas unidades que limite_eje
      */
-    unsigned long calcularDelayVelocidad(float velocidad_mm_min, float pasos_por_mm);
+    float calcularLimiteBloque(const float *limite_eje, const float *inverso_unitario) const;
     
+    /**
+     * @brief Traduce una recta hasta destino_mm a un bloque y lo agrega al planificador
+     * @param destino_mm Punto final en coordenadas de maquina (mm)
+     * @return false si el buffer del planificador esta lleno
+     * 
+     * El avance y el tipo de movimiento (rapido o no) salen del comando actual.
+     * Si algun eje invierte su sentido, antes se agrega la compensacion de holgura.
+     */
+    bool planificarMovimientoLineal(const float *destino_mm);
+    
+    /**
+     * @brief Planifica una recta sin cortarla, con la escuadra y la malla corregidas en su destino
+     * @param destino_mm Punto final sin corregir
+     * @return false si el buffer del planificador esta lleno
+     */
+    bool planificarRecta(const float *destino_mm);
+    
+    /**
+     * @brief Planifica trozos de la recta en curso mientras el planificador tenga sitio
+     */
+    void continuarTramoMalla();
+    
+    MapaAlturas mapa;             ///< Malla de alturas medida con G29
+    
+    /**
+     * @brief Correccion (escuadra y malla) incluida en el ultimo bloque planificado, en pasos
+     * 
+     * La posicion real de los motores al final de lo planificado es
+     * posicion_pasos + correccion_pasos.
+     */
+    int32_t correccion_pasos[NUM_EJES];
+    
+    /**
+     * @brief ESCUADRA_XY, ESCUADRA_XZ y ESCUADRA_YZ en Q16 con signo
+     */
+    int32_t escuadra_q16[3];
+    
+    /**
+     * @brief Correccion de escuadra de un destino en pasos
+     * @param destino_pasos Destino sin corregir
+     * @param correccion Salida: pasos a sumar a cada eje (Z siempre 0)
+     */
+    void corregirEscuadra(const int32_t *destino_pasos, int32_t *correccion) const;
+    
+    /**
+     * @brief Recupera la posicion programada tras una parada brusca
+     * 
+     * Parte de la posicion de los motores y deshace la escuadra y, si se esta
+     * aplicando, la correccion de la malla en el punto donde paro.
+     */
+    void recuperarPosicion();
+    
+    /**
+     * @brief Indica si se aplica la malla a los movimientos que se planifiquen
+     * 
+     * Los movimientos de la calibracion y del sondeo van sin corregir.
+     */
+    bool compensacionActiva() const;
+    
+    /**
+     * @brief Indica si se corrige la escuadra (siempre salvo en la calibracion)
+     */
+    bool escuadraActiva() const;
+    
+    /**
+     * @brief Agrega al planificador una pausa G04 de comando_actual.pausa_s
+     * @return false si el buffer del planificador esta lleno
+     * 
+     * La pausa viaja por la cola como un bloque sin pasos: la maquina frena
+     * hasta parar antes de ella y el loop() sigue libre mientras dura.
+     * Una linea con solo M3/M4/M5 o S llega como pausa nula; si cambia la
+     * cortadora se encola una pausa de 1 ms que la aplica en su sitio.
+     */
+    bool planificarPausa();
+    
+    /**
+     * @brief Completa un bloque a partir de sus pasos y lo agrega al planificador
+     * @param pasos Pasos con signo de cada eje (al menos uno distinto de cero)
+     * @param compensacion true para un micro-movimiento de holgura
+     */
+    void agregarBloque(const int32_t *pasos, bool compensacion);
+    
+    /**
+     * @brief Estado de la cortadora del ultimo bloque planificado
+     */
+    uint16_t ciclo_cortadora_planificado;
+    uint8_t estado_cortadora_planificado;
+    
+    /**
+     * @brief Copia en el bloque el estado de la cortadora del comando actual
+     * @param bloque Bloque que se va a agregar al planificador
+     * @param mantener true para repetir el del bloque anterior (compensacion de holgura)
+     */
+    void asignarCortadora(BloquePlanificador &bloque, bool mantener);
+    
+    /**
+     * @brief Holgura de cada eje en pasos
+     */
+    int32_t holgura_pasos[NUM_EJES];
+    
+    /**
+     * @brief Ultimo sentido de cada eje (bit n a 1 = negativo), para detectar inversiones
+     */
+    uint8_t sentido_holgura;
+    
+    /**
+     * @brief Agrega el micro-movimiento que recoge la holgura de los ejes que invierten
+     * @param pasos Pasos con signo del movimiento que se va a planificar
+     */
+    void compensarHolgura(const int32_t *pasos);
+    
+    /**
+     * @brief Pasa a pasos el area de trabajo y la holgura con la configuracion vigente
+     */
+    void aplicarConfiguracion();
+    
+    TipoAjusteMaquina ajuste_pendiente;   ///< Cambio de configuracion que espera a que pare la maquina
+    float valores_ajuste[NUM_EJES];       ///< Valores de ese cambio
+    
+    /**
+     * @brief Aplica el cambio de configuracion pendiente cuando la maquina esta parada
+     * 
+     * Con otros pasos/mm la posicion se conserva en mm y se rehace en pasos.
+     */
+    void actualizarAjuste();
+    
+    /**
+     * @brief Indica si el planificador admite un movimiento mas
+     * 
+     * Se reserva un hueco para la compensacion de holgura que pueda necesitar.
+     */
+    bool planificadorConEspacio() const;
+    
+    /**
+     * @brief Prepara el troceado del arco G02/G03 del comando actual en su plano
+     * @return false si el arco no tiene radio
+     * 
+     * El centro se toma de comando_actual.inicio + I/J/K, como lo escribio el
+     * programa. El numero de segmentos se elige para que la flecha de cada
+     * cuerda no supere TOLERANCIA_ARCO_MM. El eje fuera del plano (Z en G17)
+     * avanza linealmente (helice).
+     */
+    bool iniciarArco();
+    
+    /**
+     * @brief Planifica segmentos del arco en curso mientras el planificador tenga sitio
+     */
+    void continuarArco();
+    
+    /**
+     * @brief Entrega bloques del planificador al generador mientras este tenga espacio
+     * @param completo true para entregar tambien el ultimo bloque aunque la ISR tenga trabajo
+     */
+    void transferirBloques(bool completo);
+    
+    FaseCalibracion fase_calibracion; ///< Fase del eje que se esta calibrando
+    uint8_t orden_calibracion;        ///< Posicion en ORDEN_CALIBRACION del eje en curso
+    TipoAlarma alarma;                ///< Motivo de la alarma en curso
+    bool maquina_calibrada;           ///< La posicion en pasos parte de una calibracion valida
+    
+    /**
+     * @brief Area de trabajo en pasos, para comprobar los limites por software
+     * con enteros
+     */
+    int32_t limite_minimo_pasos[NUM_EJES];
+    int32_t limite_maximo_pasos[NUM_EJES];
+    
+    /**
+     * @brief Indica si los limites por software se aplican ahora mismo
+     */
+    bool limitesSoftwareActivos() const;
+    
+    /**
+     * @brief Comprueba una caja de destino contra el area de trabajo
+     * @param minimo_mm Esquina minima en coordenadas de maquina
+     * @param maximo_mm Esquina maxima en coordenadas de maquina
+     * @return false si se sale; en ese caso la maquina queda en alarma
+     */
+    bool comprobarLimitesSoftware(const float *minimo_mm, const float *maximo_mm);
+    
+    /**
+     * @brief Planifica un movimiento de un solo eje para la calibracion
+     * @param eje Eje a mover
+     * @param distancia_mm Desplazamiento con signo
+     * @param velocidad_mm_min Avance
+     */
+    void moverEjeCalibracion(uint8_t eje, float distancia_mm, float velocidad_mm_min);
+    
+    /**
+     * @brief Entra en una fase de calibracion y lanza su movimiento
+     */
+    void iniciarFaseCalibracion(FaseCalibracion fase);
+    
+    /**
+     * @brief Para el generador tras un disparo y recupera la posicion fijada en el flanco
+     */
+    void detenerTrasDisparo();
+    
+    /**
+     * @brief Avanza la calibracion segun los disparos y el fin de cada movimiento
+     */
+    void actualizarCalibracion();
+    
+    /**
+     * @brief Deja la calibracion en su fase final y vuelve a habilitar los limites
+     */
+    void terminarCalibracion(FaseCalibracion resultado);
+    
+    FaseSondeo fase_sondeo;       ///< Fase del sondeo en curso
+    float destino_sondeo[NUM_EJES]; ///< Final del recorrido de busqueda (mm)
+    float velocidad_sondeo;       ///< Avance de busqueda (mm/min)
+    bool midiendo_malla;          ///< El sondeo en curso es un G29
+    uint8_t punto_malla;          ///< Siguiente nodo de la malla a medir
+    float z_seguro_mm;            ///< Altura de los desplazamientos entre nodos
+    
+    /**
+     * @brief Prepara la busqueda del nodo punto_malla bajo la altura segura
+     */
+    void prepararPuntoMalla();
+    
+    /**
+     * @brief Planifica un movimiento del sondeo con el comando actual
+     * @param destino_mm Punto final
+     * @param rapido true para G00, false para G01 a velocidad_mm_min
+     * @param velocidad_mm_min Avance de un G01
+     */
+    void moverSondeo(const float *destino_mm, bool rapido, float velocidad_mm_min);
+    
+    /**
+     * @brief Avanza el sondeo segun el contacto y el fin de cada movimiento
+     */
+    void actualizarSondeo();
+    
+    /**
+     * @brief Termina el sondeo con alarma; una malla a medias se descarta
+     */
+    void fallarSondeo();
+    
+    /**
+     * @brief Indica si quedan movimientos por planificar o por ejecutar
+     */
+    bool movimientoPendiente() const;
+    
+    FaseMovimientoManual fase_manual; ///< Fase del movimiento manual
+    uint8_t eje_manual;               ///< Eje que se mueve
+    bool manual_positivo;             ///< Sentido del movimiento
+    float incremento_manual_mm;       ///< Longitud de cada bloque del movimiento manual
+    
+    /**
+     * @brief Rellena la cola corta del movimiento manual o lo termina tras el frenado
+     */
+    void actualizarMovimientoManual();
     
 
 public:
-    MultiStepperLite &controlador_motores;
+    GeneradorPasos &generador_pasos;
+    FinalesCarrera &finales_carrera;
+    Sonda &sonda;
 
     /**
      * @brief Constructor de la clase ControladorCNC
-     * @param pin_enable_x Pin enable del motor X
-     * @param pin_step_x Pin step del motor X
-     * @param pin_dir_x Pin direction del motor X
-     * @param pin_enable_y Pin enable del motor Y
-     * @param pin_step_y Pin step del motor Y
-     * @param pin_dir_y Pin direction del motor Y
-     * @param pin_enable_z Pin enable del motor Z
-     * @param pin_step_z Pin step del motor Z
-     * @param pin_dir_z Pin direction del motor Z
+     * @param miGeneradorPasos_ref Referencia al generador de pasos coordinado
+     * @param misFinalesCarrera_ref Referencia a los finales de carrera
+     * @param miSonda_ref Referencia a la sonda de contacto
      */
-    ControladorCNC(MultiStepperLite &miControladorMotores_ref);
+    ControladorCNC(GeneradorPasos &miGeneradorPasos_ref, FinalesCarrera &misFinalesCarrera_ref, Sonda &miSonda_ref);
     
     /**
      * @brief Configura los pines de control de los motores
@@ -82,31 +435,181 @@ public:
     
     /**
      * @brief Ejecuta el comando G-code actualmente establecido
-     * @return true si el comando fue aceptado para ejecucion, false en caso de error
+     * @return true si el comando fue aceptado (encolado), false si es invalido o no hay espacio
+     * 
+     * @note Comprobar hayEspacioEnCola() antes de llamar para no perder el comando.
      */
     bool ejecutarComando();
     
     /**
-     * @brief Actualiza el estado de los motores (debe llamarse frecuentemente en el loop)
+     * @brief Alimenta al generador de pasos con bloques planificados (llamar en el loop)
+     * @note Los pasos no dependen de esta llamada; los genera la ISR del Timer1
+     */
+    void actualizar();
+    
+    /**
+     * @brief Cambia el ajuste de avance de los movimientos G01/G02/G03
+     * @param porcentaje Porcentaje del F programado; se recorta a AJUSTE_AVANCE_MINIMO..AJUSTE_AVANCE_MAXIMO
+     * 
+     * Se aplica a los bloques que siguen en el planificador; los pocos que ya
+     * tiene el generador terminan con la velocidad anterior.
+     */
+    void establecerAjusteAvance(int16_t porcentaje);
+    
+    /**
+     * @brief Cambia el ajuste de los movimientos rapidos G00
+     * @param porcentaje 100, AJUSTE_RAPIDO_MEDIO o AJUSTE_RAPIDO_BAJO
+     */
+    void establecerAjusteRapido(uint8_t porcentaje);
+    
+    /**
+     * @brief Porcentaje de avance vigente
+     */
+    uint8_t obtenerAjusteAvance() const;
+    
+    /**
+     * @brief Porcentaje de rapidos vigente
+     */
+    uint8_t obtenerAjusteRapido() const;
+    
+    /**
+     * @brief Indica si el planificador admite otro bloque
+     * @return true si se puede interpretar y ejecutar la siguiente linea
+     * 
+     * @note Es false mientras quedan segmentos de un arco o de un tramo de la
+     *       malla por planificar, durante la calibracion, el sondeo y el
+     *       movimiento manual, con un cambio de configuracion pendiente o si
+     *       no cabe una linea de grabado completa.
      */
-    void actualizar(uint32_t tiempo_actual,float *posicion_motor);
+    bool hayEspacioEnCola() const;
     
     /**
-     * @brief Verifica si hay un comando en ejecucion
-     * @return true si hay un comando en ejecucion, false si esta listo para nuevo comando
+     * @brief Verifica si hay movimientos pendientes o en curso
+     * @return true si quedan bloques por ejecutar, false si la maquina esta detenida
      */
     bool comandoEnEjecucion() const;
     
     /**
      * @brief Detiene inmediatamente todos los motores
+     * 
+     * Descarta lo planificado; para pausar sin perder el trabajo usar retenerAvance().
      */
     void detenerEmergencia();
     
+    /**
+     * @brief Retencion de avance: frena siguiendo la rampa y detiene los motores
+     * 
+     * El bloque en curso y la cola se conservan, asi que la posicion no se pierde.
+     */
+    void retenerAvance();
+    
+    /**
+     * @brief Reanuda tras una retencion con una rampa de aceleracion
+     */
+    void reanudarAvance();
+    
+    /**
+     * @brief Indica si hay una retencion pedida (frenando o detenida)
+     */
+    bool enRetencion() const;
+    
+    /**
+     * @brief Inicia la calibracion de los tres ejes
+     * @return false si hay movimientos en curso
+     * 
+     * Por eje: busqueda rapida del final, retroceso, localizacion lenta y
+     * separacion. El punto de disparo de la localizacion es el cero de maquina.
+     */
+    bool iniciarCalibracion();
+    
+    /**
+     * @brief Indica si la calibracion sigue en curso
+     */
+    bool calibrando() const;
+    
+    /**
+     * @brief Fase actual de la calibracion (COMPLETA o FALLIDA al terminar)
+     */
+    FaseCalibracion obtenerFaseCalibracion() const;
+    
+    /**
+     * @brief Indica si hay un sondeo G38.2 o una medida de malla G29 en curso
+     */
+    bool sondeando() const;
+    
+    /**
+     * @brief Indica si hay una malla de alturas valida (medida o cargada de EEPROM)
+     */
+    bool mallaValida() const;
+    
+    /**
+     * @brief Empieza a mover un eje mientras se mantenga pulsada su tecla
+     * @param eje Eje a mover
+     * @param positivo Sentido del movimiento
+     * @return false si la maquina esta ocupada, en alarma o frenando el
+     *         movimiento manual anterior; true si ya se movia asi
+     * 
+     * Se puede llamar en cada vuelta del loop mientras la tecla siga pulsada.
+     * Con limites por software el eje se para en el borde del area de trabajo.
+     */
+    bool iniciarMovimientoManual(uint8_t eje, bool positivo);
+    
+    /**
+     * @brief Frena el movimiento manual (tecla soltada)
+     * 
+     * La maquina frena con la rampa desde donde este; lo que quedaba en la
+     * cola se descarta al parar.
+     */
+    void cancelarMovimientoManual();
+    
+    /**
+     * @brief Indica si hay un movimiento manual en curso (moviendo o frenando)
+     */
+    bool movimientoManualActivo() const;
+    
+    /**
+     * @brief Indica si la maquina esta en alarma
+     * 
+     * En alarma no se aceptan comandos. Tras un limite fisico la posicion en
+     * pasos puede haberse perdido en la parada brusca, asi que hay que
+     * recalibrar para volver a tener limites por software.
+     */
+    bool enAlarma() const;
+    
+    /**
+     * @brief Motivo de la alarma en curso
+     */
+    TipoAlarma obtenerAlarma() const;
+    
+    /**
+     * @brief Sale de la alarma y descarta los movimientos retenidos
+     * @return false si algun final sigue pisado (se sale calibrando) o si la
+     *         maquina aun esta frenando
+     */
+    bool restablecerAlarma();
+    
     /**
      * @brief Obtiene el comando actual en ejecucion
      * @return Referencia constante al comando actual
      */
     const ComandoGcode& obtenerComandoActual() const;
+    
+    /**
+     * @brief Posicion de un eje al final de lo planificado
+     * @param eje Eje consultado
+     * @return Posicion en pasos
+     */
+    int32_t obtenerPosicionPasos(uint8_t eje) const;
+    
+    /**
+     * @brief Posicion real de un eje segun los pasos ya emitidos por la ISR
+     * @param eje Eje consultado
+     * @return Posicion de maquina en milimetros
+     * 
+     * Se descuenta la correccion (escuadra y malla) del ultimo bloque
+     * planificado, asi que con la maquina parada coincide con lo programado.
+     */
+    float obtenerPosicionActualMm(uint8_t eje) const;
 };
 
 #endif // CNC_H
\ No newline at end of file
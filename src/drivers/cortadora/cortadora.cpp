@@ -0,0 +1,99 @@
+#include <util/atomic.h>
+
+#include "cortadora.h"
+#include "pin_rapido.h"
+
+typedef PinRapido<PIN_CORTADORA_PWM> PinPwm;
+typedef PinRapido<PIN_CORTADORA_DIR> PinDireccion;
+typedef PinRapido<PIN_CORTADORA_EN> PinHabilitacion;
+
+volatile uint16_t Cortadora::ciclo_actual = 0;
+volatile uint8_t Cortadora::estado_actual = 0;
+
+void Cortadora::inicializar() {
+    PinPwm::bajo();
+    PinPwm::salida();
+    PinDireccion::bajo();
+    PinDireccion::salida();
+    PinHabilitacion::bajo();
+    PinHabilitacion::salida();
+
+    // Fast PWM con tope en ICR5 (modo 14), prescaler 8. OC5A queda
+    // desconectado hasta que haya un ciclo distinto de cero.
+    TCCR5A = _BV(WGM51);
+    TCCR5B = _BV(WGM53) | _BV(WGM52) | _BV(CS51);
+    ICR5 = PWM_CORTADORA_MAXIMO;
+    OCR5A = 0;
+
+    ciclo_actual = 0;
+    estado_actual = 0;
+}
+
+uint8_t Cortadora::estadoDeModo(uint8_t modo) {
+    switch (modo) {
+        case 3: return CORTADORA_ENCENDIDA;
+#if MODO_LASER
+        case 4: return CORTADORA_ENCENDIDA | CORTADORA_ANTIHORARIA | CORTADORA_DINAMICA;
+#else
+        case 4: return CORTADORA_ENCENDIDA | CORTADORA_ANTIHORARIA;
+#endif
+        default: return 0;
+    }
+}
+
+uint16_t Cortadora::cicloDeVelocidad(float velocidad, uint8_t estado) {
+    if (!(estado & CORTADORA_ENCENDIDA) || velocidad <= 0.0f) {
+        return 0;
+    }
+    if (velocidad >= VELOCIDAD_CORTADORA_MAXIMA) {
+        return PWM_CORTADORA_MAXIMO;
+    }
+    return (uint16_t)(velocidad * PWM_CORTADORA_MAXIMO / VELOCIDAD_CORTADORA_MAXIMA + 0.5f);
+}
+
+void Cortadora::aplicar(uint16_t ciclo, uint8_t estado) {
+    if (ciclo == ciclo_actual && estado == estado_actual) {
+        return;
+    }
+
+    // Con OCR5A = 0 el fast PWM aun saca un pulso de una cuenta por periodo:
+    // a ciclo cero se desconecta OC5A y el pin queda en bajo
+    OCR5A = ciclo;
+    if (ciclo == 0) {
+        TCCR5A &= ~_BV(COM5A1);
+    } else {
+        TCCR5A |= _BV(COM5A1);
+    }
+
+    PinDireccion::escribir((estado & CORTADORA_ANTIHORARIA) != 0);
+    PinHabilitacion::escribir((estado & CORTADORA_ENCENDIDA) != 0);
+
+    ciclo_actual = ciclo;
+    estado_actual = estado;
+}
+
+void Cortadora::apagar() {
+    aplicar(0, 0);
+}
+
+void Cortadora::pararMovimiento() {
+    if (estado_actual & CORTADORA_DINAMICA) {
+        aplicar(0, estado_actual);
+    }
+}
+
+uint16_t Cortadora::obtenerCiclo() {
+    uint16_t ciclo;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ciclo = ciclo_actual;
+    }
+    return ciclo;
+}
+
+float Cortadora::obtenerVelocidad() {
+    return obtenerCiclo() * VELOCIDAD_CORTADORA_MAXIMA / PWM_CORTADORA_MAXIMO;
+}
+
+uint8_t Cortadora::obtenerEstado() {
+    return estado_actual;
+}
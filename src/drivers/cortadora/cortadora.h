@@ -0,0 +1,86 @@
+#ifndef CORTADORA_H
+#define CORTADORA_H
+
+#include <Arduino.h>
+#include "constantes.h"
+#include "pines.h"
+
+/**
+ * @file cortadora.h
+ * @brief Salida PWM de la cortadora (husillo o laser) sobre el Timer5
+ *
+ * @details El PWM sale por OC5A en modo fast PWM con tope en ICR5, asi que
+ * cambiar el ciclo de trabajo es escribir un registro: lo bastante barato
+ * para hacerlo desde la ISR del generador de pasos justo cuando empieza el
+ * bloque que lo trae (M3/M4/M5 y S se aplican en su sitio del recorrido, no
+ * cuando el interprete lee la linea).
+ *
+ * Con potencia dinamica el generador recalcula el ciclo en cada segmento y
+ * la ISR lo aplica al cargarlo.
+ */
+
+#define CORTADORA_ENCENDIDA   0x01 ///< Bit de estado: cortadora en marcha
+#define CORTADORA_ANTIHORARIA 0x02 ///< Bit de estado: giro M4 (pin DIR en alto)
+#define CORTADORA_DINAMICA    0x04 ///< Bit de estado: potencia proporcional a la velocidad (M4 con MODO_LASER)
+
+/**
+ * @class Cortadora
+ * @brief Control estatico de la cortadora (solo hay una)
+ */
+class Cortadora {
+private:
+    static volatile uint16_t ciclo_actual;  ///< Valor cargado en OCR5A
+    static volatile uint8_t estado_actual;  ///< Bits CORTADORA_* aplicados
+
+public:
+    /**
+     * @brief Configura el Timer5 y los pines, con la cortadora apagada
+     */
+    static void inicializar();
+
+    /**
+     * @brief Convierte un modo M (3, 4 o 5) en bits de estado
+     */
+    static uint8_t estadoDeModo(uint8_t modo);
+
+    /**
+     * @brief Convierte un valor S en cuentas de OCR5A
+     * @param velocidad Valor S programado (0..VELOCIDAD_CORTADORA_MAXIMA)
+     * @param estado Bits de estado; apagada siempre da 0
+     */
+    static uint16_t cicloDeVelocidad(float velocidad, uint8_t estado);
+
+    /**
+     * @brief Aplica un ciclo de trabajo y un estado
+     * @note Se llama desde la ISR del generador de pasos al cargar un bloque
+     */
+    static void aplicar(uint16_t ciclo, uint8_t estado);
+
+    /**
+     * @brief Apaga la cortadora al instante (parada de emergencia)
+     */
+    static void apagar();
+
+    /**
+     * @brief Los motores se pararon: con potencia dinamica el ciclo baja a cero
+     * @note Se llama desde la ISR del generador de pasos al quedarse sin segmentos
+     */
+    static void pararMovimiento();
+
+    /**
+     * @brief Ciclo de trabajo aplicado (cuentas de OCR5A)
+     */
+    static uint16_t obtenerCiclo();
+
+    /**
+     * @brief Valor S equivalente al ciclo aplicado
+     */
+    static float obtenerVelocidad();
+
+    /**
+     * @brief Bits de estado aplicados
+     */
+    static uint8_t obtenerEstado();
+};
+
+#endif // CORTADORA_H
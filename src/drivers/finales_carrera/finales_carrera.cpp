@@ -0,0 +1,97 @@
+#include "finales_carrera.h"
+#include "pin_rapido.h"
+#include <util/atomic.h>
+
+typedef PinRapido<PIN_FINAL_CARRERA_X> FinalX;
+typedef PinRapido<PIN_FINAL_CARRERA_Y> FinalY;
+typedef PinRapido<PIN_FINAL_CARRERA_Z> FinalZ;
+
+static_assert(FinalX::puerto == PUERTO_K && FinalY::puerto == PUERTO_K && FinalZ::puerto == PUERTO_K,
+              "FinalesCarrera: los finales deben estar en el puerto K (PCINT2)");
+
+FinalesCarrera *FinalesCarrera::instancia = nullptr;
+
+ISR(PCINT2_vect) {
+    FinalesCarrera::instancia->atenderInterrupcion();
+}
+
+FinalesCarrera::FinalesCarrera(GeneradorPasos &miGeneradorPasos_ref):
+    generador_pasos(miGeneradorPasos_ref),
+    ejes_armados(0),
+    ejes_disparados(0),
+    limites_habilitados(LIMITES_FISICOS_HABILITADOS),
+    disparo_limite(false)
+{
+    instancia = this;
+}
+
+void FinalesCarrera::inicializar() {
+    FinalX::entradaPullUp();
+    FinalY::entradaPullUp();
+    FinalZ::entradaPullUp();
+
+    // En el puerto K el bit del pin coincide con el de PCMSK2
+    PCMSK2 |= FinalX::mascara | FinalY::mascara | FinalZ::mascara;
+    PCIFR = _BV(PCIF2);
+    PCICR |= _BV(PCIE2);
+}
+
+uint8_t FinalesCarrera::leer() const {
+    uint8_t niveles = (FinalX::leer() ? (1 << EJE_X) : 0) |
+                      (FinalY::leer() ? (1 << EJE_Y) : 0) |
+                      (FinalZ::leer() ? (1 << EJE_Z) : 0);
+#if FINAL_CARRERA_ACTIVO_BAJO
+    return ~niveles & ((1 << NUM_EJES) - 1);
+#else
+    return niveles;
+#endif
+}
+
+void FinalesCarrera::armar(uint8_t mascara) {
+    ejes_armados = mascara;
+}
+
+uint8_t FinalesCarrera::obtenerDisparados() const {
+    return ejes_disparados;
+}
+
+void FinalesCarrera::limpiar() {
+    ejes_disparados = 0;
+}
+
+void FinalesCarrera::habilitarLimites(bool habilitar) {
+    limites_habilitados = habilitar && LIMITES_FISICOS_HABILITADOS;
+}
+
+bool FinalesCarrera::consumirDisparoLimite() {
+    bool disparo;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        disparo = disparo_limite;
+        disparo_limite = false;
+    }
+    return disparo;
+}
+
+/**
+ * @brief PCINT2 salta en ambos flancos de cualquier pin del puerto K; solo
+ * interesan los finales activados. Un limite para el temporizador aqui mismo;
+ * vaciar las colas del generador y el planificador queda para el
+ * ControladorCNC, fuera de la interrupcion.
+ */
+void FinalesCarrera::atenderInterrupcion() {
+    uint8_t activos = leer();
+    if (activos == 0) {
+        return;
+    }
+    if (limites_habilitados) {
+        generador_pasos.detenerDesdeInterrupcion();
+        disparo_limite = true;
+        return;
+    }
+    uint8_t activados = activos & ejes_armados;
+    if (activados) {
+        generador_pasos.bloquearEjes(activados);
+        ejes_disparados |= activados;
+        ejes_armados &= ~activados;
+    }
+}
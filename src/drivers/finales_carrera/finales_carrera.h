@@ -0,0 +1,93 @@
+#ifndef FINALES_CARRERA_H
+#define FINALES_CARRERA_H
+
+#include <Arduino.h>
+#include "constantes.h"
+#include "pines.h"
+#include "generador_pasos.h"
+
+/**
+ * @file finales_carrera.h
+ * @brief Lectura de los finales de carrera con interrupcion de cambio de pin
+ *
+ * @details Los tres finales comparten la interrupcion PCINT2 (puerto K). Un
+ * eje "armado" se bloquea en el GeneradorPasos dentro de la propia
+ * interrupcion, de modo que la posicion en pasos queda fijada en el flanco
+ * aunque el loop() tarde en enterarse. Lo usa la calibracion de ejes.
+ *
+ * Fuera de la calibracion actuan como limites fisicos: la misma interrupcion
+ * detiene el generador de pasos al instante, sin esperar al loop(), que
+ * puede pasar decenas de milisegundos dibujando en la pantalla.
+ */
+
+/**
+ * @class FinalesCarrera
+ * @brief Finales de carrera de los tres ejes (bit n = eje n)
+ *
+ * @note Solo puede existir una instancia: la ISR la localiza a traves del
+ *       puntero estatico instancia.
+ */
+class FinalesCarrera {
+private:
+    GeneradorPasos &generador_pasos;
+    volatile uint8_t ejes_armados;     ///< Ejes que se bloquean al activarse su final
+    volatile uint8_t ejes_disparados;  ///< Ejes armados cuyo final se activo
+    volatile bool limites_habilitados; ///< Un final activado detiene los motores
+    volatile bool disparo_limite;      ///< Un limite detuvo los motores y nadie lo ha atendido
+
+public:
+    static FinalesCarrera *instancia; ///< Instancia atendida por la ISR
+
+    /**
+     * @brief Constructor
+     * @param miGeneradorPasos_ref Generador cuyos ejes se bloquean al disparar
+     */
+    FinalesCarrera(GeneradorPasos &miGeneradorPasos_ref);
+
+    /**
+     * @brief Configura los pines con pull-up y habilita la interrupcion PCINT2
+     */
+    void inicializar();
+
+    /**
+     * @brief Estado actual de los finales
+     * @return Bit n a 1 si el final del eje n esta activado
+     */
+    uint8_t leer() const;
+
+    /**
+     * @brief Elige los ejes que se bloquean al activarse su final
+     * @param mascara Bit n a 1 para armar el eje n (0 desarma todos)
+     */
+    void armar(uint8_t mascara);
+
+    /**
+     * @brief Ejes armados que se dispararon desde la ultima llamada a limpiar()
+     */
+    uint8_t obtenerDisparados() const;
+
+    /**
+     * @brief Olvida los disparos registrados
+     */
+    void limpiar();
+
+    /**
+     * @brief Habilita o suspende los limites fisicos (se suspenden al calibrar)
+     * @note Sin efecto si LIMITES_FISICOS_HABILITADOS es 0
+     */
+    void habilitarLimites(bool habilitar);
+
+    /**
+     * @brief Indica si un limite detuvo los motores desde la ultima consulta
+     * @return true una sola vez por disparo
+     */
+    bool consumirDisparoLimite();
+
+    /**
+     * @brief Rutina de servicio de PCINT2
+     * @note Solo debe llamarse desde ISR(PCINT2_vect)
+     */
+    void atenderInterrupcion();
+};
+
+#endif // FINALES_CARRERA_H
@@ -0,0 +1,575 @@
+#include <util/atomic.h>
+
+#include "generador_pasos.h"
+#include "constantes.h"
+#include "pines.h"
+#include "pin_rapido.h"
+#include "cortadora.h"
+
+// Bit n de las mascaras = eje n (EJE_X, EJE_Y, EJE_Z)
+typedef GrupoPinesRapido<PIN_MOTOR_X_PUL, PIN_MOTOR_Y_PUL, PIN_MOTOR_Z_PUL> PinesPaso;
+typedef GrupoPinesRapido<PIN_MOTOR_X_DIR, PIN_MOTOR_Y_DIR, PIN_MOTOR_Z_DIR> PinesDireccion;
+
+// Bits CS1x del Timer1 para los dos prescalers usados
+#define PRESCALER_TIMER1_8  (_BV(CS11))
+#define PRESCALER_TIMER1_64 (_BV(CS11) | _BV(CS10))
+#define MASCARA_PRESCALER_TIMER1 (_BV(CS12) | _BV(CS11) | _BV(CS10))
+
+GeneradorPasos *GeneradorPasos::instancia = nullptr;
+
+ISR(TIMER1_COMPA_vect) {
+    GeneradorPasos::instancia->atenderInterrupcion();
+}
+
+GeneradorPasos::GeneradorPasos():
+    indice_cabeza(0),
+    indice_cola(0),
+    indice_segmento_cabeza(0),
+    indice_segmento_cola(0),
+    segmentos_adelantados(TAMANO_BUFFER_SEGMENTOS - 1),
+    bloque(nullptr),
+    segmento(nullptr),
+    interrupciones_restantes(0),
+    temporizador_activo(false),
+    detenido(false),
+    indice_pixel_cabeza(0),
+    indice_pixel_cola(0),
+    pixeles_restantes(0),
+    contador_pixel(0),
+    mascara_dominante(0),
+    ciclo_segmento(0),
+    indice_preparacion(0),
+    bloque_preparacion(nullptr),
+    eventos_preparados(0),
+    rampa_preparacion(),
+    resto_eventos(0),
+    frenando_retencion(false),
+    retenido(false)
+{
+    instancia = this;
+}
+
+void GeneradorPasos::inicializar() {
+    PinesPaso::salida();
+    PinesPaso::escribir(0);
+
+    // Timer1 en modo CTC (WGM12), detenido hasta que haya segmentos
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TCCR1A = 0;
+        TCCR1B = _BV(WGM12);
+        TCNT1 = 0;
+        TIMSK1 &= ~_BV(OCIE1A);
+        temporizador_activo = false;
+    }
+}
+
+bool GeneradorPasos::encolarBloque(const BloquePasos& nuevo_bloque) {
+    if (nuevo_bloque.eventos == 0) {
+        return false;
+    }
+
+    uint8_t siguiente = (indice_cabeza + 1) % TAMANO_COLA_PASOS;
+    if (siguiente == indice_cola) {
+        return false; // Cola llena
+    }
+
+    cola[indice_cabeza] = nuevo_bloque;
+    // Publicar el bloque solo cuando ya esta completo
+    indice_cabeza = siguiente;
+
+#if MODO_DESARROLLADOR
+    Serial.print(F("[GeneradorPasos::encolarBloque] Eventos: ")); Serial.print(nuevo_bloque.eventos);
+    Serial.print(F(" tasa: ")); Serial.print(nuevo_bloque.tasa_inicial);
+    Serial.print(F("/")); Serial.print(nuevo_bloque.tasa_nominal);
+    Serial.print(F("/")); Serial.println(nuevo_bloque.tasa_final);
+#endif
+    return true;
+}
+
+bool GeneradorPasos::hayEspacioEnCola() const {
+    return ((indice_cabeza + 1) % TAMANO_COLA_PASOS) != indice_cola;
+}
+
+uint8_t GeneradorPasos::bloquesPendientes() const {
+    return (indice_cabeza + TAMANO_COLA_PASOS - indice_cola) % TAMANO_COLA_PASOS;
+}
+
+bool GeneradorPasos::encolarPixeles(const uint8_t *potencias, uint8_t cantidad) {
+    if (cantidad > espacioPixeles()) {
+        return false;
+    }
+    uint8_t cabeza = indice_pixel_cabeza;
+    for (uint8_t i = 0; i < cantidad; i++) {
+        pixeles[cabeza++] = potencias[i];
+    }
+    indice_pixel_cabeza = cabeza;
+    return true;
+}
+
+/**
+ * @brief Con indices de 8 bits la resta da la ocupacion directamente; se deja
+ * un hueco libre para distinguir el buffer lleno del vacio.
+ */
+uint8_t GeneradorPasos::espacioPixeles() const {
+    return (TAMANO_BUFFER_PIXELES - 1) - static_cast<uint8_t>(indice_pixel_cabeza - indice_pixel_cola);
+}
+
+/**
+ * @brief Una parada desde otra ISR puede llegar en mitad de la preparacion;
+ * el temporizador solo se arranca comprobandola con las interrupciones
+ * desactivadas.
+ */
+void GeneradorPasos::prepararSegmentos() {
+    if (detenido) {
+        return;
+    }
+    bool preparado = false;
+    while (prepararSegmento()) {
+        preparado = true;
+    }
+
+    if (preparado) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (!temporizador_activo && !detenido) {
+                iniciarTemporizador();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Cada segmento dura un tick de aceleracion. La tasa sigue las mismas
+ * reglas que usa el planificador para situar los cambios de fase: la subida
+ * cambia la tasa al final del tick, la bajada al principio. Los segmentos se
+ * cortan en acelerar_hasta y desacelerar_desde para no pasarse de fase.
+ */
+bool GeneradorPasos::prepararSegmento() {
+    uint8_t siguiente_segmento = (indice_segmento_cabeza + 1) % TAMANO_BUFFER_SEGMENTOS;
+    uint8_t preparados = (indice_segmento_cabeza + TAMANO_BUFFER_SEGMENTOS - indice_segmento_cola) % TAMANO_BUFFER_SEGMENTOS;
+    if (preparados >= segmentos_adelantados) {
+        return false; // Buffer de segmentos lleno (o en el limite fijado)
+    }
+
+    if (retenido) {
+        return false; // Retencion completa: esperar a reanudar()
+    }
+    if (bloque_preparacion == nullptr && !iniciarBloquePreparacion()) {
+        return false; // Nada que preparar
+    }
+    const BloquePasos *preparando = bloque_preparacion;
+    if (frenando_retencion && preparando->tasa_programada == 0) {
+        // Una pausa (G04) ya es un punto de parada: el frenado no la alarga
+        frenando_retencion = false;
+        retenido = true;
+        return false;
+    }
+
+    uint32_t tasa_segmento;
+    uint32_t limite_fase;
+    if (frenando_retencion) {
+        // Se frena con la aceleracion del bloque en curso, sin atender a sus fases
+        uint32_t &tasa = rampa_preparacion.tasa;
+        uint32_t minima = TASA_MINIMA_EVENTOS * UNO_Q16;
+        uint32_t incremento = NucleoPasos::incrementoTick(*preparando, rampa_preparacion,
+                                                          tasa > minima ? tasa - minima : 0);
+        if (tasa > minima + incremento) {
+            tasa -= incremento;
+        } else {
+            tasa = minima;
+            frenando_retencion = false;
+            retenido = true;
+        }
+        tasa_segmento = tasa;
+        limite_fase = preparando->eventos;
+    } else {
+        tasa_segmento = NucleoPasos::tasaTick(*preparando, eventos_preparados, rampa_preparacion, limite_fase);
+    }
+    if (tasa_segmento < (TASA_MINIMA_EVENTOS * UNO_Q16)) {
+        tasa_segmento = TASA_MINIMA_EVENTOS * UNO_Q16;
+    }
+
+    // Eventos que caben en un tick, arrastrando la fraccion al siguiente
+    resto_eventos += tasa_segmento / TICKS_ACELERACION_POR_SEGUNDO;
+    uint32_t eventos = enteroQ16(resto_eventos);
+    resto_eventos &= (UNO_Q16 - 1);
+    if (eventos == 0) {
+        eventos = 1;
+    }
+    if (eventos > limite_fase - eventos_preparados) {
+        eventos = limite_fase - eventos_preparados;
+    }
+
+    // Periodo en cuentas de 0.5 us (tasa en Q24.8 para no desbordar); a tasas
+    // bajas se sobremuestrea
+    uint32_t cuentas = ((F_CPU / 8) << 8) / (tasa_segmento >> 8);
+    uint8_t nivel = 0;
+    while (nivel < NIVEL_MAXIMO_AMASS && (cuentas >> 1) >= PERIODO_MINIMO_AMASS) {
+        cuentas >>= 1;
+        nivel++;
+    }
+
+    SegmentoPasos &nuevo = segmentos[indice_segmento_cabeza];
+    nuevo.prescaler = PRESCALER_TIMER1_8;
+    if (cuentas > 0xFFFF) {
+        // Con prescaler 64 el Timer1 cuenta cada 4 us
+        cuentas >>= 3;
+        nuevo.prescaler = PRESCALER_TIMER1_64;
+        if (cuentas > 0xFFFF) {
+            cuentas = 0xFFFF;
+        }
+    } else if (cuentas < INTERVALO_MINIMO_TIMER) {
+        cuentas = INTERVALO_MINIMO_TIMER;
+    }
+    nuevo.cuentas_timer = static_cast<uint16_t>(cuentas);
+    nuevo.nivel_amass = nivel;
+    nuevo.interrupciones = static_cast<uint16_t>(eventos << nivel);
+    nuevo.ciclo_cortadora = calcularCicloCortadora(*preparando, tasa_segmento);
+
+    eventos_preparados += eventos;
+    nuevo.ultimo_del_bloque = (eventos_preparados >= preparando->eventos);
+    if (nuevo.ultimo_del_bloque) {
+        bloque_preparacion = nullptr;
+        indice_preparacion = (indice_preparacion + 1) % TAMANO_COLA_PASOS;
+        if (frenando_retencion && indice_preparacion == indice_cabeza) {
+            // Se acabo la cola mientras se frenaba: la retencion termina aqui
+            frenando_retencion = false;
+            retenido = true;
+        }
+    }
+
+    // Publicar el segmento solo cuando ya esta completo
+    indice_segmento_cabeza = siguiente_segmento;
+    return true;
+}
+
+/**
+ * @brief La razon entre tasas se calcula en Q8 (256 = velocidad programada)
+ * para multiplicar el ciclo sin desbordar 32 bits. Las pausas tienen tasa
+ * programada nula: la maquina esta parada y el laser no corta.
+ */
+uint16_t GeneradorPasos::calcularCicloCortadora(const BloquePasos& preparando, uint32_t tasa_segmento) const {
+    if (!(preparando.estado_cortadora & CORTADORA_DINAMICA)) {
+        return preparando.ciclo_cortadora;
+    }
+    uint32_t referencia = preparando.tasa_programada >> 8;
+    if (referencia == 0) {
+        return 0;
+    }
+    uint32_t razon = tasa_segmento / referencia;
+    if (razon >= 256) {
+        return preparando.ciclo_cortadora;
+    }
+    return static_cast<uint16_t>((static_cast<uint32_t>(preparando.ciclo_cortadora) * razon) >> 8);
+}
+
+bool GeneradorPasos::iniciarBloquePreparacion() {
+    if (indice_preparacion == indice_cabeza) {
+        return false;
+    }
+    bloque_preparacion = &cola[indice_preparacion];
+    eventos_preparados = 0;
+    resto_eventos = 0;
+    if (frenando_retencion) {
+        // El frenado sigue sobre el bloque nuevo desde la tasa alcanzada
+        rampa_preparacion.desacelerando = true;
+        return true;
+    }
+    rampa_preparacion.tasa = bloque_preparacion->tasa_inicial;
+    rampa_preparacion.incremento = 0;
+    rampa_preparacion.desacelerando = false;
+    return true;
+}
+
+/**
+ * @brief Primero se asegura la tasa final: si ni acelerando todo el resto del
+ * bloque se llega a ella, se busca la mayor alcanzable. Luego se busca igual
+ * la tasa pico con la que caben la subida y la bajada. Las dos busquedas son
+ * las de NucleoPasos::picoRampas(), con un numero acotado de reproducciones.
+ */
+uint32_t GeneradorPasos::recalcularPerfil(BloquePasos& destino, uint32_t eventos_hechos, uint32_t tasa_desde) {
+    uint32_t resto = destino.eventos - eventos_hechos;
+    uint32_t incremento = destino.incremento_tasa;
+    uint32_t sobreaceleracion = destino.incremento_aceleracion;
+
+    uint32_t final = destino.tasa_final;
+    uint32_t subida;
+    uint32_t bajada;
+    if (final > tasa_desde && NucleoPasos::eventosRampa(tasa_desde, final, incremento, sobreaceleracion) > resto) {
+        final = NucleoPasos::picoRampas(tasa_desde, 0, false, tasa_desde, final, resto,
+                                        incremento, sobreaceleracion, subida, bajada);
+    }
+
+    uint32_t pico = max(destino.tasa_nominal, max(tasa_desde, final));
+    subida = NucleoPasos::eventosRampa(tasa_desde, pico, incremento, sobreaceleracion);
+    bajada = NucleoPasos::eventosRampa(pico, final, incremento, sobreaceleracion);
+    if (subida + bajada > resto) {
+        pico = NucleoPasos::picoRampas(tasa_desde, final, true, max(tasa_desde, final), pico, resto,
+                                       incremento, sobreaceleracion, subida, bajada);
+        if (subida + bajada > resto) {
+            bajada = resto - min(subida, resto);
+        }
+    }
+
+    destino.tasa_inicial = tasa_desde;
+    destino.tasa_nominal = pico;
+    destino.tasa_final = final;
+    destino.acelerar_hasta = eventos_hechos + min(subida, resto);
+    destino.desacelerar_desde = destino.eventos - bajada;
+    return final;
+}
+
+/**
+ * @brief Los segmentos de un bloque llegan en orden, asi que el bloque de un
+ * segmento nuevo siempre es el de la cola.
+ */
+bool GeneradorPasos::cargarSiguienteSegmento() {
+    if (indice_segmento_cola == indice_segmento_cabeza) {
+        return false;
+    }
+
+    segmento = &segmentos[indice_segmento_cola];
+    TCCR1B = (TCCR1B & ~MASCARA_PRESCALER_TIMER1) | segmento->prescaler;
+    OCR1A = segmento->cuentas_timer;
+
+    if (bloque == nullptr) {
+        bloque = &cola[indice_cola];
+        nucleo.iniciarBloque(bloque->pasos, bloque->eventos, bloque->direccion, bloque->compensacion);
+        aplicarDireccion();
+
+        // Los pixeles avanzan con los eventos del eje dominante
+        pixeles_restantes = bloque->pixeles;
+        contador_pixel = 0;
+        mascara_dominante = 0;
+        for (uint8_t i = 0; i < NUM_EJES && mascara_dominante == 0; i++) {
+            if (bloque->pasos[i] == bloque->eventos) {
+                mascara_dominante = 1 << i;
+            }
+        }
+    }
+    // M3/M4/M5 y S cambian justo donde empieza su bloque; con potencia
+    // dinamica el ciclo cambia ademas en cada segmento
+    ciclo_segmento = segmento->ciclo_cortadora;
+    aplicarPixel();
+
+    nucleo.ajustarNivel(bloque->pasos, segmento->nivel_amass);
+    interrupciones_restantes = segmento->interrupciones;
+    return true;
+}
+
+/**
+ * @brief pixel + pixel/128 lleva 0-255 a 0-256 sin dividir: 255 da el ciclo
+ * completo y 0 apaga.
+ */
+void GeneradorPasos::aplicarPixel() {
+    uint16_t ciclo = ciclo_segmento;
+    if (pixeles_restantes != 0) {
+        uint8_t pixel = pixeles[indice_pixel_cola];
+        ciclo = static_cast<uint16_t>((static_cast<uint32_t>(ciclo) * (pixel + (pixel >> 7))) >> 8);
+    }
+    Cortadora::aplicar(ciclo, bloque->estado_cortadora);
+}
+
+void GeneradorPasos::atenderInterrupcion() {
+    if (segmento == nullptr) {
+        if (!cargarSiguienteSegmento()) {
+            // Sin segmentos: fin del trabajo o el loop no alcanzo a preparar
+            detenerTemporizador();
+            Cortadora::pararMovimiento();
+            return;
+        }
+    }
+
+    uint8_t mascara = nucleo.calcularEvento();
+    pulsar(mascara);
+
+    if (pixeles_restantes != 0 && (mascara & mascara_dominante)) {
+        // Bresenham: tras el evento k han empezado k * pixeles / eventos pixeles
+        contador_pixel += bloque->pixeles;
+        bool cambio = false;
+        while (contador_pixel >= bloque->eventos && pixeles_restantes != 0) {
+            contador_pixel -= bloque->eventos;
+            indice_pixel_cola++;
+            pixeles_restantes--;
+            cambio = true;
+        }
+        if (cambio && pixeles_restantes != 0) {
+            aplicarPixel();
+        }
+    }
+
+    if (--interrupciones_restantes == 0) {
+        if (segmento->ultimo_del_bloque) {
+            // El bloque termino: liberar su hueco en la cola
+            bloque = nullptr;
+            indice_cola = (indice_cola + 1) % TAMANO_COLA_PASOS;
+        }
+        segmento = nullptr;
+        indice_segmento_cola = (indice_segmento_cola + 1) % TAMANO_BUFFER_SEGMENTOS;
+    }
+}
+
+bool GeneradorPasos::enMovimiento() const {
+    return indice_cabeza != indice_cola;
+}
+
+void GeneradorPasos::detener() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        detenerTemporizador();
+        bloque = nullptr;
+        segmento = nullptr;
+        interrupciones_restantes = 0;
+        nucleo.vaciar();
+        indice_segmento_cola = indice_segmento_cabeza;
+        indice_cola = indice_cabeza;
+        indice_preparacion = indice_cabeza;
+        bloque_preparacion = nullptr;
+        frenando_retencion = false;
+        retenido = false;
+        pixeles_restantes = 0;
+        indice_pixel_cola = indice_pixel_cabeza;
+        Cortadora::apagar();
+        detenido = false;
+    }
+}
+
+void GeneradorPasos::detenerDesdeInterrupcion() {
+    detenerTemporizador();
+    Cortadora::apagar();
+    detenido = true;
+}
+
+bool GeneradorPasos::estaDetenido() const {
+    return detenido;
+}
+
+void GeneradorPasos::retener() {
+    if (frenando_retencion || retenido) {
+        return;
+    }
+    if (bloque_preparacion == nullptr && indice_preparacion == indice_cabeza) {
+        retenido = true; // Ya no queda nada por preparar
+        return;
+    }
+    frenando_retencion = true;
+    rampa_preparacion.desacelerando = true;
+    rampa_preparacion.incremento = 0;
+}
+
+/**
+ * @brief El bloque que quedo a medias se retoma desde la tasa minima. Si no
+ * le alcanza para llegar a su tasa final, los bloques siguientes de la cola
+ * arrancan desde la que si alcanzo. Las pausas no se recalculan: sus eventos
+ * son milisegundos, y lo que viene detras ya arranca parado.
+ */
+void GeneradorPasos::reanudar() {
+    if (!retenido) {
+        return;
+    }
+    if (bloque_preparacion == nullptr) {
+        iniciarBloquePreparacion();
+    }
+    if (bloque_preparacion != nullptr && bloque_preparacion->tasa_programada == 0) {
+        rampa_preparacion.tasa = bloque_preparacion->tasa_nominal;
+        rampa_preparacion.desacelerando = false;
+    } else if (bloque_preparacion != nullptr) {
+        uint32_t tasa = recalcularPerfil(*bloque_preparacion, eventos_preparados, TASA_MINIMA_EVENTOS * UNO_Q16);
+        rampa_preparacion.tasa = bloque_preparacion->tasa_inicial;
+        rampa_preparacion.incremento = 0;
+        rampa_preparacion.desacelerando = false;
+
+        uint8_t indice = (indice_preparacion + 1) % TAMANO_COLA_PASOS;
+        while (indice != indice_cabeza && cola[indice].tasa_programada != 0 && tasa < cola[indice].tasa_inicial) {
+            tasa = recalcularPerfil(cola[indice], 0, tasa);
+            indice = (indice + 1) % TAMANO_COLA_PASOS;
+        }
+    }
+    retenido = false;
+}
+
+void GeneradorPasos::limitarSegmentos(uint8_t maximo) {
+    segmentos_adelantados = CONSTRAIN(maximo, (uint8_t)2, (uint8_t)(TAMANO_BUFFER_SEGMENTOS - 1));
+}
+
+bool GeneradorPasos::enRetencion() const {
+    return frenando_retencion || retenido;
+}
+
+bool GeneradorPasos::retencionCompleta() const {
+    return retenido && indice_segmento_cola == indice_segmento_cabeza;
+}
+
+uint32_t GeneradorPasos::obtenerPasosRestantes(uint8_t eje) const {
+    if (eje >= NUM_EJES) {
+        return 0;
+    }
+    uint32_t pasos;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pasos = nucleo.pasosRestantes(eje);
+    }
+    return pasos;
+}
+
+int32_t GeneradorPasos::obtenerPosicion(uint8_t eje) const {
+    if (eje >= NUM_EJES) {
+        return 0;
+    }
+    int32_t pasos;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pasos = nucleo.posicionEje(eje);
+    }
+    return pasos;
+}
+
+void GeneradorPasos::establecerPosicion(uint8_t eje, int32_t pasos) {
+    if (eje >= NUM_EJES) {
+        return;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        nucleo.fijarPosicion(eje, pasos);
+    }
+}
+
+void GeneradorPasos::bloquearEjes(uint8_t mascara) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        nucleo.bloquear(mascara);
+    }
+}
+
+void GeneradorPasos::desbloquearEjes() {
+    nucleo.desbloquear();
+}
+
+/**
+ * @brief Arranca el Timer1 con un primer periodo corto para que la ISR cargue
+ * el segmento de inmediato
+ */
+void GeneradorPasos::iniciarTemporizador() {
+    TCNT1 = 0;
+    OCR1A = INTERVALO_MINIMO_TIMER;
+    TCCR1B = (TCCR1B & ~MASCARA_PRESCALER_TIMER1) | PRESCALER_TIMER1_8;
+    TIMSK1 |= _BV(OCIE1A);
+    temporizador_activo = true;
+}
+
+void GeneradorPasos::detenerTemporizador() {
+    TIMSK1 &= ~_BV(OCIE1A);
+    TCCR1B &= ~MASCARA_PRESCALER_TIMER1;
+    temporizador_activo = false;
+}
+
+void GeneradorPasos::aplicarDireccion() {
+    PinesDireccion::escribir(bloque->direccion);
+}
+
+/**
+ * @brief Los ejes que pasan en el mismo evento suben y bajan con una sola
+ * escritura por puerto
+ */
+void GeneradorPasos::pulsar(uint8_t mascara) {
+    if (mascara == 0) {
+        return;
+    }
+    PinesPaso::activar(mascara);
+    delayMicroseconds(ANCHO_PULSO_PASO_US);
+    PinesPaso::desactivar(mascara);
+}
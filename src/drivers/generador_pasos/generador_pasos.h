@@ -0,0 +1,317 @@
+#ifndef GENERADOR_PASOS_H
+#define GENERADOR_PASOS_H
+
+#include <Arduino.h>
+#include "constantes.h"
+#include "punto_fijo.h"
+#include "nucleo_pasos.h"
+
+/**
+ * @file generador_pasos.h
+ * @brief Generador de pasos coordinado para los tres ejes de la CNC
+ *
+ * @details Sustituye a MultiStepperLite. En lugar de temporizar cada eje por
+ * separado, el eje dominante (el que mas pasos recorre) marca el ritmo de los
+ * eventos de paso y los demas ejes se reparten sobre esos eventos mediante
+ * acumuladores de error tipo Bresenham/DDA. Asi todos los ejes arrancan y
+ * terminan juntos y la herramienta sigue la recta programada.
+ *
+ * Cada bloque trae un perfil trapezoidal (acelerar / crucero / desacelerar)
+ * expresado en eventos. Desde loop(), prepararSegmentos() trocea ese perfil
+ * en segmentos de duracion fija (1 / TICKS_ACELERACION_POR_SEGUNDO) con el
+ * numero de eventos y el periodo del Timer1 ya calculados. La ISR solo copia
+ * el periodo al cargar cada segmento y ejecuta Bresenham: sin flotantes ni
+ * divisiones. En los bloques con curva S el propio incremento de tasa sube y
+ * baja de un segmento a otro, de modo que la aceleracion nunca cambia de golpe.
+ *
+ * A tasas bajas los segmentos usan sobremuestreo adaptativo (AMASS): la ISR
+ * corre 2^nivel veces mas rapido y los acumuladores se escalan igual, asi los
+ * ejes secundarios pueden pasar en medio de dos pasos del dominante en lugar
+ * de quedar alineados a su rejilla.
+ *
+ * La retencion de avance (feed hold) tambien se resuelve al preparar: los
+ * segmentos nuevos frenan con la aceleracion del bloque, aunque crucen de un
+ * bloque al siguiente, y al llegar a la tasa minima se deja de preparar. El
+ * resto del bloque y la cola quedan intactos; al reanudar se recalcula el
+ * perfil de lo que falta partiendo de la tasa minima.
+ */
+
+/**
+ * @struct SegmentoPasos
+ * @brief Tramo corto de un bloque con el periodo del Timer1 ya resuelto
+ */
+struct SegmentoPasos {
+    uint16_t interrupciones;      ///< Interrupciones del segmento (eventos << nivel_amass)
+    uint16_t cuentas_timer;       ///< Valor de OCR1A
+    uint8_t prescaler;            ///< Bits CS1x del Timer1
+    uint8_t nivel_amass;          ///< Nivel de sobremuestreo (0 = sin sobremuestreo)
+    uint16_t ciclo_cortadora;     ///< Ciclo de PWM de la cortadora (escalado con potencia dinamica)
+    bool ultimo_del_bloque;       ///< true si al terminarlo se libera el bloque
+};
+
+/**
+ * @class GeneradorPasos
+ * @brief Motor de pasos multieje con interpolacion Bresenham por interrupcion
+ *
+ * La logica de interpolacion vive en NucleoPasos, que no toca pines, de modo
+ * que la secuencia de pasos puede reproducirse fuera del microcontrolador.
+ *
+ * @note Solo puede existir una instancia: la ISR del Timer1 la localiza a
+ *       traves del puntero estatico instancia.
+ */
+class GeneradorPasos {
+private:
+    BloquePasos cola[TAMANO_COLA_PASOS];        ///< Cola circular de bloques pendientes
+    volatile uint8_t indice_cabeza;             ///< Siguiente posicion libre (escribe loop)
+    volatile uint8_t indice_cola;               ///< Bloque en ejecucion (avanza la ISR)
+
+    SegmentoPasos segmentos[TAMANO_BUFFER_SEGMENTOS]; ///< Segmentos listos para la ISR
+    volatile uint8_t indice_segmento_cabeza;    ///< Siguiente segmento libre (escribe loop)
+    volatile uint8_t indice_segmento_cola;      ///< Segmento en ejecucion (avanza la ISR)
+    uint8_t segmentos_adelantados;              ///< Segmentos que se preparan como mucho por delante de la ISR
+
+    // Estado de la ISR
+    BloquePasos *bloque;                        ///< Bloque en ejecucion dentro de la cola
+    SegmentoPasos *segmento;                    ///< Segmento en ejecucion
+    uint16_t interrupciones_restantes;          ///< Interrupciones que faltan en el segmento
+    NucleoPasos nucleo;                         ///< Acumuladores Bresenham, pasos restantes y posicion
+    volatile bool temporizador_activo;          ///< true mientras el Timer1 esta generando interrupciones
+    volatile bool detenido;                     ///< Parada desde otra ISR pendiente de vaciar con detener()
+
+    // Grabado raster: los pixeles se consumen en el orden de sus bloques
+    uint8_t pixeles[TAMANO_BUFFER_PIXELES];     ///< Potencias (0-255) de los pixeles pendientes
+    volatile uint8_t indice_pixel_cabeza;       ///< Siguiente pixel libre (escribe loop)
+    volatile uint8_t indice_pixel_cola;         ///< Pixel en curso (avanza la ISR)
+    uint8_t pixeles_restantes;                  ///< Pixeles del bloque cargado que faltan por empezar o terminar
+    uint32_t contador_pixel;                    ///< Acumulador Bresenham de los limites entre pixeles
+    uint8_t mascara_dominante;                  ///< Bit del eje que marca los eventos del bloque cargado
+    uint16_t ciclo_segmento;                    ///< Ciclo de la cortadora del segmento en curso, antes del pixel
+
+    // Estado de la preparacion de segmentos (solo loop)
+    uint8_t indice_preparacion;                 ///< Bloque que se esta troceando
+    BloquePasos *bloque_preparacion;            ///< nullptr si hay que empezar un bloque nuevo
+    uint32_t eventos_preparados;                ///< Eventos del bloque ya repartidos en segmentos
+    RampaTasa rampa_preparacion;                ///< Tasa vigente del perfil y estado de su rampa
+    uint32_t resto_eventos;                     ///< Fraccion de evento arrastrada entre segmentos (Q16.16)
+    bool frenando_retencion;                    ///< true mientras se preparan los segmentos de frenado de una retencion
+    bool retenido;                              ///< true cuando la retencion ya llego a la tasa minima
+
+    /**
+     * @brief Escribe los pines de direccion segun el bloque cargado
+     */
+    void aplicarDireccion();
+
+    /**
+     * @brief Genera un pulso en los pines de paso indicados
+     * @param mascara Bit n a 1 para pulsar el eje n
+     */
+    void pulsar(uint8_t mascara);
+
+    /**
+     * @brief Aplica a la cortadora el ciclo del segmento escalado por el pixel en curso
+     */
+    void aplicarPixel();
+
+    /**
+     * @brief Toma el siguiente segmento, programa el Timer1 y, si empieza un
+     * bloque, prepara los acumuladores
+     * @return false si no hay segmentos preparados
+     */
+    bool cargarSiguienteSegmento();
+
+    /**
+     * @brief Trocea el siguiente tramo del bloque en preparacion
+     * @return false si el buffer de segmentos esta lleno o no hay bloques
+     */
+    bool prepararSegmento();
+
+    /**
+     * @brief Ciclo de la cortadora para un segmento del bloque
+     * @param preparando Bloque al que pertenece el segmento
+     * @param tasa_segmento Tasa del segmento (eventos/s, Q16.16)
+     * @return El ciclo del bloque, o escalado por tasa_segmento / tasa_programada
+     *         con potencia dinamica
+     */
+    uint16_t calcularCicloCortadora(const BloquePasos& preparando, uint32_t tasa_segmento) const;
+
+    /**
+     * @brief Empieza a preparar el siguiente bloque de la cola
+     * @return false si no hay bloques sin preparar
+     */
+    bool iniciarBloquePreparacion();
+
+    /**
+     * @brief Recalcula el perfil de lo que falta de un bloque a partir de una tasa dada
+     * @param destino Bloque a modificar (no debe tener segmentos pendientes en la ISR)
+     * @param eventos_hechos Eventos del bloque ya preparados
+     * @param tasa_desde Tasa con la que se retoma (eventos/s, Q16.16)
+     * @return Tasa final alcanzable; menor que la planificada si el bloque es corto
+     */
+    static uint32_t recalcularPerfil(BloquePasos& destino, uint32_t eventos_hechos, uint32_t tasa_desde);
+
+    /**
+     * @brief Habilita la interrupcion de comparacion del Timer1
+     */
+    void iniciarTemporizador();
+
+    /**
+     * @brief Deshabilita la interrupcion y detiene el reloj del Timer1
+     */
+    void detenerTemporizador();
+
+public:
+    static GeneradorPasos *instancia; ///< Instancia atendida por la ISR
+
+    /**
+     * @brief Constructor del generador (cola vacia)
+     */
+    GeneradorPasos();
+
+    /**
+     * @brief Configura los pines de paso y el Timer1 en modo CTC (detenido)
+     */
+    void inicializar();
+
+    /**
+     * @brief Agrega un bloque al final de la cola
+     * @param nuevo_bloque Bloque a ejecutar
+     * @return false si la cola esta llena o el bloque no contiene pasos
+     *
+     * @note Los pasos empiezan cuando prepararSegmentos() lo trocea.
+     */
+    bool encolarBloque(const BloquePasos& nuevo_bloque);
+
+    /**
+     * @brief Llena el buffer de segmentos y arranca el Timer1 si estaba parado
+     * @note Llamar en cada pasada del loop(); si el buffer se vacia antes de
+     *       terminar un bloque la maquina se detiene hasta la siguiente llamada.
+     */
+    void prepararSegmentos();
+
+    /**
+     * @brief Indica si queda espacio en la cola
+     */
+    bool hayEspacioEnCola() const;
+
+    /**
+     * @brief Numero de bloques en cola, incluido el que se esta ejecutando
+     */
+    uint8_t bloquesPendientes() const;
+
+    /**
+     * @brief Guarda los pixeles de una linea de grabado
+     * @param potencias Potencia de cada pixel (0-255, fraccion del S programado)
+     * @param cantidad Numero de pixeles
+     * @return false si no caben; no se guarda ninguno
+     *
+     * @note Se llama al planificar el bloque: el orden de los pixeles debe ser
+     *       el de los bloques que los recorren.
+     */
+    bool encolarPixeles(const uint8_t *potencias, uint8_t cantidad);
+
+    /**
+     * @brief Pixeles que aun caben en el buffer de grabado
+     */
+    uint8_t espacioPixeles() const;
+
+    /**
+     * @brief Rutina de servicio del Timer1: genera un evento de paso
+     * @note Solo debe llamarse desde ISR(TIMER1_COMPA_vect)
+     */
+    void atenderInterrupcion();
+
+    /**
+     * @brief Indica si el generador tiene bloques en curso o pendientes
+     */
+    bool enMovimiento() const;
+
+    /**
+     * @brief Detiene inmediatamente la generacion de pasos y vacia la cola
+     * @note Solo desde el loop(); desde otra ISR usar detenerDesdeInterrupcion()
+     */
+    void detener();
+
+    /**
+     * @brief Parada brusca desde la ISR de un final de carrera o de la sonda
+     *
+     * Solo para el Timer1 y apaga la cortadora: las colas pueden estar a medio
+     * escribir por el loop(), asi que se quedan como estan hasta que este
+     * llame a detener(). Hasta entonces no se preparan segmentos ni vuelve a
+     * arrancar el temporizador.
+     */
+    void detenerDesdeInterrupcion();
+
+    /**
+     * @brief Indica si hay una parada de detenerDesdeInterrupcion() sin vaciar
+     */
+    bool estaDetenido() const;
+
+    /**
+     * @brief Inicia una retencion de avance: frena hasta la tasa minima y se detiene
+     * @note Los segmentos ya preparados (como mucho los de limitarSegmentos())
+     *       se ejecutan antes de que empiece el frenado.
+     */
+    void retener();
+
+    /**
+     * @brief Reanuda tras una retencion con una rampa de aceleracion
+     * @note Si la retencion todavia esta frenando no hace nada.
+     */
+    void reanudar();
+
+    /**
+     * @brief Limita los segmentos preparados por delante de la ISR
+     * @param maximo Entre 2 y TAMANO_BUFFER_SEGMENTOS - 1 (valor por defecto)
+     *
+     * Menos segmentos adelantan el frenado de una retencion a costa de que el
+     * loop() tenga menos margen antes de dejar a la ISR sin segmentos.
+     */
+    void limitarSegmentos(uint8_t maximo);
+
+    /**
+     * @brief Indica si hay una retencion pedida (frenando o ya detenida)
+     */
+    bool enRetencion() const;
+
+    /**
+     * @brief Indica si la retencion termino y los motores estan parados
+     */
+    bool retencionCompleta() const;
+
+    /**
+     * @brief Pasos que faltan en un eje del bloque actual
+     * @param eje Eje consultado
+     */
+    uint32_t obtenerPasosRestantes(uint8_t eje) const;
+
+    /**
+     * @brief Posicion real de un eje: cuenta los pasos emitidos con su signo
+     * @param eje Eje consultado
+     * @return Posicion de maquina en pasos
+     */
+    int32_t obtenerPosicion(uint8_t eje) const;
+
+    /**
+     * @brief Fija la posicion de maquina de un eje (calibracion)
+     * @param eje Eje a modificar
+     * @param pasos Nueva posicion en pasos
+     * @note Solo con el eje detenido
+     */
+    void establecerPosicion(uint8_t eje, int32_t pasos);
+
+    /**
+     * @brief Deja de emitir pasos en los ejes indicados sin parar el resto
+     * @param mascara Bit n a 1 para bloquear el eje n
+     *
+     * Los pasos bloqueados no cuentan en la posicion, que queda fijada en el
+     * instante del bloqueo. Se puede llamar desde otra ISR.
+     */
+    void bloquearEjes(uint8_t mascara);
+
+    /**
+     * @brief Vuelve a emitir pasos en todos los ejes
+     */
+    void desbloquearEjes();
+};
+
+#endif // GENERADOR_PASOS_H
@@ -0,0 +1,205 @@
+#include "mapa_alturas.h"
+#include "configuracion_maquina.h"
+#include <EEPROM.h>
+
+/**
+ * @brief Formato de la malla en EEPROM
+ */
+struct RegistroMalla {
+    uint16_t marca;                    ///< MARCA_EEPROM_MALLA si el registro es valido
+    uint8_t puntos_x;
+    uint8_t puntos_y;
+    float origen_mm[2];
+    float celda_mm[2];
+    int16_t alturas[MAXIMO_PUNTOS_MALLA * MAXIMO_PUNTOS_MALLA];
+};
+
+/**
+ * @brief Margen para no volver a cortar en la linea sobre la que ya se esta
+ */
+static const float MARGEN_LINEA_MM = 0.001f;
+
+MapaAlturas::MapaAlturas():
+    puntos_x(0),
+    puntos_y(0),
+    origen_mm{0.0f, 0.0f},
+    celda_mm{0.0f, 0.0f},
+    origen_pasos{0, 0},
+    celda_pasos{0, 0},
+    valido(false)
+{
+}
+
+void MapaAlturas::calcularPasos() {
+    for (uint8_t i = 0; i < 2; i++) {
+        origen_pasos[i] = lroundf(origen_mm[i] * ConfiguracionMaquina::pasosPorMm(i));
+        celda_pasos[i] = lroundf(celda_mm[i] * ConfiguracionMaquina::pasosPorMm(i));
+    }
+}
+
+bool MapaAlturas::preparar(const float *origen, const float *tamano, uint8_t puntos) {
+    if (puntos < 2 || puntos > MAXIMO_PUNTOS_MALLA || tamano[0] <= 0.0f || tamano[1] <= 0.0f) {
+        return false;
+    }
+    valido = false;
+    puntos_x = puntos;
+    puntos_y = puntos;
+    for (uint8_t i = 0; i < 2; i++) {
+        origen_mm[i] = origen[i];
+        celda_mm[i] = tamano[i] / (puntos - 1);
+    }
+    calcularPasos();
+    if (celda_pasos[0] == 0 || celda_pasos[1] == 0) {
+        return false;
+    }
+    return true;
+}
+
+uint8_t MapaAlturas::totalPuntos() const {
+    return puntos_x * puntos_y;
+}
+
+void MapaAlturas::coordenadasPunto(uint8_t indice, float *xy_mm) const {
+    uint8_t fila = indice / puntos_x;
+    uint8_t columna = indice % puntos_x;
+    if (fila & 1) {
+        columna = puntos_x - 1 - columna; // Zigzag
+    }
+    xy_mm[0] = origen_mm[0] + columna * celda_mm[0];
+    xy_mm[1] = origen_mm[1] + fila * celda_mm[1];
+}
+
+void MapaAlturas::registrarAltura(uint8_t indice, int32_t z_pasos) {
+    uint8_t fila = indice / puntos_x;
+    uint8_t columna = indice % puntos_x;
+    if (fila & 1) {
+        columna = puntos_x - 1 - columna;
+    }
+    alturas[fila * puntos_x + columna] = static_cast<int16_t>(z_pasos);
+}
+
+/**
+ * @brief El primer nodo medido es el (0, 0); queda como referencia de altura
+ * cero, asi el programa de fresado usa el Z que tenia la pieza en ese punto.
+ */
+void MapaAlturas::completar() {
+    int16_t referencia = alturas[0];
+    for (uint8_t i = 0; i < totalPuntos(); i++) {
+        alturas[i] -= referencia;
+    }
+    valido = true;
+
+    RegistroMalla registro;
+    registro.marca = MARCA_EEPROM_MALLA;
+    registro.puntos_x = puntos_x;
+    registro.puntos_y = puntos_y;
+    for (uint8_t i = 0; i < 2; i++) {
+        registro.origen_mm[i] = origen_mm[i];
+        registro.celda_mm[i] = celda_mm[i];
+    }
+    memcpy(registro.alturas, alturas, sizeof(alturas));
+    // put() solo reescribe los bytes que cambian
+    EEPROM.put(DIRECCION_EEPROM_MALLA, registro);
+
+#if MODO_DESARROLLADOR
+    Serial.print(F("[MapaAlturas::completar] Malla de "));
+    Serial.print(puntos_x); Serial.print(F("x")); Serial.println(puntos_y);
+    for (uint8_t fila = 0; fila < puntos_y; fila++) {
+        for (uint8_t columna = 0; columna < puntos_x; columna++) {
+            Serial.print(alturas[fila * puntos_x + columna]); Serial.print(F(" "));
+        }
+        Serial.println();
+    }
+#endif
+}
+
+bool MapaAlturas::esValido() const {
+    return valido;
+}
+
+int32_t MapaAlturas::localizar(int32_t desplazamiento, uint8_t eje, uint8_t &indice) const {
+    uint8_t ultimo = ((eje == 0) ? puntos_x : puntos_y) - 1;
+    int32_t celda = celda_pasos[eje];
+    if (desplazamiento <= 0) {
+        indice = 0;
+        return 0;
+    }
+    if (desplazamiento >= celda * ultimo) {
+        indice = ultimo - 1;
+        return 256;
+    }
+    indice = desplazamiento / celda;
+    return ((desplazamiento - indice * celda) << 8) / celda;
+}
+
+/**
+ * @brief Dos interpolaciones en X (filas inferior y superior de la celda) y
+ * una en Y entre ambas, con fracciones Q8: el resultado queda en Q16 y se
+ * redondea al paso.
+ */
+int32_t MapaAlturas::correccion(int32_t x_pasos, int32_t y_pasos) const {
+    if (!valido) {
+        return 0;
+    }
+    uint8_t columna, fila;
+    int32_t fx = localizar(x_pasos - origen_pasos[0], 0, columna);
+    int32_t fy = localizar(y_pasos - origen_pasos[1], 1, fila);
+
+    const int16_t *inferior = &alturas[fila * puntos_x + columna];
+    const int16_t *superior = inferior + puntos_x;
+    int32_t abajo = ((int32_t)inferior[0] << 8) + (inferior[1] - inferior[0]) * fx;
+    int32_t arriba = ((int32_t)superior[0] << 8) + (superior[1] - superior[0]) * fx;
+    int32_t resultado = (abajo << 8) + (arriba - abajo) * fy;
+    return (resultado + 0x8000) >> 16;
+}
+
+bool MapaAlturas::siguienteLinea(uint8_t eje, float posicion_mm, bool positivo, float &linea_mm) const {
+    uint8_t ultimo = ((eje == 0) ? puntos_x : puntos_y) - 1;
+    float relativo = (posicion_mm - origen_mm[eje]) / celda_mm[eje];
+    int16_t linea;
+    if (positivo) {
+        linea = static_cast<int16_t>(floor(relativo + MARGEN_LINEA_MM / celda_mm[eje])) + 1;
+        if (linea < 0) {
+            linea = 0;
+        }
+        if (linea > ultimo) {
+            return false;
+        }
+    } else {
+        linea = static_cast<int16_t>(ceil(relativo - MARGEN_LINEA_MM / celda_mm[eje])) - 1;
+        if (linea > ultimo) {
+            linea = ultimo;
+        }
+        if (linea < 0) {
+            return false;
+        }
+    }
+    linea_mm = origen_mm[eje] + linea * celda_mm[eje];
+    return true;
+}
+
+void MapaAlturas::borrar() {
+    valido = false;
+    // Basta con invalidar la marca
+    EEPROM.put(DIRECCION_EEPROM_MALLA, static_cast<uint16_t>(0));
+}
+
+bool MapaAlturas::cargar() {
+    RegistroMalla registro;
+    EEPROM.get(DIRECCION_EEPROM_MALLA, registro);
+    valido = false;
+    if (registro.marca != MARCA_EEPROM_MALLA || registro.puntos_x < 2 || registro.puntos_y < 2 ||
+        registro.puntos_x > MAXIMO_PUNTOS_MALLA || registro.puntos_y > MAXIMO_PUNTOS_MALLA) {
+        return false;
+    }
+    puntos_x = registro.puntos_x;
+    puntos_y = registro.puntos_y;
+    for (uint8_t i = 0; i < 2; i++) {
+        origen_mm[i] = registro.origen_mm[i];
+        celda_mm[i] = registro.celda_mm[i];
+    }
+    memcpy(alturas, registro.alturas, sizeof(alturas));
+    calcularPasos();
+    valido = celda_pasos[0] != 0 && celda_pasos[1] != 0;
+    return valido;
+}
@@ -0,0 +1,126 @@
+#ifndef MAPA_ALTURAS_H
+#define MAPA_ALTURAS_H
+
+#include <Arduino.h>
+#include "constantes.h"
+
+/**
+ * @file mapa_alturas.h
+ * @brief Malla de alturas medida con la sonda para compensar Z (fresado de PCB)
+ *
+ * @details La malla es una rejilla regular en XY, en coordenadas de maquina,
+ * con la altura de cada nodo en pasos de Z relativa al primer punto medido.
+ * La correccion de un punto es la interpolacion bilineal de su celda y se
+ * calcula solo con enteros; el ControladorCNC la evalua en los extremos de
+ * cada tramo, nunca por paso.
+ *
+ * Los puntos se miden en zigzag (filas alternas en sentido contrario) para
+ * no volver al principio de cada fila.
+ */
+
+/**
+ * @class MapaAlturas
+ * @brief Rejilla de alturas con persistencia en EEPROM
+ */
+class MapaAlturas {
+private:
+    uint8_t puntos_x;                  ///< Nodos en X
+    uint8_t puntos_y;                  ///< Nodos en Y
+    float origen_mm[2];                ///< Nodo (0, 0) en coordenadas de maquina
+    float celda_mm[2];                 ///< Separacion entre nodos en X e Y
+    int32_t origen_pasos[2];           ///< origen_mm en pasos
+    int32_t celda_pasos[2];            ///< celda_mm en pasos
+    int16_t alturas[MAXIMO_PUNTOS_MALLA * MAXIMO_PUNTOS_MALLA]; ///< Altura de cada nodo (pasos de Z), fila a fila
+    bool valido;                       ///< La malla esta completa y se puede aplicar
+
+    /**
+     * @brief Pasa de mm a pasos las medidas de la rejilla con la configuracion vigente
+     */
+    void calcularPasos();
+
+    /**
+     * @brief Celda y fraccion de una coordenada a lo largo de un eje
+     * @param desplazamiento Distancia al origen en pasos
+     * @param eje 0 = X, 1 = Y
+     * @param indice Nodo inferior de la celda
+     * @return Fraccion dentro de la celda en Q8 (0 a 256)
+     *
+     * Fuera de la rejilla se toma el borde: la correccion queda constante.
+     */
+    int32_t localizar(int32_t desplazamiento, uint8_t eje, uint8_t &indice) const;
+
+public:
+    /**
+     * @brief Constructor (malla vacia, no valida)
+     */
+    MapaAlturas();
+
+    /**
+     * @brief Empieza una malla nueva; deja de ser valida hasta completar()
+     * @param origen Esquina de la rejilla en coordenadas de maquina (X, Y)
+     * @param tamano Ancho y alto de la rejilla (mm, positivos)
+     * @param puntos Nodos por lado (2 a MAXIMO_PUNTOS_MALLA)
+     * @return false si los parametros no son validos
+     */
+    bool preparar(const float *origen, const float *tamano, uint8_t puntos);
+
+    /**
+     * @brief Numero de nodos a medir
+     */
+    uint8_t totalPuntos() const;
+
+    /**
+     * @brief Coordenadas del nodo n-esimo en el orden de medida
+     * @param indice Orden de medida (0 a totalPuntos() - 1)
+     * @param xy_mm Salida: X e Y del nodo en coordenadas de maquina
+     */
+    void coordenadasPunto(uint8_t indice, float *xy_mm) const;
+
+    /**
+     * @brief Guarda la medida de un nodo
+     * @param indice Orden de medida
+     * @param z_pasos Posicion de Z en el contacto
+     */
+    void registrarAltura(uint8_t indice, int32_t z_pasos);
+
+    /**
+     * @brief Deja las alturas relativas al primer nodo, valida la malla y la guarda en EEPROM
+     */
+    void completar();
+
+    /**
+     * @brief Indica si la malla se puede aplicar
+     */
+    bool esValido() const;
+
+    /**
+     * @brief Correccion de Z en un punto
+     * @param x_pasos X en pasos de maquina
+     * @param y_pasos Y en pasos de maquina
+     * @return Pasos de Z a sumar (0 si la malla no es valida)
+     */
+    int32_t correccion(int32_t x_pasos, int32_t y_pasos) const;
+
+    /**
+     * @brief Siguiente linea de la rejilla que cruza un movimiento
+     * @param eje 0 = X, 1 = Y
+     * @param posicion_mm Coordenada actual en ese eje
+     * @param positivo Sentido del movimiento
+     * @param linea_mm Salida: coordenada de la linea
+     * @return false si no quedan lineas en ese sentido
+     */
+    bool siguienteLinea(uint8_t eje, float posicion_mm, bool positivo, float &linea_mm) const;
+
+    /**
+     * @brief Deja de aplicar la malla y la borra de EEPROM
+     */
+    void borrar();
+    
+    /**
+     * @brief Recupera la malla guardada en EEPROM
+     * @return false si no hay una malla valida guardada
+     */
+    bool cargar();
+};
+
+#endif // MAPA_ALTURAS_H
@@ -0,0 +1,264 @@
+#include "nucleo_pasos.h"
+
+#include <math.h>
+
+NucleoPasos::NucleoPasos():
+    eventos_escalados(0),
+    pasos_nivel{0, 0, 0},
+    contador_error{0, 0, 0},
+    pasos_restantes{0, 0, 0},
+    sentido{1, 1, 1},
+    posicion{0, 0, 0},
+    ejes_bloqueados(0)
+{
+}
+
+/**
+ * @brief Los acumuladores arrancan en -eventos/2 para que los pasos de los
+ * ejes secundarios queden centrados dentro de cada intervalo del eje dominante.
+ */
+void NucleoPasos::iniciarBloque(const uint32_t pasos[NUM_EJES], uint32_t eventos,
+                                uint8_t direccion, bool compensacion) {
+    eventos_escalados = eventos << NIVEL_MAXIMO_AMASS;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        contador_error[i] = -static_cast<int32_t>(eventos_escalados >> 1);
+        pasos_restantes[i] = pasos[i];
+        // La holgura se recoge sin mover la posicion; asi la ISR no necesita distinguirlo
+        sentido[i] = compensacion ? 0 : (direccion & (1 << i)) ? -1 : 1;
+    }
+}
+
+void NucleoPasos::ajustarNivel(const uint32_t pasos[NUM_EJES], uint8_t nivel_amass) {
+    uint8_t desplazamiento = NIVEL_MAXIMO_AMASS - nivel_amass;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        pasos_nivel[i] = pasos[i] << desplazamiento;
+    }
+}
+
+uint8_t NucleoPasos::calcularEvento() {
+    uint8_t mascara = 0;
+    uint8_t bloqueados = ejes_bloqueados;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        contador_error[i] += pasos_nivel[i];
+        if (contador_error[i] > 0) {
+            contador_error[i] -= eventos_escalados;
+            pasos_restantes[i]--;
+            if (!(bloqueados & (1 << i))) {
+                posicion[i] += sentido[i];
+                mascara |= (1 << i);
+            }
+        }
+    }
+    return mascara;
+}
+
+void NucleoPasos::vaciar() {
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        pasos_restantes[i] = 0;
+    }
+}
+
+uint32_t NucleoPasos::incrementoTick(const BloquePasos &bloque, RampaTasa &rampa, uint32_t falta) {
+    if (bloque.incremento_aceleracion == 0) {
+        return bloque.incremento_tasa; // Perfil trapezoidal
+    }
+    rampa.incremento = siguienteIncrementoCurvaS(rampa.incremento, falta,
+                                                 bloque.incremento_tasa, bloque.incremento_aceleracion);
+    return rampa.incremento;
+}
+
+uint32_t NucleoPasos::tasaTick(const BloquePasos &bloque, uint32_t eventos_hechos,
+                               RampaTasa &rampa, uint32_t &limite_fase) {
+    if (eventos_hechos < bloque.acelerar_hasta) {
+        uint32_t tasa_tick = rampa.tasa;
+        limite_fase = bloque.acelerar_hasta;
+        if (rampa.tasa < bloque.tasa_nominal) {
+            rampa.tasa += incrementoTick(bloque, rampa, bloque.tasa_nominal - rampa.tasa);
+            if (rampa.tasa > bloque.tasa_nominal) {
+                rampa.tasa = bloque.tasa_nominal;
+            }
+        }
+        return tasa_tick;
+    }
+    if (eventos_hechos >= bloque.desacelerar_desde) {
+        if (!rampa.desacelerando) {
+            // La rampa de bajada arranca siempre con aceleracion nula
+            rampa.desacelerando = true;
+            rampa.incremento = 0;
+        }
+        if (rampa.tasa > bloque.tasa_final) {
+            uint32_t incremento = incrementoTick(bloque, rampa, rampa.tasa - bloque.tasa_final);
+            if (rampa.tasa > bloque.tasa_final + incremento) {
+                rampa.tasa -= incremento;
+            } else {
+                rampa.tasa = bloque.tasa_final;
+            }
+        }
+        limite_fase = bloque.eventos;
+        return rampa.tasa;
+    }
+    rampa.tasa = bloque.tasa_nominal;
+    rampa.incremento = 0;
+    limite_fase = bloque.desacelerar_desde;
+    return rampa.tasa;
+}
+
+/**
+ * @brief La subida cambia la tasa al final de cada tick (el primero se
+ * recorre a la tasa inicial) y la bajada al principio, igual que en
+ * tasaTick().
+ *
+ * La bajada hereda la fraccion de evento que arrastraba la fase anterior, de
+ * hasta un evento, y su ultimo tick es el que va a tasa_hasta. Se cuenta con
+ * la fraccion maxima y se reserva ese ultimo evento; si no, el bloque podia
+ * acabarse un tick antes de llegar a la tasa final.
+ */
+uint32_t NucleoPasos::eventosRampa(uint32_t tasa_desde, uint32_t tasa_hasta,
+                                   uint32_t incremento_maximo, uint32_t sobreaceleracion) {
+    if (tasa_desde == tasa_hasta) {
+        return 0;
+    }
+    bool subida = tasa_hasta > tasa_desde;
+    uint32_t tasa = tasa_desde;
+    uint32_t incremento = 0;
+    uint32_t eventos = 0;
+    uint32_t fraccion = subida ? tasa_desde / TICKS_ACELERACION_POR_SEGUNDO : UNO_Q16 - 1;
+
+    while (tasa != tasa_hasta) {
+        uint32_t falta = subida ? tasa_hasta - tasa : tasa - tasa_hasta;
+        incremento = (sobreaceleracion == 0) ? incremento_maximo :
+                     siguienteIncrementoCurvaS(incremento, falta, incremento_maximo, sobreaceleracion);
+        if (falta <= incremento) {
+            tasa = tasa_hasta;
+        } else {
+            tasa = subida ? tasa + incremento : tasa - incremento;
+            fraccion += tasa / TICKS_ACELERACION_POR_SEGUNDO;
+        }
+        eventos += enteroQ16(fraccion);
+        fraccion &= (UNO_Q16 - 1);
+    }
+    if (!subida) {
+        return eventos + 1;
+    }
+    return eventos + (fraccion > 0 ? 1 : 0);
+}
+
+/**
+ * @brief Con aceleracion a y sobreaceleracion j (por tick) un cambio de tasa
+ * dv dura dv/a + a/j ticks si llega a la aceleracion maxima (dv >= a^2/j) y
+ * 2*sqrt(dv/j) si no; la tasa media de una rampa simetrica es la media de sus
+ * extremos.
+ */
+uint32_t NucleoPasos::eventosRampaEstimados(uint32_t tasa_desde, uint32_t tasa_hasta,
+                                            uint32_t incremento_maximo, uint32_t sobreaceleracion) {
+    if (tasa_desde == tasa_hasta) {
+        return 0;
+    }
+    float cambio = static_cast<float>(tasa_hasta > tasa_desde ? tasa_hasta - tasa_desde : tasa_desde - tasa_hasta);
+    float incremento = static_cast<float>(incremento_maximo);
+    float ticks;
+    if (sobreaceleracion == 0) {
+        ticks = ceil(cambio / incremento);
+    } else if (cambio * sobreaceleracion >= incremento * incremento) {
+        ticks = cambio / incremento + incremento / sobreaceleracion;
+    } else {
+        ticks = 2.0f * sqrt(cambio / sobreaceleracion);
+    }
+    float media = 0.5f * (static_cast<float>(tasa_desde) + static_cast<float>(tasa_hasta));
+    return static_cast<uint32_t>(ticks * media / (static_cast<float>(TICKS_ACELERACION_POR_SEGUNDO) * UNO_Q16)) + 1;
+}
+
+/**
+ * @brief Biseccion de picoRampas() sobre la estimacion en forma cerrada
+ */
+static uint32_t picoEstimado(uint32_t tasa_desde, uint32_t tasa_hasta, bool con_bajada,
+                             uint32_t minima, uint32_t maxima, uint32_t eventos,
+                             uint32_t incremento_maximo, uint32_t sobreaceleracion) {
+    while (maxima - minima > UNO_Q16) {
+        uint32_t medio = minima + (maxima - minima) / 2;
+        uint32_t estimados = NucleoPasos::eventosRampaEstimados(tasa_desde, medio, incremento_maximo, sobreaceleracion);
+        if (con_bajada) {
+            estimados += NucleoPasos::eventosRampaEstimados(medio, tasa_hasta, incremento_maximo, sobreaceleracion);
+        }
+        if (estimados > eventos) {
+            maxima = medio;
+        } else {
+            minima = medio;
+        }
+    }
+    return minima;
+}
+
+/**
+ * @brief La biseccion solo evalua la forma cerrada, y cada intento corrige su
+ * objetivo con lo que dieron las rampas exactas del anterior: si no cabian se
+ * baja lo que sobraba mas un tick por rampa; si cabian lejos del limite se
+ * escala con la razon entre los eventos pedidos y los exactos. Los intentos
+ * acotan el pico entre el mayor que cabe y el menor que no, y si la
+ * estimacion cae fuera de ese intervalo se toma su punto medio.
+ */
+uint32_t NucleoPasos::picoRampas(uint32_t tasa_desde, uint32_t tasa_hasta, bool con_bajada,
+                                 uint32_t segura, uint32_t maxima, uint32_t eventos,
+                                 uint32_t incremento_maximo, uint32_t sobreaceleracion,
+                                 uint32_t &subida, uint32_t &bajada) {
+    uint32_t cabe = segura;     // Mayor pico que cabe (segura se da por buena)
+    uint32_t no_cabe = maxima;  // Menor pico que no cabe
+    bool comprobado = false;    // subida y bajada ya son las de cabe
+    uint32_t objetivo = eventos;
+    for (uint8_t intento = 0; intento <= CORRECCIONES_MAXIMAS_PICO && no_cabe - cabe > UNO_Q16; intento++) {
+        uint32_t candidato = picoEstimado(tasa_desde, tasa_hasta, con_bajada, cabe, no_cabe, objetivo,
+                                          incremento_maximo, sobreaceleracion);
+        if (candidato == cabe) {
+            candidato = cabe + (no_cabe - cabe) / 2;
+        }
+        uint32_t subida_candidato = eventosRampa(tasa_desde, candidato, incremento_maximo, sobreaceleracion);
+        uint32_t bajada_candidato = con_bajada ?
+            eventosRampa(candidato, tasa_hasta, incremento_maximo, sobreaceleracion) : 0;
+        uint32_t exactos = subida_candidato + bajada_candidato;
+        if (exactos <= eventos) {
+            cabe = candidato;
+            subida = subida_candidato;
+            bajada = bajada_candidato;
+            comprobado = true;
+            if (exactos == 0 || eventos - exactos <= eventos / 64) {
+                break; // A menos de un 1.5 % de los eventos disponibles
+            }
+            objetivo = static_cast<uint32_t>(static_cast<uint64_t>(objetivo) * eventos / exactos);
+        } else {
+            // Los eventos exactos saltan de tick en tick: se baja al menos un
+            // tick de cada rampa a la tasa del pico
+            no_cabe = candidato;
+            uint32_t tick = enteroQ16(candidato) / TICKS_ACELERACION_POR_SEGUNDO + 1;
+            uint32_t bajar = exactos - eventos + (con_bajada ? 2 * tick : tick);
+            objetivo = (objetivo > bajar) ? objetivo - bajar : 0;
+        }
+    }
+    if (!comprobado) {
+        subida = eventosRampa(tasa_desde, cabe, incremento_maximo, sobreaceleracion);
+        bajada = con_bajada ? eventosRampa(cabe, tasa_hasta, incremento_maximo, sobreaceleracion) : 0;
+    }
+    return cabe;
+}
+
+/**
+ * @brief Bajando el incremento de a en a-j, a-2j, ..., j se ganan unos
+ * a(a+j)/(2j) eventos/s; en cuanto eso alcanza para llegar al objetivo se
+ * empieza a bajar. Solo multiplica (en 64 bits, los productos de Q16.16 son
+ * Q32.32), y solo una vez por segmento.
+ */
+uint32_t NucleoPasos::siguienteIncrementoCurvaS(uint32_t incremento, uint32_t falta,
+                                                uint32_t incremento_maximo, uint32_t sobreaceleracion) {
+    if (2 * static_cast<uint64_t>(falta) * sobreaceleracion <=
+        static_cast<uint64_t>(incremento) * (incremento + sobreaceleracion)) {
+        // Fase de bajada de la aceleracion; nunca a cero para no quedarse sin llegar
+        return (incremento > sobreaceleracion) ? incremento - sobreaceleracion : sobreaceleracion;
+    }
+    if (incremento < incremento_maximo) {
+        // Fase de subida de la aceleracion
+        incremento += sobreaceleracion;
+        if (incremento > incremento_maximo) {
+            incremento = incremento_maximo;
+        }
+    }
+    return incremento;
+}
@@ -0,0 +1,235 @@
+#ifndef NUCLEO_PASOS_H
+#define NUCLEO_PASOS_H
+
+#include <stdint.h>
+#include "constantes.h"
+#include "punto_fijo.h"
+
+/**
+ * @file nucleo_pasos.h
+ * @brief Interpolacion Bresenham/DDA y rampas de tasa, sin hardware
+ *
+ * @details Es la parte de GeneradorPasos que decide que ejes pasan en cada
+ * interrupcion y como cambia la tasa de un tick al siguiente. No incluye Arduino.h ni toca registros, de modo que se
+ * compila tambien en el entorno native de PlatformIO y la secuencia de pasos
+ * se comprueba con pio test -e native. GeneradorPasos se encarga de los
+ * pines, el Timer1 y de leer estos contadores de forma atomica.
+ */
+
+enum Motor: uint8_t{
+    EJE_X,
+    EJE_Y,
+    EJE_Z,
+    NUM_EJES
+};
+
+/**
+ * @struct BloquePasos
+ * @brief Movimiento lineal ya traducido a pasos, con su perfil trapezoidal
+ *
+ * Las tasas se expresan en eventos (pasos del eje dominante) por segundo, en
+ * Q16.16 para que las rampas no acumulen el error de redondear el incremento.
+ */
+struct BloquePasos {
+    uint32_t pasos[NUM_EJES];     ///< Pasos absolutos a recorrer en cada eje
+    uint32_t eventos;             ///< Pasos del eje dominante (maximo de pasos[])
+    uint32_t tasa_inicial;        ///< Tasa al entrar al bloque (eventos/s, Q16.16)
+    uint32_t tasa_nominal;        ///< Tasa de crucero (eventos/s, Q16.16)
+    uint32_t tasa_final;          ///< Tasa al salir del bloque (eventos/s, Q16.16)
+    uint32_t incremento_tasa;     ///< Cambio de tasa por tick de aceleracion (eventos/s, Q16.16)
+    uint32_t incremento_aceleracion; ///< Cambio de incremento_tasa por tick en curva S (Q16.16, 0 = trapecio)
+    uint32_t acelerar_hasta;      ///< Evento en el que termina la rampa de subida
+    uint32_t desacelerar_desde;   ///< Evento en el que empieza la rampa de bajada
+    uint8_t direccion;            ///< Bit n a 1 si el eje n se mueve en sentido negativo
+    bool compensacion;            ///< Compensacion de holgura: los pasos no cuentan en la posicion
+    uint16_t ciclo_cortadora;     ///< Ciclo de PWM de la cortadora durante el bloque (cuentas de OCR5A)
+    uint8_t estado_cortadora;     ///< Bits CORTADORA_* durante el bloque
+    uint32_t tasa_programada;     ///< Tasa del F programado, sin ajustes (eventos/s, Q16.16, 0 en pausas)
+    uint8_t pixeles;              ///< Pixeles de grabado repartidos a lo largo del bloque (0 = sin grabado)
+
+    BloquePasos() : pasos{0, 0, 0}, eventos(0), tasa_inicial(0), tasa_nominal(0),
+                    tasa_final(0), incremento_tasa(0), incremento_aceleracion(0), acelerar_hasta(0),
+                    desacelerar_desde(0), direccion(0), compensacion(false),
+                    ciclo_cortadora(0), estado_cortadora(0), tasa_programada(0), pixeles(0) {}
+};
+
+/**
+ * @struct RampaTasa
+ * @brief Tasa de un bloque entre un tick de preparacion y el siguiente
+ */
+struct RampaTasa {
+    uint32_t tasa;                ///< Tasa vigente del perfil (eventos/s, Q16.16)
+    uint32_t incremento;          ///< Incremento de tasa del ultimo tick en curva S (Q16.16)
+    bool desacelerando;           ///< true desde que empezo la rampa de bajada del bloque
+
+    RampaTasa() : tasa(0), incremento(0), desacelerando(false) {}
+};
+
+
+/**
+ * @class NucleoPasos
+ * @brief Acumuladores Bresenham de un bloque y posicion segun los pasos emitidos
+ *
+ * Los acumuladores trabajan con eventos << NIVEL_MAXIMO_AMASS y los pasos se
+ * desplazan segun el nivel del segmento: con nivel n el eje dominante pasa
+ * una de cada 2^n interrupciones.
+ */
+class NucleoPasos {
+private:
+    uint32_t eventos_escalados;                 ///< Eventos del bloque << NIVEL_MAXIMO_AMASS
+    uint32_t pasos_nivel[NUM_EJES];             ///< Pasos por eje escalados al nivel del segmento
+    int32_t contador_error[NUM_EJES];           ///< Acumuladores Bresenham por eje
+    volatile uint32_t pasos_restantes[NUM_EJES];///< Pasos que faltan en cada eje
+    int8_t sentido[NUM_EJES];                   ///< +1 o -1 segun la direccion del bloque cargado (0 en compensacion)
+    volatile int32_t posicion[NUM_EJES];        ///< Posicion de maquina segun los pasos ya emitidos
+    volatile uint8_t ejes_bloqueados;           ///< Bit n a 1: el eje n no emite pasos (final de carrera)
+
+public:
+    /**
+     * @brief Constructor (sin bloque cargado, posicion 0)
+     */
+    NucleoPasos();
+
+    /**
+     * @brief Prepara los acumuladores para un bloque nuevo
+     * @param pasos Pasos absolutos de cada eje
+     * @param eventos Pasos del eje dominante (maximo de pasos[])
+     * @param direccion Bit n a 1 si el eje n se mueve en sentido negativo
+     * @param compensacion true si los pasos no deben contar en la posicion
+     */
+    void iniciarBloque(const uint32_t pasos[NUM_EJES], uint32_t eventos,
+                       uint8_t direccion, bool compensacion);
+
+    /**
+     * @brief Escala los pasos del bloque al nivel AMASS de un segmento
+     * @param pasos Pasos absolutos de cada eje (los del bloque cargado)
+     * @param nivel_amass Nivel de sobremuestreo (0 a NIVEL_MAXIMO_AMASS)
+     */
+    void ajustarNivel(const uint32_t pasos[NUM_EJES], uint8_t nivel_amass);
+
+    /**
+     * @brief Avanza una interrupcion del segmento en curso
+     * @return Mascara con los ejes que deben dar un paso en esta interrupcion
+     */
+    uint8_t calcularEvento();
+
+    /**
+     * @brief Descarta los pasos que faltaban del bloque cargado
+     */
+    void vaciar();
+
+    /**
+     * @brief Pasos que faltan en un eje del bloque cargado (sin proteger)
+     */
+    uint32_t pasosRestantes(uint8_t eje) const { return pasos_restantes[eje]; }
+
+    /**
+     * @brief Posicion de un eje en pasos (sin proteger)
+     */
+    int32_t posicionEje(uint8_t eje) const { return posicion[eje]; }
+
+    /**
+     * @brief Fija la posicion de un eje en pasos (sin proteger)
+     */
+    void fijarPosicion(uint8_t eje, int32_t pasos) { posicion[eje] = pasos; }
+
+    /**
+     * @brief Deja de emitir los pasos de los ejes indicados (sin proteger)
+     * @param mascara Bit n a 1 para bloquear el eje n
+     */
+    void bloquear(uint8_t mascara) { ejes_bloqueados |= mascara; }
+
+    /**
+     * @brief Vuelve a emitir pasos en todos los ejes
+     */
+    void desbloquear() { ejes_bloqueados = 0; }
+
+    /**
+     * @brief Incremento de tasa del siguiente tick en una rampa S
+     * @param incremento Incremento del tick anterior (eventos/s, Q16.16)
+     * @param falta Diferencia entre la tasa vigente y la objetivo de la rampa
+     * @param incremento_maximo Incremento que corresponde a la aceleracion maxima
+     * @param sobreaceleracion Cambio maximo del incremento entre ticks
+     *
+     * @note La usan GeneradorPasos al preparar y el planificador al reproducir la rampa.
+     */
+    static uint32_t siguienteIncrementoCurvaS(uint32_t incremento, uint32_t falta,
+                                              uint32_t incremento_maximo, uint32_t sobreaceleracion);
+
+    /**
+     * @brief Cambio de tasa de un tick de rampa con la aceleracion del bloque
+     * @param bloque Bloque que se esta troceando
+     * @param rampa Estado de la rampa; guarda el incremento en curva S
+     * @param falta Diferencia entre la tasa vigente y la tasa objetivo de la rampa
+     *
+     * En curva S sube la aceleracion de a poco y empieza a bajarla cuando la
+     * tasa que falta es la que se gana al llevarla de nuevo a cero.
+     */
+    static uint32_t incrementoTick(const BloquePasos &bloque, RampaTasa &rampa, uint32_t falta);
+
+    /**
+     * @brief Tasa del siguiente tick de un bloque segun su fase
+     * @param bloque Bloque que se esta troceando
+     * @param eventos_hechos Eventos del bloque ya repartidos en ticks anteriores
+     * @param rampa Estado de la rampa, que avanza un tick
+     * @param limite_fase Devuelve el evento en el que termina la fase del tick
+     * @return Tasa con la que se recorre el tick (eventos/s, Q16.16)
+     *
+     * La subida cambia la tasa al final del tick y la bajada al principio;
+     * ninguna pasa de la tasa nominal ni de la final.
+     */
+    static uint32_t tasaTick(const BloquePasos &bloque, uint32_t eventos_hechos,
+                             RampaTasa &rampa, uint32_t &limite_fase);
+
+    /**
+     * @brief Eventos que recorren los segmentos durante una rampa
+     * @param tasa_desde Tasa al empezar la rampa (Q16.16)
+     * @param tasa_hasta Tasa al terminarla (Q16.16)
+     * @param incremento_maximo Incremento por tick a aceleracion maxima
+     * @param sobreaceleracion Cambio del incremento por tick (0 = rampa lineal)
+     *
+     * Reproduce tick a tick la preparacion de segmentos con la misma
+     * aritmetica entera, de modo que el cambio de fase cae justo donde lo
+     * necesita la rampa. Solo debe usarse fuera de la ISR.
+     */
+    static uint32_t eventosRampa(uint32_t tasa_desde, uint32_t tasa_hasta,
+                                 uint32_t incremento_maximo, uint32_t sobreaceleracion);
+
+    /**
+     * @brief Estimacion de eventosRampa() en forma cerrada, sin recorrer los ticks
+     * @param tasa_desde Tasa al empezar la rampa (Q16.16)
+     * @param tasa_hasta Tasa al terminarla (Q16.16)
+     * @param incremento_maximo Incremento por tick a aceleracion maxima
+     * @param sobreaceleracion Cambio del incremento por tick (0 = rampa lineal)
+     *
+     * Se equivoca en unos pocos ticks de la rampa; sirve para buscar, no
+     * para fijar las fases de un bloque.
+     */
+    static uint32_t eventosRampaEstimados(uint32_t tasa_desde, uint32_t tasa_hasta,
+                                          uint32_t incremento_maximo, uint32_t sobreaceleracion);
+
+    /**
+     * @brief Mayor tasa pico con la que una subida y una bajada caben en un bloque
+     * @param tasa_desde Tasa al entrar (Q16.16)
+     * @param tasa_hasta Tasa al salir (Q16.16); sin uso si con_bajada es false
+     * @param con_bajada false para buscar solo la mayor tasa alcanzable subiendo
+     * @param segura Pico que ya se sabe que cabe, o el menor admisible
+     * @param maxima Pico deseado (mayor que segura)
+     * @param eventos Eventos disponibles para las dos rampas
+     * @param incremento_maximo Incremento por tick a aceleracion maxima
+     * @param sobreaceleracion Cambio del incremento por tick (0 = rampa lineal)
+     * @param subida Devuelve los eventos exactos de la subida al pico
+     * @param bajada Devuelve los eventos exactos de la bajada desde el pico
+     * @return Tasa pico (Q16.16), entre segura y maxima
+     *
+     * La busqueda usa eventosRampaEstimados(); eventosRampa() solo se llama
+     * para comprobar el resultado, a lo sumo CORRECCIONES_MAXIMAS_PICO + 2
+     * veces por rampa. Solo debe usarse fuera de la ISR.
+     */
+    static uint32_t picoRampas(uint32_t tasa_desde, uint32_t tasa_hasta, bool con_bajada,
+                               uint32_t segura, uint32_t maxima, uint32_t eventos,
+                               uint32_t incremento_maximo, uint32_t sobreaceleracion,
+                               uint32_t &subida, uint32_t &bajada);
+};
+
+#endif // NUCLEO_PASOS_H
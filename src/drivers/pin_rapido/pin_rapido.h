@@ -0,0 +1,285 @@
+#ifndef PIN_RAPIDO_H
+#define PIN_RAPIDO_H
+
+#include <Arduino.h>
+
+/**
+ * @file pin_rapido.h
+ * @brief Acceso directo a los registros PORT/DDR/PIN resuelto en compilacion
+ *
+ * @details digitalWrite() busca en tablas de flash el puerto y el bit de cada
+ * pin en cada llamada (decenas de ciclos). PinRapido<PIN> resuelve esa
+ * correspondencia en compilacion para el ATmega2560 (Arduino Mega), de modo
+ * que alto()/bajo() quedan en una sola instruccion sbi/cbi en los puertos A-G
+ * o en una lectura-modificacion-escritura en H, J, K y L.
+ *
+ * GrupoPinesRapido agrupa tres pines (uno por eje) y escribe con un solo
+ * acceso por puerto todos los que deben cambiar juntos, como los pulsos de
+ * paso simultaneos de varios ejes.
+ *
+ * @warning En los puertos H, J, K y L la escritura no es atomica: si la ISR y
+ *          el loop() escriben pines del mismo puerto, el loop() debe hacerlo
+ *          con las interrupciones deshabilitadas.
+ */
+
+enum PuertoAvr : uint8_t {
+    PUERTO_A,
+    PUERTO_B,
+    PUERTO_C,
+    PUERTO_D,
+    PUERTO_E,
+    PUERTO_F,
+    PUERTO_G,
+    PUERTO_H,
+    PUERTO_J,
+    PUERTO_K,
+    PUERTO_L
+};
+
+#define NUM_PINES_MEGA 70
+
+namespace pin_rapido {
+
+/**
+ * @brief Puerto de cada pin digital del Arduino Mega (igual que pins_arduino.h)
+ */
+constexpr uint8_t PUERTO_DE_PIN[NUM_PINES_MEGA] = {
+    PUERTO_E, PUERTO_E, PUERTO_E, PUERTO_E, PUERTO_G, PUERTO_E, PUERTO_H, PUERTO_H, // 0-7
+    PUERTO_H, PUERTO_H, PUERTO_B, PUERTO_B, PUERTO_B, PUERTO_B, PUERTO_J, PUERTO_J, // 8-15
+    PUERTO_H, PUERTO_H, PUERTO_D, PUERTO_D, PUERTO_D, PUERTO_D, PUERTO_A, PUERTO_A, // 16-23
+    PUERTO_A, PUERTO_A, PUERTO_A, PUERTO_A, PUERTO_A, PUERTO_A, PUERTO_C, PUERTO_C, // 24-31
+    PUERTO_C, PUERTO_C, PUERTO_C, PUERTO_C, PUERTO_C, PUERTO_C, PUERTO_D, PUERTO_G, // 32-39
+    PUERTO_G, PUERTO_G, PUERTO_L, PUERTO_L, PUERTO_L, PUERTO_L, PUERTO_L, PUERTO_L, // 40-47
+    PUERTO_L, PUERTO_L, PUERTO_B, PUERTO_B, PUERTO_B, PUERTO_B, PUERTO_F, PUERTO_F, // 48-55
+    PUERTO_F, PUERTO_F, PUERTO_F, PUERTO_F, PUERTO_F, PUERTO_F, PUERTO_K, PUERTO_K, // 56-63
+    PUERTO_K, PUERTO_K, PUERTO_K, PUERTO_K, PUERTO_K, PUERTO_K                      // 64-69
+};
+
+/**
+ * @brief Bit dentro del puerto de cada pin digital del Arduino Mega
+ */
+constexpr uint8_t BIT_DE_PIN[NUM_PINES_MEGA] = {
+    0, 1, 4, 5, 5, 3, 3, 4, // 0-7
+    5, 6, 4, 5, 6, 7, 1, 0, // 8-15
+    1, 0, 3, 2, 1, 0, 0, 1, // 16-23
+    2, 3, 4, 5, 6, 7, 7, 6, // 24-31
+    5, 4, 3, 2, 1, 0, 7, 2, // 32-39
+    1, 0, 7, 6, 5, 4, 3, 2, // 40-47
+    1, 0, 3, 2, 1, 0, 0, 1, // 48-55
+    2, 3, 4, 5, 6, 7, 0, 1, // 56-63
+    2, 3, 4, 5, 6, 7        // 64-69
+};
+
+/**
+ * @brief Registro PORT de un puerto; con PUERTO constante se reduce a una direccion fija
+ */
+template <uint8_t PUERTO>
+inline volatile uint8_t &registroPuerto() {
+    switch (PUERTO) {
+        case PUERTO_A: return PORTA;
+        case PUERTO_B: return PORTB;
+        case PUERTO_C: return PORTC;
+        case PUERTO_D: return PORTD;
+        case PUERTO_E: return PORTE;
+        case PUERTO_F: return PORTF;
+        case PUERTO_G: return PORTG;
+        case PUERTO_H: return PORTH;
+        case PUERTO_J: return PORTJ;
+        case PUERTO_K: return PORTK;
+        default:       return PORTL;
+    }
+}
+
+/**
+ * @brief Registro DDR de un puerto
+ */
+template <uint8_t PUERTO>
+inline volatile uint8_t &registroDireccion() {
+    switch (PUERTO) {
+        case PUERTO_A: return DDRA;
+        case PUERTO_B: return DDRB;
+        case PUERTO_C: return DDRC;
+        case PUERTO_D: return DDRD;
+        case PUERTO_E: return DDRE;
+        case PUERTO_F: return DDRF;
+        case PUERTO_G: return DDRG;
+        case PUERTO_H: return DDRH;
+        case PUERTO_J: return DDRJ;
+        case PUERTO_K: return DDRK;
+        default:       return DDRL;
+    }
+}
+
+/**
+ * @brief Registro PIN (lectura) de un puerto
+ */
+template <uint8_t PUERTO>
+inline volatile uint8_t &registroEntrada() {
+    switch (PUERTO) {
+        case PUERTO_A: return PINA;
+        case PUERTO_B: return PINB;
+        case PUERTO_C: return PINC;
+        case PUERTO_D: return PIND;
+        case PUERTO_E: return PINE;
+        case PUERTO_F: return PINF;
+        case PUERTO_G: return PING;
+        case PUERTO_H: return PINH;
+        case PUERTO_J: return PINJ;
+        case PUERTO_K: return PINK;
+        default:       return PINL;
+    }
+}
+
+} // namespace pin_rapido
+
+/**
+ * @class PinRapido
+ * @brief Pin digital con puerto y bit fijados en compilacion
+ * @tparam PIN Numero de pin de Arduino (los de pines.h)
+ */
+template <uint8_t PIN>
+class PinRapido {
+    static_assert(PIN < NUM_PINES_MEGA, "PinRapido: el pin no existe en el ATmega2560");
+
+public:
+    static constexpr uint8_t puerto = pin_rapido::PUERTO_DE_PIN[PIN]; ///< Puerto AVR del pin
+    static constexpr uint8_t mascara = 1 << pin_rapido::BIT_DE_PIN[PIN]; ///< Bit del pin en su puerto
+
+    /**
+     * @brief Configura el pin como salida
+     */
+    static inline void salida() {
+        pin_rapido::registroDireccion<puerto>() |= mascara;
+    }
+
+    /**
+     * @brief Configura el pin como entrada con resistencia de pull-up
+     */
+    static inline void entradaPullUp() {
+        pin_rapido::registroDireccion<puerto>() &= ~mascara;
+        pin_rapido::registroPuerto<puerto>() |= mascara;
+    }
+
+    /**
+     * @brief Pone el pin en alto
+     */
+    static inline void alto() {
+        pin_rapido::registroPuerto<puerto>() |= mascara;
+    }
+
+    /**
+     * @brief Pone el pin en bajo
+     */
+    static inline void bajo() {
+        pin_rapido::registroPuerto<puerto>() &= ~mascara;
+    }
+
+    /**
+     * @brief Escribe el nivel indicado
+     */
+    static inline void escribir(bool nivel) {
+        if (nivel) {
+            alto();
+        } else {
+            bajo();
+        }
+    }
+
+    /**
+     * @brief Lee el nivel del pin
+     */
+    static inline bool leer() {
+        return (pin_rapido::registroEntrada<puerto>() & mascara) != 0;
+    }
+};
+
+/**
+ * @class GrupoPinesRapido
+ * @brief Tres pines que se escriben juntos, un acceso por puerto distinto
+ * @tparam PIN_0 Pin seleccionado por el bit 0 de la mascara
+ * @tparam PIN_1 Pin seleccionado por el bit 1 de la mascara
+ * @tparam PIN_2 Pin seleccionado por el bit 2 de la mascara
+ *
+ * Los bits de cada puerto se reunen en un registro y se escriben de una vez,
+ * asi los ejes que pasan en el mismo evento reciben el flanco a la vez.
+ */
+template <uint8_t PIN_0, uint8_t PIN_1, uint8_t PIN_2>
+class GrupoPinesRapido {
+private:
+    typedef PinRapido<PIN_0> Pin0;
+    typedef PinRapido<PIN_1> Pin1;
+    typedef PinRapido<PIN_2> Pin2;
+
+    /**
+     * @brief Bits del puerto PUERTO que corresponden a los pines seleccionados
+     */
+    template <uint8_t PUERTO>
+    static inline uint8_t bitsEnPuerto(uint8_t seleccion) {
+        uint8_t bits = 0;
+        if (Pin0::puerto == PUERTO && (seleccion & 0x01)) bits |= Pin0::mascara;
+        if (Pin1::puerto == PUERTO && (seleccion & 0x02)) bits |= Pin1::mascara;
+        if (Pin2::puerto == PUERTO && (seleccion & 0x04)) bits |= Pin2::mascara;
+        return bits;
+    }
+
+    template <uint8_t PUERTO>
+    static inline void escribirPuerto(uint8_t niveles) {
+        uint8_t todos = bitsEnPuerto<PUERTO>(0x07);
+        volatile uint8_t &registro = pin_rapido::registroPuerto<PUERTO>();
+        registro = (registro & ~todos) | bitsEnPuerto<PUERTO>(niveles);
+    }
+
+public:
+    /**
+     * @brief Configura los tres pines como salida
+     */
+    static inline void salida() {
+        Pin0::salida();
+        Pin1::salida();
+        Pin2::salida();
+    }
+
+    /**
+     * @brief Pone en alto los pines seleccionados
+     * @param seleccion Bit n a 1 para el pin n
+     */
+    static inline void activar(uint8_t seleccion) {
+        pin_rapido::registroPuerto<Pin0::puerto>() |= bitsEnPuerto<Pin0::puerto>(seleccion);
+        if (Pin1::puerto != Pin0::puerto) {
+            pin_rapido::registroPuerto<Pin1::puerto>() |= bitsEnPuerto<Pin1::puerto>(seleccion);
+        }
+        if (Pin2::puerto != Pin0::puerto && Pin2::puerto != Pin1::puerto) {
+            pin_rapido::registroPuerto<Pin2::puerto>() |= bitsEnPuerto<Pin2::puerto>(seleccion);
+        }
+    }
+
+    /**
+     * @brief Pone en bajo los pines seleccionados
+     * @param seleccion Bit n a 1 para el pin n
+     */
+    static inline void desactivar(uint8_t seleccion) {
+        pin_rapido::registroPuerto<Pin0::puerto>() &= ~bitsEnPuerto<Pin0::puerto>(seleccion);
+        if (Pin1::puerto != Pin0::puerto) {
+            pin_rapido::registroPuerto<Pin1::puerto>() &= ~bitsEnPuerto<Pin1::puerto>(seleccion);
+        }
+        if (Pin2::puerto != Pin0::puerto && Pin2::puerto != Pin1::puerto) {
+            pin_rapido::registroPuerto<Pin2::puerto>() &= ~bitsEnPuerto<Pin2::puerto>(seleccion);
+        }
+    }
+
+    /**
+     * @brief Escribe los tres pines a la vez
+     * @param niveles Bit n a 1 para poner en alto el pin n, a 0 para ponerlo en bajo
+     */
+    static inline void escribir(uint8_t niveles) {
+        escribirPuerto<Pin0::puerto>(niveles);
+        if (Pin1::puerto != Pin0::puerto) {
+            escribirPuerto<Pin1::puerto>(niveles);
+        }
+        if (Pin2::puerto != Pin0::puerto && Pin2::puerto != Pin1::puerto) {
+            escribirPuerto<Pin2::puerto>(niveles);
+        }
+    }
+};
+
+#endif // PIN_RAPIDO_H
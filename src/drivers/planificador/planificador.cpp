@@ -0,0 +1,360 @@
+#include "planificador.h"
+
+#if PERFIL_CURVA_S
+// Una rampa S de a y j dura dv/a + a/j; con la mitad de a la rampa lineal
+// supuesta por la anticipacion es al menos igual de larga si dv >= a^2/j
+#define FACTOR_ACELERACION_ANTICIPACION 0.5f
+#else
+#define FACTOR_ACELERACION_ANTICIPACION 1.0f
+#endif
+
+Planificador::Planificador():
+    indice_cabeza(0),
+    indice_cola(0),
+    indice_optimo(0),
+    unitario_anterior{0, 0, 0},
+    ajuste_avance(100),
+    ajuste_rapido(100)
+{
+}
+
+uint8_t Planificador::siguienteIndice(uint8_t indice) {
+    return (indice + 1) % TAMANO_BUFFER_PLANIFICADOR;
+}
+
+uint8_t Planificador::anteriorIndice(uint8_t indice) {
+    return (indice + TAMANO_BUFFER_PLANIFICADOR - 1) % TAMANO_BUFFER_PLANIFICADOR;
+}
+
+bool Planificador::estaVacio() const {
+    return indice_cabeza == indice_cola;
+}
+
+bool Planificador::estaLleno() const {
+    return siguienteIndice(indice_cabeza) == indice_cola;
+}
+
+uint8_t Planificador::cantidadBloques() const {
+    return (indice_cabeza + TAMANO_BUFFER_PLANIFICADOR - indice_cola) % TAMANO_BUFFER_PLANIFICADOR;
+}
+
+/**
+ * @brief Modelo de desviacion de union: se supone un arco tangente a ambos
+ * movimientos que se separa DESVIACION_UNION_MM del vertice, y se limita la
+ * aceleracion centripeta en ese arco a la del bloque.
+ *
+ * v^2 = a * d * sen(theta/2) / (1 - sen(theta/2))
+ */
+float Planificador::calcularVelocidadUnionCuadrado(const float *unitario, float aceleracion) const {
+    // theta es el angulo entre el movimiento anterior invertido y el nuevo
+    float coseno_theta = 0;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        coseno_theta -= unitario_anterior[i] * unitario[i];
+    }
+
+    if (coseno_theta > 0.999999f) {
+        return 0; // Inversion completa de direccion: hay que detenerse
+    }
+    if (coseno_theta < -0.999999f) {
+        return VELOCIDAD_UNION_RECTA_CUADRADO; // Movimiento colineal: sin limite por la union
+    }
+
+    float seno_medio_theta = sqrt(0.5f * (1.0f - coseno_theta));
+    return (aceleracion * DESVIACION_UNION_MM * seno_medio_theta) / (1.0f - seno_medio_theta);
+}
+
+/**
+ * @brief Un avance ajustado por encima del 100% no pasa de la velocidad
+ * maxima de los ejes del bloque.
+ */
+float Planificador::calcularVelocidadNominal(const BloquePlanificador& bloque) const {
+    if (bloque.comando == 0) {
+        return bloque.velocidad_nominal * ajuste_rapido / 100.0f;
+    }
+    float velocidad = bloque.velocidad_nominal * ajuste_avance / 100.0f;
+    if (ajuste_avance > 100) {
+        velocidad = min(velocidad, bloque.velocidad_maxima);
+    }
+    return velocidad;
+}
+
+float Planificador::calcularEntradaMaximaCuadrado(uint8_t indice) const {
+    float nominal_minima = min(calcularVelocidadNominal(bloques[indice]),
+                               calcularVelocidadNominal(bloques[anteriorIndice(indice)]));
+    return min(bloques[indice].velocidad_union_cuadrado, nominal_minima * nominal_minima);
+}
+
+bool Planificador::agregarBloque(const BloquePlanificador& bloque, const float *unitario) {
+    if (estaLleno()) {
+        return false;
+    }
+
+    BloquePlanificador &nuevo = bloques[indice_cabeza];
+    nuevo = bloque;
+    nuevo.velocidad_entrada_cuadrado = 0;
+
+    if (estaVacio()) {
+        // El bloque anterior ya se entrego con salida 0: esta entrada queda fija
+        nuevo.velocidad_union_cuadrado = 0;
+        nuevo.velocidad_entrada_max_cuadrado = 0;
+        indice_optimo = indice_cabeza;
+    } else {
+        nuevo.velocidad_union_cuadrado = calcularVelocidadUnionCuadrado(unitario, nuevo.aceleracion);
+        nuevo.velocidad_entrada_max_cuadrado = calcularEntradaMaximaCuadrado(indice_cabeza);
+    }
+
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        unitario_anterior[i] = unitario[i];
+    }
+
+    indice_cabeza = siguienteIndice(indice_cabeza);
+    recalcular();
+    return true;
+}
+
+void Planificador::recalcular() {
+    // Pasada inversa: el bloque mas nuevo debe poder frenar hasta 0 en su distancia
+    uint8_t indice = anteriorIndice(indice_cabeza);
+    if (indice == indice_optimo) {
+        return; // Unico bloque planificable y su entrada ya es fija
+    }
+
+    BloquePlanificador *actual = &bloques[indice];
+    actual->velocidad_entrada_cuadrado = min(actual->velocidad_entrada_max_cuadrado,
+                                             2.0f * FACTOR_ACELERACION_ANTICIPACION * actual->aceleracion * actual->distancia_mm);
+
+    BloquePlanificador *siguiente;
+    indice = anteriorIndice(indice);
+    while (indice != indice_optimo) {
+        siguiente = actual;
+        actual = &bloques[indice];
+        indice = anteriorIndice(indice);
+
+        if (actual->velocidad_entrada_cuadrado != actual->velocidad_entrada_max_cuadrado) {
+            float entrada_cuadrado = siguiente->velocidad_entrada_cuadrado +
+                                     2.0f * FACTOR_ACELERACION_ANTICIPACION * actual->aceleracion * actual->distancia_mm;
+            actual->velocidad_entrada_cuadrado = min(entrada_cuadrado, actual->velocidad_entrada_max_cuadrado);
+        }
+    }
+
+    // Pasada directa: ninguna entrada puede superar lo alcanzable acelerando desde el bloque previo
+    siguiente = &bloques[indice_optimo];
+    indice = siguienteIndice(indice_optimo);
+    while (indice != indice_cabeza) {
+        actual = siguiente;
+        siguiente = &bloques[indice];
+
+        if (actual->velocidad_entrada_cuadrado < siguiente->velocidad_entrada_cuadrado) {
+            float entrada_cuadrado = actual->velocidad_entrada_cuadrado +
+                                     2.0f * FACTOR_ACELERACION_ANTICIPACION * actual->aceleracion * actual->distancia_mm;
+            if (entrada_cuadrado < siguiente->velocidad_entrada_cuadrado) {
+                // Limitado por la aceleracion: ningun bloque nuevo puede mejorarlo
+                siguiente->velocidad_entrada_cuadrado = entrada_cuadrado;
+                indice_optimo = indice;
+            }
+        }
+        if (siguiente->velocidad_entrada_cuadrado == siguiente->velocidad_entrada_max_cuadrado) {
+            indice_optimo = indice;
+        }
+        indice = siguienteIndice(indice);
+    }
+}
+
+BloquePlanificador* Planificador::obtenerBloqueActual() {
+    if (estaVacio()) {
+        return nullptr;
+    }
+    return &bloques[indice_cola];
+}
+
+float Planificador::obtenerVelocidadSalidaActual() const {
+    if (cantidadBloques() < 2) {
+        return 0;
+    }
+    return sqrt(bloques[siguienteIndice(indice_cola)].velocidad_entrada_cuadrado);
+}
+
+void Planificador::descartarBloqueActual() {
+    if (!estaVacio()) {
+        if (indice_optimo == indice_cola) {
+            indice_optimo = siguienteIndice(indice_cola);
+        }
+        indice_cola = siguienteIndice(indice_cola);
+    }
+}
+
+void Planificador::reiniciar() {
+    indice_cola = indice_cabeza;
+    indice_optimo = indice_cabeza;
+}
+
+/**
+ * @brief Los limites de entrada se rehacen con las nuevas nominales y se
+ * replanifica desde la cola. Si la entrada fija de la cola es mayor que el
+ * nuevo plan, se arrastra hacia delante el piso v^2 - 2ad que impone frenar
+ * con la aceleracion del bloque. El plan anterior ya garantizaba poder
+ * frenar desde esa entrada dentro del buffer, asi que el piso nunca contradice
+ * la pasada inversa.
+ */
+void Planificador::establecerAjustes(uint8_t avance, uint8_t rapido) {
+    avance = CONSTRAIN(avance, (uint8_t)AJUSTE_AVANCE_MINIMO, (uint8_t)AJUSTE_AVANCE_MAXIMO);
+    rapido = CONSTRAIN(rapido, (uint8_t)AJUSTE_RAPIDO_BAJO, (uint8_t)100);
+    if (avance == ajuste_avance && rapido == ajuste_rapido) {
+        return;
+    }
+    ajuste_avance = avance;
+    ajuste_rapido = rapido;
+    if (estaVacio()) {
+        return;
+    }
+
+    float piso_cuadrado = bloques[indice_cola].velocidad_entrada_cuadrado;
+    uint8_t anterior = indice_cola;
+    for (uint8_t indice = siguienteIndice(indice_cola); indice != indice_cabeza; indice = siguienteIndice(indice)) {
+        BloquePlanificador &bloque = bloques[indice];
+        piso_cuadrado -= 2.0f * FACTOR_ACELERACION_ANTICIPACION * bloques[anterior].aceleracion * bloques[anterior].distancia_mm;
+        bloque.velocidad_entrada_max_cuadrado = max(calcularEntradaMaximaCuadrado(indice), piso_cuadrado);
+        piso_cuadrado = max(piso_cuadrado, 0.0f);
+        anterior = indice;
+    }
+
+    indice_optimo = indice_cola;
+    recalcular();
+
+#if MODO_DESARROLLADOR
+    Serial.print(F("[Planificador::establecerAjustes] Avance: ")); Serial.print(ajuste_avance);
+    Serial.print(F("% Rapidos: ")); Serial.print(ajuste_rapido);
+    Serial.println(F("%"));
+#endif
+}
+
+uint8_t Planificador::obtenerAjusteAvance() const {
+    return ajuste_avance;
+}
+
+uint8_t Planificador::obtenerAjusteRapido() const {
+    return ajuste_rapido;
+}
+
+/**
+ * @brief Las velocidades en mm/s se pasan a eventos/s con el factor
+ * eventos/mm del bloque, asi la ISR trabaja solo con el eje dominante.
+ */
+void Planificador::calcularTrapecio(const BloquePlanificador& planificado,
+                                    float velocidad_entrada, float velocidad_salida,
+                                    BloquePasos& destino) const {
+    if (planificado.comando == 4) {
+        // Pausa: tasa constante sin rampas. Si se retiene, frena en un solo tick.
+        destino.eventos = planificado.eventos;
+        destino.tasa_inicial = (uint32_t)TASA_EVENTOS_PAUSA * UNO_Q16;
+        destino.tasa_nominal = destino.tasa_inicial;
+        destino.tasa_final = destino.tasa_inicial;
+        destino.incremento_tasa = destino.tasa_inicial;
+        destino.incremento_aceleracion = 0;
+        destino.acelerar_hasta = 0;
+        destino.desacelerar_desde = planificado.eventos;
+        destino.tasa_programada = 0;
+        return;
+    }
+    
+    float eventos_por_mm = planificado.eventos / planificado.distancia_mm;
+    // Referencia de la potencia dinamica: el F programado, sin ajustes ni rampas
+    destino.tasa_programada = flotanteAQ16(min(planificado.velocidad_nominal * eventos_por_mm,
+                                               (float)TASA_MAXIMA_EVENTOS));
+
+    float velocidad_nominal = max(calcularVelocidadNominal(planificado), max(velocidad_entrada, velocidad_salida));
+    float tasa_nominal = velocidad_nominal * eventos_por_mm;
+    float tasa_inicial = velocidad_entrada * eventos_por_mm;
+    float tasa_final = velocidad_salida * eventos_por_mm;
+    float aceleracion = planificado.aceleracion * eventos_por_mm; // eventos/s^2
+
+    // Las correcciones de escuadra y malla pueden sumar algun evento por mm a
+    // un eje ya al limite: ninguna tasa pasa de TASA_MAXIMA_EVENTOS (Q16.16)
+    tasa_nominal = CONSTRAIN(tasa_nominal, (float)TASA_MINIMA_EVENTOS, (float)TASA_MAXIMA_EVENTOS);
+    tasa_inicial = CONSTRAIN(tasa_inicial, (float)TASA_MINIMA_EVENTOS, tasa_nominal);
+    tasa_final = CONSTRAIN(tasa_final, (float)TASA_MINIMA_EVENTOS, tasa_nominal);
+
+#if PERFIL_CURVA_S
+    if (calcularCurvaS(planificado, eventos_por_mm, tasa_inicial, tasa_nominal, tasa_final, destino)) {
+        return;
+    }
+#endif
+
+    // Eventos necesarios para cada rampa: d = (v1^2 - v0^2) / (2a)
+    float inverso_doble_aceleracion = 1.0f / (2.0f * aceleracion);
+    int32_t eventos_aceleracion = static_cast<int32_t>(ceil(
+        (tasa_nominal * tasa_nominal - tasa_inicial * tasa_inicial) * inverso_doble_aceleracion));
+    int32_t eventos_desaceleracion = static_cast<int32_t>(floor(
+        (tasa_nominal * tasa_nominal - tasa_final * tasa_final) * inverso_doble_aceleracion));
+    int32_t eventos_crucero = static_cast<int32_t>(planificado.eventos) - eventos_aceleracion - eventos_desaceleracion;
+
+    if (eventos_crucero < 0) {
+        // Perfil triangular: punto donde se cruzan la rampa de subida y la de bajada
+        eventos_aceleracion = static_cast<int32_t>(ceil(
+            (2.0f * aceleracion * planificado.eventos - tasa_inicial * tasa_inicial + tasa_final * tasa_final) *
+            (0.5f * inverso_doble_aceleracion)));
+        eventos_aceleracion = CONSTRAIN(eventos_aceleracion, (int32_t)0, (int32_t)planificado.eventos);
+        eventos_crucero = 0;
+    }
+
+    destino.eventos = planificado.eventos;
+    destino.tasa_inicial = flotanteAQ16(tasa_inicial);
+    destino.tasa_nominal = flotanteAQ16(tasa_nominal);
+    destino.tasa_final = flotanteAQ16(tasa_final);
+    destino.acelerar_hasta = eventos_aceleracion;
+    destino.desacelerar_desde = eventos_aceleracion + eventos_crucero;
+
+    // Un incremento mayor que la tasa maxima tampoco cabria en Q16.16
+    uint32_t incremento = flotanteAQ16(min(aceleracion * (1.0f / TICKS_ACELERACION_POR_SEGUNDO), (float)TASA_MAXIMA_EVENTOS));
+    destino.incremento_tasa = (incremento > 0) ? incremento : 1;
+    destino.incremento_aceleracion = 0;
+}
+
+#if PERFIL_CURVA_S
+/**
+ * @brief Si las dos rampas no caben, se busca la tasa pico con la que si
+ * caben (NucleoPasos::picoRampas). Solo se ejecuta en loop(), una vez por
+ * bloque, y reproduce a lo sumo 2 * (CORRECCIONES_MAXIMAS_PICO + 4) rampas.
+ */
+bool Planificador::calcularCurvaS(const BloquePlanificador& planificado, float eventos_por_mm,
+                                  float tasa_inicial, float tasa_nominal, float tasa_final,
+                                  BloquePasos& destino) {
+    float aceleracion = planificado.aceleracion * eventos_por_mm;           // eventos/s^2
+    float sobreaceleracion = planificado.sobreaceleracion * eventos_por_mm; // eventos/s^3
+
+    uint32_t incremento = flotanteAQ16(min(aceleracion * (1.0f / TICKS_ACELERACION_POR_SEGUNDO), (float)TASA_MAXIMA_EVENTOS));
+    if (incremento == 0) incremento = 1;
+    uint32_t incremento_aceleracion = flotanteAQ16(min(
+        sobreaceleracion / ((float)TICKS_ACELERACION_POR_SEGUNDO * TICKS_ACELERACION_POR_SEGUNDO),
+        (float)TASA_MAXIMA_EVENTOS));
+    if (incremento_aceleracion == 0) incremento_aceleracion = 1;
+
+    uint32_t inicial = flotanteAQ16(tasa_inicial);
+    uint32_t final = flotanteAQ16(tasa_final);
+    uint32_t pico = flotanteAQ16(tasa_nominal);
+
+    uint32_t eventos_subida = NucleoPasos::eventosRampa(inicial, pico, incremento, incremento_aceleracion);
+    uint32_t eventos_bajada = NucleoPasos::eventosRampa(pico, final, incremento, incremento_aceleracion);
+
+    if (eventos_subida + eventos_bajada > planificado.eventos) {
+        uint32_t minima = max(inicial, final);
+        if (NucleoPasos::eventosRampa(inicial, minima, incremento, incremento_aceleracion) +
+            NucleoPasos::eventosRampa(minima, final, incremento, incremento_aceleracion) > planificado.eventos) {
+            return false; // Ni sin pico caben: rampa lineal
+        }
+
+        pico = NucleoPasos::picoRampas(inicial, final, true, minima, pico, planificado.eventos,
+                                       incremento, incremento_aceleracion, eventos_subida, eventos_bajada);
+    }
+
+    destino.eventos = planificado.eventos;
+    destino.tasa_inicial = inicial;
+    destino.tasa_nominal = pico;
+    destino.tasa_final = final;
+    destino.acelerar_hasta = eventos_subida;
+    destino.desacelerar_desde = planificado.eventos - eventos_bajada;
+    destino.incremento_tasa = incremento;
+    destino.incremento_aceleracion = incremento_aceleracion;
+    return true;
+}
+#endif
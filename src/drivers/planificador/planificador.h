@@ -0,0 +1,215 @@
+#ifndef PLANIFICADOR_H
+#define PLANIFICADOR_H
+
+#include <Arduino.h>
+#include "constantes.h"
+#include "generador_pasos.h"
+
+/**
+ * @file planificador.h
+ * @brief Cola de bloques de movimiento planificados por delante de la ejecucion
+ *
+ * @details El interprete llena esta cola mientras la maquina se mueve, de modo
+ * que el siguiente segmento ya esta calculado cuando termina el anterior y no
+ * hay tiempo muerto entre bloques.
+ *
+ * Sobre la cola se hace una anticipacion (lookahead) de dos pasadas: la
+ * pasada inversa asegura que siempre se pueda frenar al final del ultimo
+ * bloque conocido y la directa limita cada entrada a lo que permite la
+ * aceleracion desde el bloque anterior. La velocidad maxima en cada union se
+ * obtiene con el modelo de desviacion de union (junction deviation) a partir
+ * del angulo entre movimientos consecutivos.
+ *
+ * Los ajustes de avance y de rapidos escalan la velocidad nominal de cada
+ * bloque al planificarlo; al cambiarlos se replanifica todo el buffer.
+ *
+ * Con PERFIL_CURVA_S las rampas son de 7 fases (sobreaceleracion limitada).
+ * La anticipacion usa entonces la mitad de la aceleracion, de modo que la
+ * rampa S, mas larga que la lineal, siga cabiendo en la distancia planificada.
+ */
+
+/**
+ * @struct BloquePlanificador
+ * @brief Version compacta de un ComandoGcode de movimiento, ya en pasos
+ */
+struct BloquePlanificador {
+    int32_t pasos[NUM_EJES];          ///< Pasos con signo a recorrer en cada eje
+    uint32_t eventos;                 ///< Pasos del eje dominante (en una pausa G04, milisegundos)
+    float distancia_mm;               ///< Longitud del movimiento en milimetros
+    float velocidad_nominal;          ///< Velocidad programada sobre la trayectoria, sin ajustes (mm/s)
+    float velocidad_maxima;           ///< Velocidad que ningun eje deja superar sobre la trayectoria (mm/s)
+    float aceleracion;                ///< Aceleracion maxima sobre la trayectoria (mm/s^2)
+    float sobreaceleracion;           ///< Sobreaceleracion maxima sobre la trayectoria (mm/s^3)
+    float velocidad_entrada_cuadrado; ///< Velocidad de entrada planificada al cuadrado (mm/s)^2
+    float velocidad_entrada_max_cuadrado; ///< Limite de entrada por union y velocidades nominales
+    float velocidad_union_cuadrado;   ///< Limite de entrada solo por el angulo de la union
+    uint8_t comando;                  ///< Codigo G de origen (0 a 4; los arcos llegan ya troceados)
+    bool compensacion;                ///< Micro-movimiento de holgura: mueve motores pero no la posicion
+    uint16_t ciclo_cortadora;         ///< Ciclo de PWM de la cortadora (cuentas de OCR5A)
+    uint8_t estado_cortadora;         ///< Bits CORTADORA_* (encendida, antihoraria)
+    uint8_t pixeles;                  ///< Pixeles de grabado ya guardados en el GeneradorPasos
+};
+
+/**
+ * @class Planificador
+ * @brief Buffer circular de capacidad fija de bloques de movimiento
+ *
+ * Solo se usa desde loop(): el interprete agrega bloques por la cabeza y el
+ * ControladorCNC los retira por la cola para entregarlos al GeneradorPasos.
+ * La entrada del bloque de la cola ya quedo fijada por la salida del bloque
+ * entregado antes, por lo que la anticipacion nunca la modifica.
+ */
+class Planificador {
+private:
+    BloquePlanificador bloques[TAMANO_BUFFER_PLANIFICADOR]; ///< Almacenamiento del buffer
+    uint8_t indice_cabeza;    ///< Siguiente posicion libre
+    uint8_t indice_cola;      ///< Bloque mas antiguo pendiente
+    uint8_t indice_optimo;    ///< Hasta este bloque (inclusive) el plan ya es optimo
+
+    float unitario_anterior[NUM_EJES]; ///< Direccion del ultimo bloque agregado
+    uint8_t ajuste_avance;             ///< Porcentaje aplicado al F programado
+    uint8_t ajuste_rapido;             ///< Porcentaje aplicado a los G00
+
+    /**
+     * @brief Indice siguiente en el buffer circular
+     */
+    static uint8_t siguienteIndice(uint8_t indice);
+
+    /**
+     * @brief Indice anterior en el buffer circular
+     */
+    static uint8_t anteriorIndice(uint8_t indice);
+
+    /**
+     * @brief Limite de velocidad al cuadrado en la union con el bloque anterior
+     * @param unitario Direccion del nuevo bloque
+     * @param aceleracion Aceleracion del nuevo bloque (mm/s^2)
+     */
+    float calcularVelocidadUnionCuadrado(const float *unitario, float aceleracion) const;
+
+    /**
+     * @brief Velocidad nominal de un bloque con el ajuste que le corresponde (mm/s)
+     */
+    float calcularVelocidadNominal(const BloquePlanificador& bloque) const;
+
+    /**
+     * @brief Limite de entrada de un bloque a partir de su union y de las
+     * velocidades nominales ajustadas de el y del anterior
+     * @param indice Bloque consultado (no puede ser la cola)
+     */
+    float calcularEntradaMaximaCuadrado(uint8_t indice) const;
+
+    /**
+     * @brief Replanifica las velocidades de entrada tras agregar un bloque
+     *
+     * Solo recorre los bloques posteriores a indice_optimo: los anteriores ya
+     * estan a su velocidad maxima o limitados por la aceleracion desde el
+     * inicio, y ningun bloque nuevo puede mejorarlos.
+     */
+    void recalcular();
+
+#if PERFIL_CURVA_S
+    /**
+     * @brief Calcula el perfil de curva S de un bloque con tasas ya en eventos/s
+     * @return false si ni siquiera sin velocidad pico caben las rampas en el bloque
+     */
+    static bool calcularCurvaS(const BloquePlanificador& planificado, float eventos_por_mm,
+                               float tasa_inicial, float tasa_nominal, float tasa_final,
+                               BloquePasos& destino);
+#endif
+
+public:
+    /**
+     * @brief Constructor (buffer vacio)
+     */
+    Planificador();
+
+    /**
+     * @brief Indica si no hay bloques pendientes
+     */
+    bool estaVacio() const;
+
+    /**
+     * @brief Indica si ya no caben mas bloques
+     */
+    bool estaLleno() const;
+
+    /**
+     * @brief Numero de bloques pendientes
+     */
+    uint8_t cantidadBloques() const;
+
+    /**
+     * @brief Agrega un bloque al final del buffer y replanifica las uniones
+     * @param bloque Bloque a copiar (sin velocidades de entrada)
+     * @param unitario Vector unitario de la direccion del movimiento
+     * @return false si el buffer esta lleno
+     */
+    bool agregarBloque(const BloquePlanificador& bloque, const float *unitario);
+
+    /**
+     * @brief Bloque mas antiguo pendiente de ejecutar
+     * @return Puntero al bloque o nullptr si el buffer esta vacio
+     */
+    BloquePlanificador* obtenerBloqueActual();
+
+    /**
+     * @brief Velocidad con la que debe terminar el bloque actual (mm/s)
+     * @return Entrada planificada del bloque siguiente, o 0 si no hay siguiente
+     */
+    float obtenerVelocidadSalidaActual() const;
+
+    /**
+     * @brief Retira el bloque mas antiguo una vez entregado al generador
+     *
+     * La entrada del bloque siguiente queda fijada a partir de este momento.
+     */
+    void descartarBloqueActual();
+
+    /**
+     * @brief Vacia el buffer
+     */
+    void reiniciar();
+
+    /**
+     * @brief Cambia los ajustes de velocidad y replanifica los bloques pendientes
+     * @param avance Porcentaje del avance programado (AJUSTE_AVANCE_MINIMO a AJUSTE_AVANCE_MAXIMO)
+     * @param rapido Porcentaje de los rapidos (hasta 100)
+     *
+     * La entrada del bloque de la cola ya esta fijada; si el nuevo plan es mas
+     * lento que ella, los bloques siguientes conservan la velocidad necesaria
+     * para frenar sin saltos.
+     */
+    void establecerAjustes(uint8_t avance, uint8_t rapido);
+
+    /**
+     * @brief Porcentaje de avance vigente
+     */
+    uint8_t obtenerAjusteAvance() const;
+
+    /**
+     * @brief Porcentaje de rapidos vigente
+     */
+    uint8_t obtenerAjusteRapido() const;
+
+    /**
+     * @brief Calcula el perfil trapezoidal de un bloque en unidades de eventos
+     * @param planificado Bloque de origen
+     * @param velocidad_entrada Velocidad al inicio del bloque (mm/s)
+     * @param velocidad_salida Velocidad al final del bloque (mm/s)
+     * @param destino Bloque de pasos donde se escriben tasas y puntos de cambio de fase
+     *
+     * Si la distancia no alcanza para llegar a la velocidad nominal el perfil
+     * se vuelve triangular: se acelera hasta el punto donde se cruzan las rampas.
+     * Con PERFIL_CURVA_S se calcula la curva S y solo si no cabe en el bloque
+     * se recurre al trapecio.
+     *
+     * La velocidad nominal es la ajustada; si un ajuste la dejo por debajo de
+     * la entrada o de la salida, se cruza a esa velocidad para no dar un salto.
+     */
+    void calcularTrapecio(const BloquePlanificador& planificado,
+                          float velocidad_entrada, float velocidad_salida,
+                          BloquePasos& destino) const;
+};
+
+#endif // PLANIFICADOR_H
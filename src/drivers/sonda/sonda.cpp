@@ -0,0 +1,84 @@
+#include "sonda.h"
+#include "pin_rapido.h"
+#include <util/atomic.h>
+
+typedef PinRapido<PIN_SONDA> PinSonda;
+
+static_assert(PinSonda::puerto == PUERTO_B, "Sonda: la sonda debe estar en el puerto B (PCINT0)");
+
+Sonda *Sonda::instancia = nullptr;
+
+ISR(PCINT0_vect) {
+    Sonda::instancia->atenderInterrupcion();
+}
+
+Sonda::Sonda(GeneradorPasos &miGeneradorPasos_ref):
+    generador_pasos(miGeneradorPasos_ref),
+    armada(false),
+    contacto(false),
+    posicion_contacto{0, 0, 0}
+{
+    instancia = this;
+}
+
+void Sonda::inicializar() {
+    PinSonda::entradaPullUp();
+
+    // En el puerto B el bit del pin coincide con el de PCMSK0
+    PCMSK0 |= PinSonda::mascara;
+    PCIFR = _BV(PCIF0);
+    PCICR |= _BV(PCIE0);
+}
+
+bool Sonda::leer() const {
+#if SONDA_ACTIVA_BAJO
+    return !PinSonda::leer();
+#else
+    return PinSonda::leer();
+#endif
+}
+
+void Sonda::armar() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        contacto = false;
+        armada = true;
+    }
+}
+
+void Sonda::desarmar() {
+    armada = false;
+}
+
+bool Sonda::consumirContacto() {
+    bool hubo_contacto;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        hubo_contacto = contacto;
+        contacto = false;
+    }
+    return hubo_contacto;
+}
+
+int32_t Sonda::obtenerContacto(uint8_t eje) const {
+    int32_t posicion;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        posicion = posicion_contacto[eje];
+    }
+    return posicion;
+}
+
+/**
+ * @brief La ISR del Timer1 no puede interrumpir a esta, asi que la posicion
+ * copiada es exactamente la del ultimo paso emitido antes del contacto.
+ * Solo se para el Timer1; las colas se vacian en ControladorCNC::actualizarSondeo().
+ */
+void Sonda::atenderInterrupcion() {
+    if (!armada || !leer()) {
+        return;
+    }
+    generador_pasos.detenerDesdeInterrupcion();
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        posicion_contacto[i] = generador_pasos.obtenerPosicion(i);
+    }
+    armada = false;
+    contacto = true;
+}
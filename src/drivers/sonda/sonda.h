@@ -0,0 +1,83 @@
+#ifndef SONDA_H
+#define SONDA_H
+
+#include <Arduino.h>
+#include "constantes.h"
+#include "pines.h"
+#include "generador_pasos.h"
+
+/**
+ * @file sonda.h
+ * @brief Sonda de contacto (G38.2 y malla de alturas) con interrupcion de cambio de pin
+ *
+ * @details La sonda usa la interrupcion PCINT0 (puerto B). Armada, el primer
+ * contacto detiene el generador de pasos y copia su posicion dentro de la
+ * propia interrupcion, asi que el punto medido no depende de lo que tarde el
+ * loop() en enterarse y se puede sondear deprisa.
+ */
+
+/**
+ * @class Sonda
+ * @brief Entrada de la sonda de contacto
+ *
+ * @note Solo puede existir una instancia: la ISR la localiza a traves del
+ *       puntero estatico instancia.
+ */
+class Sonda {
+private:
+    GeneradorPasos &generador_pasos;
+    volatile bool armada;                       ///< El siguiente contacto detiene los motores
+    volatile bool contacto;                     ///< Hubo contacto y nadie lo ha atendido
+    volatile int32_t posicion_contacto[NUM_EJES]; ///< Posicion en pasos en el instante del contacto
+
+public:
+    static Sonda *instancia; ///< Instancia atendida por la ISR
+
+    /**
+     * @brief Constructor
+     * @param miGeneradorPasos_ref Generador que se detiene con el contacto
+     */
+    Sonda(GeneradorPasos &miGeneradorPasos_ref);
+
+    /**
+     * @brief Configura el pin con pull-up y habilita la interrupcion PCINT0
+     */
+    void inicializar();
+
+    /**
+     * @brief Estado actual de la sonda
+     * @return true si esta tocando
+     */
+    bool leer() const;
+
+    /**
+     * @brief Arma la sonda y olvida contactos anteriores
+     */
+    void armar();
+
+    /**
+     * @brief Desarma la sonda sin detener nada
+     */
+    void desarmar();
+
+    /**
+     * @brief Indica si la sonda armada hizo contacto desde la ultima consulta
+     * @return true una sola vez por contacto
+     */
+    bool consumirContacto();
+
+    /**
+     * @brief Posicion de un eje en el instante del contacto
+     * @param eje Eje consultado
+     * @return Posicion en pasos
+     */
+    int32_t obtenerContacto(uint8_t eje) const;
+
+    /**
+     * @brief Rutina de servicio de PCINT0
+     * @note Solo debe llamarse desde ISR(PCINT0_vect)
+     */
+    void atenderInterrupcion();
+};
+
+#endif // SONDA_H
@@ -11,7 +11,6 @@
  //Nota para mi: cada que hago full clean del proyecto debo volver a especificar en el mcufriend_shield y mcufriend_special que estoy usando un shield de 16 bits
 #include <Ch376msc.h>
 #include <Arduino.h>
-#include <MultiStepperLite.h>
 #include <Keypad.h>
 
 #include "pines.h"
@@ -21,8 +20,13 @@
 
 #include "consola.h"
 #include "interprete_gcode.h"
+#include "generador_pasos.h"
+#include "finales_carrera.h"
+#include "cortadora.h"
+#include "sonda.h"
 #include "controlador_cnc.h"
 #include "comando_gcode.h"
+#include "textos.h"
 
 const byte FILAS = 4; 
 const byte COLUMNAS = 3; 
@@ -48,17 +52,26 @@ GestorArchivos gestor(controlador_sd, controlador_usb);
 Consola miConsola(gestor);
 
 InterpreteGcode miInterpreteGcode;
-MultiStepperLite miControladorMotores(3);
-ControladorCNC miControladorCNC(miControladorMotores);
+GeneradorPasos miGeneradorPasos;
+FinalesCarrera misFinalesCarrera(miGeneradorPasos);
+Sonda miSonda(miGeneradorPasos);
+ControladorCNC miControladorCNC(miGeneradorPasos, misFinalesCarrera, miSonda);
 ComandoGcode comando_actual,comando_anterior;
 
 //ControladorSD miControladorSD;
 
 char linea_gcode_buffer[256] = ""; 
+char estado_cortadora_buffer[24] = "";
 
-bool esperando_fin_movimiento = false;
 char tecla;
 bool archivo_terminado = false;
+bool calibracion_lanzada = false;
+bool calibracion_fallida = false; ///< El error sigue en pantalla hasta que el usuario sale
+bool alarma_mostrada = false;
+bool sondeo_lanzado = false; ///< Un G38.2 o G29 deja la maquina donde el interprete no sabe
+char tecla_manual = NO_KEY;  ///< Tecla de movimiento manual que se mantiene pulsada
+char tecla_consola = NO_KEY; ///< Pulsacion de la pantalla de movimiento manual para la consola
+bool movimiento_manual_lanzado = false; ///< Los ejes se movieron sin pasar por el interprete
 
 static uint32_t ultima_ejecucion_consola = 0;
 static uint32_t intervalo_entre_ciclos = 0;
@@ -81,6 +94,275 @@ void limpiarBufferKeypad() {
     teclado.getKeys();
 }
 
+/**
+ * @brief Aplica una tecla de ajuste de velocidad o de retencion durante la ejecucion
+ * @return true si la tecla era de ajuste
+ */
+bool procesarTeclaAjuste(char tecla) {
+    switch (tecla) {
+        case TECLA_AVANCE_MENOS:
+            miControladorCNC.establecerAjusteAvance(miControladorCNC.obtenerAjusteAvance() - AJUSTE_AVANCE_PASO_GRUESO);
+            return true;
+        case TECLA_AVANCE_RESTABLECER:
+            miControladorCNC.establecerAjusteAvance(100);
+            return true;
+        case TECLA_AVANCE_MAS:
+            miControladorCNC.establecerAjusteAvance(miControladorCNC.obtenerAjusteAvance() + AJUSTE_AVANCE_PASO_GRUESO);
+            return true;
+        case TECLA_RAPIDO_BAJO:
+            miControladorCNC.establecerAjusteRapido(AJUSTE_RAPIDO_BAJO);
+            return true;
+        case TECLA_RAPIDO_MEDIO:
+            miControladorCNC.establecerAjusteRapido(AJUSTE_RAPIDO_MEDIO);
+            return true;
+        case TECLA_RAPIDO_COMPLETO:
+            miControladorCNC.establecerAjusteRapido(100);
+            return true;
+        case TECLA_RETENCION:
+            if (miControladorCNC.enRetencion()) {
+                miControladorCNC.reanudarAvance();
+            } else {
+                miControladorCNC.retenerAvance();
+            }
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Atiende los bytes de tiempo real del puerto serie
+ * 
+ * Se leen en cada vuelta del loop para que el ajuste no espere al refresco
+ * de la consola; cualquier otro byte se descarta.
+ */
+void procesarBytesTiempoReal() {
+    while (Serial.available() > 0) {
+        uint8_t byte_recibido = Serial.read();
+        uint8_t avance = miControladorCNC.obtenerAjusteAvance();
+        switch (byte_recibido) {
+            case BYTE_AVANCE_RESTABLECER:  miControladorCNC.establecerAjusteAvance(100); break;
+            case BYTE_AVANCE_MAS_GRUESO:   miControladorCNC.establecerAjusteAvance(avance + AJUSTE_AVANCE_PASO_GRUESO); break;
+            case BYTE_AVANCE_MENOS_GRUESO: miControladorCNC.establecerAjusteAvance(avance - AJUSTE_AVANCE_PASO_GRUESO); break;
+            case BYTE_AVANCE_MAS_FINO:     miControladorCNC.establecerAjusteAvance(avance + AJUSTE_AVANCE_PASO_FINO); break;
+            case BYTE_AVANCE_MENOS_FINO:   miControladorCNC.establecerAjusteAvance(avance - AJUSTE_AVANCE_PASO_FINO); break;
+            case BYTE_RAPIDO_COMPLETO:     miControladorCNC.establecerAjusteRapido(100); break;
+            case BYTE_RAPIDO_MEDIO:        miControladorCNC.establecerAjusteRapido(AJUSTE_RAPIDO_MEDIO); break;
+            case BYTE_RAPIDO_BAJO:         miControladorCNC.establecerAjusteRapido(AJUSTE_RAPIDO_BAJO); break;
+            case BYTE_RETENCION:           miControladorCNC.retenerAvance(); break;
+            case BYTE_REANUDAR:            miControladorCNC.reanudarAvance(); break;
+        }
+    }
+}
+
+/**
+ * @brief Alinea la posicion programada del interprete con la de los motores
+ * 
+ * Necesario cuando la maquina se ha movido, o ha descartado movimientos, sin
+ * pasar por el interprete.
+ */
+void sincronizarInterprete() {
+    float posicion_mm[NUM_EJES];
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        posicion_mm[i] = miControladorCNC.obtenerPosicionActualMm(i);
+    }
+    miInterpreteGcode.establecerPosicion(posicion_mm);
+}
+
+/**
+ * @brief Lee e interpreta la siguiente linea del archivo si el planificador tiene espacio
+ * 
+ * Se llama en cada vuelta del loop (no solo en el refresco de la consola) para que
+ * el buffer del planificador se mantenga lleno mientras la maquina se mueve.
+ */
+void alimentarPlanificador() {
+    if (!miControladorCNC.hayEspacioEnCola()) {
+        return;
+    }
+    if (sondeo_lanzado) {
+        // El sondeo termino: se sigue desde el punto de contacto
+        sincronizarInterprete();
+        sondeo_lanzado = false;
+    }
+    
+    String linea_gcode = gestor.leerLineaNoBloqueante();
+    
+    if (linea_gcode.length() > 0) {
+        linea_gcode.toCharArray(linea_gcode_buffer, sizeof(linea_gcode_buffer));
+        
+        #if MODO_DESARROLLADOR
+        Serial.print(F("Procesando línea: "));
+        Serial.println(linea_gcode_buffer);
+        #endif
+        
+        if (miInterpreteGcode.procesarComando(linea_gcode)) {
+            comando_anterior = comando_actual;
+            comando_actual = miInterpreteGcode.obtenerComandoActual();
+            
+            miControladorCNC.establecerComando(comando_actual);
+            if (miControladorCNC.ejecutarComando()) {
+                sondeo_lanzado = miControladorCNC.sondeando();
+                #if MODO_DESARROLLADOR
+                Serial.println(F("[Main] Comando enviado al planificador"));
+                #endif
+            }
+        }
+    } else {
+        archivo_terminado = true;
+        strcpy(linea_gcode_buffer, "FIN ARCHIVO");
+        #if MODO_DESARROLLADOR
+        Serial.println(F("Fin del archivo"));
+        #endif
+        gestor.cerrarArchivo();
+    }
+}
+
+/**
+ * @brief Lanza la calibracion al entrar en su pantalla y la cierra al terminar
+ * 
+ * Si el usuario sale de la pantalla a mitad del ciclo, la calibracion se cancela.
+ */
+void atenderCalibracion() {
+    bool en_pantalla = miConsola.obtenerContextoActual() == CALIBRACION;
+    
+    if (!calibracion_lanzada) {
+        if (!en_pantalla) {
+            calibracion_fallida = false;
+        } else if (!calibracion_fallida && miControladorCNC.iniciarCalibracion()) {
+            calibracion_lanzada = true;
+        }
+        return;
+    }
+    
+    if (miControladorCNC.calibrando()) {
+        if (!en_pantalla) {
+            miControladorCNC.detenerEmergencia();
+            calibracion_lanzada = false;
+        }
+        return;
+    }
+    
+    bool exito = miControladorCNC.obtenerFaseCalibracion() == CALIBRACION_COMPLETA;
+    if (exito) {
+        sincronizarInterprete();
+    }
+    miConsola.finalizarCalibracion(exito);
+    calibracion_lanzada = false;
+    calibracion_fallida = !exito;
+}
+
+/**
+ * @brief Lleva la consola a la pantalla de alarma cuando salta un limite
+ * 
+ * Los motores ya estan parados o frenando; aqui solo se abandona el archivo
+ * en curso. El interprete se alinea al salir de la alarma.
+ */
+void atenderAlarma() {
+    if (!miControladorCNC.enAlarma()) {
+        alarma_mostrada = false;
+        return;
+    }
+    if (alarma_mostrada) {
+        return;
+    }
+    alarma_mostrada = true;
+    
+    // Con el archivo cerrado, la siguiente lectura da el programa por terminado
+    gestor.cerrarArchivo();
+    if (miControladorCNC.obtenerAlarma() == ALARMA_LIMITE_FISICO) {
+        miConsola.mostrarAlarma(TXT_ALARMA_LIMITE_FISICO);
+    } else if (miControladorCNC.obtenerAlarma() == ALARMA_SONDEO) {
+        miConsola.mostrarAlarma(TXT_ALARMA_SONDEO);
+    } else {
+        miConsola.mostrarAlarma(TXT_ALARMA_LIMITE_SOFTWARE);
+    }
+}
+
+/**
+ * @brief Eje y sentido de una tecla de movimiento manual
+ * @return false si la tecla no mueve ningun eje
+ */
+bool ejeDeTeclaManual(char tecla, uint8_t &eje, bool &positivo) {
+    switch (tecla) {
+        case TECLA_MANUAL_X_MENOS: eje = EJE_X; positivo = false; return true;
+        case TECLA_MANUAL_X_MAS:   eje = EJE_X; positivo = true;  return true;
+        case TECLA_MANUAL_Y_MENOS: eje = EJE_Y; positivo = false; return true;
+        case TECLA_MANUAL_Y_MAS:   eje = EJE_Y; positivo = true;  return true;
+        case TECLA_MANUAL_Z_MENOS: eje = EJE_Z; positivo = false; return true;
+        case TECLA_MANUAL_Z_MAS:   eje = EJE_Z; positivo = true;  return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Mueve un eje mientras su tecla siga pulsada en la pantalla de movimiento manual
+ * 
+ * El teclado se lee en cada vuelta del loop y no en el refresco de la
+ * consola: soltar la tecla tiene que llegar al controlador en pocos
+ * milisegundos. Como esta lectura consume los cambios del teclado, las
+ * demas pulsaciones se guardan para la consola.
+ * 
+ * Solo arranca con una pulsacion nueva; la tecla con la que se entro en la
+ * pantalla no mueve nada. Si la maquina aun frena el movimiento anterior, se
+ * reintenta mientras la tecla siga pulsada. Cuando la maquina para, el
+ * interprete se alinea con la nueva posicion.
+ */
+void atenderMovimientoManual() {
+    if (movimiento_manual_lanzado && !miControladorCNC.movimientoManualActivo()) {
+        sincronizarInterprete();
+        movimiento_manual_lanzado = false;
+    }
+    if (miConsola.obtenerContextoActual() != MOVIMIENTO_MANUAL) {
+        if (tecla_manual != NO_KEY) {
+            miControladorCNC.cancelarMovimientoManual();
+            tecla_manual = NO_KEY;
+        }
+        return;
+    }
+    
+    uint8_t eje;
+    bool positivo;
+    if (teclado.getKeys()) {
+        for (uint8_t i = 0; i < LIST_MAX; i++) {
+            if (!teclado.key[i].stateChanged) {
+                continue;
+            }
+            char tecla_cambiada = teclado.key[i].kchar;
+            if (teclado.key[i].kstate == PRESSED) {
+                if (!ejeDeTeclaManual(tecla_cambiada, eje, positivo)) {
+                    tecla_consola = tecla_cambiada;
+                } else if (tecla_manual == NO_KEY) {
+                    tecla_manual = tecla_cambiada;
+                }
+            } else if (teclado.key[i].kstate == RELEASED && tecla_cambiada == tecla_manual) {
+                miControladorCNC.cancelarMovimientoManual();
+                tecla_manual = NO_KEY;
+            }
+        }
+    }
+    
+    if (tecla_manual != NO_KEY && ejeDeTeclaManual(tecla_manual, eje, positivo) &&
+        miControladorCNC.iniciarMovimientoManual(eje, positivo)) {
+        movimiento_manual_lanzado = true;
+    }
+}
+
+/**
+ * @brief Texto de la cortadora para la pantalla de ejecucion
+ * 
+ * Se lee lo que la ISR aplico, no el ultimo M/S interpretado: el cambio
+ * aparece cuando empieza su bloque.
+ */
+void actualizarEstadoCortadora() {
+    uint8_t estado = Cortadora::obtenerEstado();
+    if (!(estado & CORTADORA_ENCENDIDA)) {
+        strncpy_P(estado_cortadora_buffer, PSTR("Apagada"), sizeof(estado_cortadora_buffer) - 1);
+        return;
+    }
+    snprintf_P(estado_cortadora_buffer, sizeof(estado_cortadora_buffer), PSTR("M%u S%u"),
+               (estado & CORTADORA_ANTIHORARIA) ? 4 : 3,
+               (unsigned int)lroundf(Cortadora::obtenerVelocidad()));
+}
+
 void setup() {
     Serial.begin(115200);
     #if MODO_DESARROLLADOR
@@ -106,8 +388,19 @@ void loop() {
 
     tiempo_actual = micros();
     
+    procesarBytesTiempoReal();
+    
     // Actualizar controlador CNC
-    miControladorCNC.actualizar(tiempo_actual,0);
+    miControladorCNC.actualizar();
+    
+    atenderAlarma();
+    atenderCalibracion();
+    atenderMovimientoManual();
+    
+    // Lógica de ejecución G-code: se interpreta por delante del movimiento
+    if(miConsola.obtenerContextoActual() == EJECUCION && !archivo_terminado){
+        alimentarPlanificador();
+    }
 
     intervalo_entre_ciclos = tiempo_actual - tiempo_bucle_anterior;
     tiempo_bucle_anterior = tiempo_actual;
@@ -118,73 +411,51 @@ void loop() {
         //Serial.print(F("[Main] intervalo_actualizacion_consola: "));
         //Serial.println(tiempo_actual - ultima_ejecucion_consola);
         ultima_ejecucion_consola = tiempo_actual;
-        char tecla = teclado.getKey();
+        // Posicion real de los motores (pasos ya emitidos), no la ultima linea interpretada
+        float posicion_x = miControladorCNC.obtenerPosicionActualMm(EJE_X);
+        float posicion_y = miControladorCNC.obtenerPosicionActualMm(EJE_Y);
+        float posicion_z = miControladorCNC.obtenerPosicionActualMm(EJE_Z);
+        actualizarEstadoCortadora();
+        char tecla;
+        if (miConsola.obtenerContextoActual() == MOVIMIENTO_MANUAL) {
+            // El teclado ya lo leyo atenderMovimientoManual()
+            tecla = tecla_consola;
+            tecla_consola = NO_KEY;
+        } else {
+            tecla = teclado.getKey();
+        }
         if (tecla) {
             #if MODO_DESARROLLADOR
             Serial.print(F("[Main] Tecla detectada: "));
             Serial.println(tecla);
             #endif
-        
+            
+            if (miConsola.obtenerContextoActual() == EJECUCION) {
+                procesarTeclaAjuste(tecla);
+            } else if (miConsola.obtenerContextoActual() == ALARMA && tecla == '0') {
+                // Si un final sigue pisado la alarma se mantiene hasta calibrar
+                if (miControladorCNC.restablecerAlarma()) {
+                    sincronizarInterprete();
+                }
+            }
             
             // Actualizar consola con la tecla
-            miConsola.actualizar(tecla, comando_anterior.x, comando_actual.x, comando_actual.x,
-                                comando_anterior.y, comando_actual.y, comando_actual.y,
-                                comando_anterior.z, comando_actual.z, comando_actual.z,
-                                linea_gcode_buffer);
+            miConsola.actualizar(tecla, comando_anterior.x, posicion_x, comando_actual.x,
+                                comando_anterior.y, posicion_y, comando_actual.y,
+                                comando_anterior.z, posicion_z, comando_actual.z,
+                                linea_gcode_buffer, estado_cortadora_buffer);
             
-        limpiarBufferKeypad();
+            // Vaciar el teclado consumiria la liberacion de la tecla de movimiento manual
+            if (miConsola.obtenerContextoActual() != MOVIMIENTO_MANUAL) {
+                limpiarBufferKeypad();
+            }
             
         } else {
             // Actualizar consola sin tecla
-            miConsola.actualizar(' ', comando_anterior.x, miControladorCNC.controlador_motores.get_remaining_steps(0), comando_actual.x,
-                                comando_anterior.y, comando_actual.y, comando_actual.y,
-                                comando_anterior.z, comando_actual.z, comando_actual.z,
-                                linea_gcode_buffer);
-        }
-        // Lógica de ejecución G-code
-        if(miConsola.obtenerContextoActual() == EJECUCION && !archivo_terminado){
-            
-            if (!miControladorCNC.comandoEnEjecucion() && !esperando_fin_movimiento) {
-                String linea_gcode = gestor.leerLineaNoBloqueante();
-                
-                if (linea_gcode.length() > 0) {
-                    linea_gcode.toCharArray(linea_gcode_buffer, sizeof(linea_gcode_buffer));
-                    
-                    #if MODO_DESARROLLADOR
-                    Serial.print(F("Procesando línea: "));
-                    Serial.println(linea_gcode_buffer);
-                    #endif
-                    
-                    if (miInterpreteGcode.procesarComando(linea_gcode)) {
-                        comando_actual = miInterpreteGcode.obtenerComandoActual();
-                        
-                        miControladorCNC.establecerComando(comando_actual);
-                        if (miControladorCNC.ejecutarComando()) {
-                            esperando_fin_movimiento = true;
-                            #if MODO_DESARROLLADOR
-                            Serial.println(F("[Main] Comando enviado a CNC"));
-                            #endif
-                        }
-                    }
-                } else {
-                    archivo_terminado = true;
-                    strcpy(linea_gcode_buffer, "FIN ARCHIVO");
-                    #if MODO_DESARROLLADOR
-                    Serial.println(F("Fin del archivo"));
-                    #endif
-                    gestor.cerrarArchivo();
-                }
-            } 
-            else if (esperando_fin_movimiento && !miControladorCNC.comandoEnEjecucion()) {
-                esperando_fin_movimiento = false;
-                comando_anterior = comando_actual;
-
-                #if MODO_DESARROLLADOR
-                Serial.println(F("[Main] Movimiento completado"));
-                #endif
-                
-                delay(100);
-            }
+            miConsola.actualizar(' ', comando_anterior.x, posicion_x, comando_actual.x,
+                                comando_anterior.y, posicion_y, comando_actual.y,
+                                comando_anterior.z, posicion_z, comando_actual.z,
+                                linea_gcode_buffer, estado_cortadora_buffer);
         }
     }
    
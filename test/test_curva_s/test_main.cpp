@@ -0,0 +1,199 @@
+/**
+ * @file test_main.cpp
+ * @brief Pruebas en el ordenador de las rampas de tasa con curva S
+ *
+ * @details Se ejecutan con: pio test -e native
+ * Cada prueba arma un bloque como lo hace Planificador::calcularCurvaS() a
+ * partir de NucleoPasos::eventosRampa() y lo recorre tick a tick con
+ * NucleoPasos::tasaTick(), como GeneradorPasos::prepararSegmento(): la
+ * subida cambia la tasa al final del tick y la bajada al principio.
+ */
+
+#include <unity.h>
+
+#include "nucleo_pasos.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+/**
+ * @brief Recorre un bloque entero y comprueba la secuencia de tasas
+ * @param inicial Tasa de entrada (eventos/s)
+ * @param nominal Tasa de crucero (eventos/s)
+ * @param final Tasa de salida (eventos/s)
+ * @param incremento Incremento maximo por tick (Q16.16)
+ * @param sobreaceleracion Cambio del incremento por tick (Q16.16, 0 = trapecio)
+ * @param crucero Eventos a tasa nominal entre las dos rampas
+ */
+static void recorrerBloque(uint32_t inicial, uint32_t nominal, uint32_t final,
+                           uint32_t incremento, uint32_t sobreaceleracion, uint32_t crucero) {
+    BloquePasos bloque;
+    bloque.tasa_inicial = inicial * UNO_Q16;
+    bloque.tasa_nominal = nominal * UNO_Q16;
+    bloque.tasa_final = final * UNO_Q16;
+    bloque.incremento_tasa = incremento;
+    bloque.incremento_aceleracion = sobreaceleracion;
+    bloque.acelerar_hasta = NucleoPasos::eventosRampa(bloque.tasa_inicial, bloque.tasa_nominal,
+                                                      incremento, sobreaceleracion);
+    const uint32_t bajada = NucleoPasos::eventosRampa(bloque.tasa_nominal, bloque.tasa_final,
+                                                      incremento, sobreaceleracion);
+    bloque.eventos = bloque.acelerar_hasta + crucero + bajada;
+    bloque.desacelerar_desde = bloque.eventos - bajada;
+
+    RampaTasa rampa;
+    rampa.tasa = bloque.tasa_inicial;
+    uint32_t incremento_anterior = 0;
+    uint32_t tasa_anterior = bloque.tasa_inicial;
+    uint32_t resto = 0;
+    uint32_t hechos = 0;
+    bool alcanzo_nominal = (bloque.tasa_inicial == bloque.tasa_nominal);
+
+    while (hechos < bloque.eventos) {
+        bool subiendo = hechos < bloque.acelerar_hasta;
+        bool bajando = !subiendo && hechos >= bloque.desacelerar_desde;
+        if (!subiendo && !bajando) {
+            TEST_ASSERT_EQUAL_UINT32(bloque.tasa_nominal, rampa.tasa);
+        }
+        if (bajando && !rampa.desacelerando) {
+            // La bajada arranca con aceleracion nula
+            incremento_anterior = 0;
+        }
+        uint32_t limite_fase;
+        uint32_t tasa_segmento = NucleoPasos::tasaTick(bloque, hechos, rampa, limite_fase);
+        if (subiendo) {
+            TEST_ASSERT_EQUAL_UINT32(bloque.acelerar_hasta, limite_fase);
+            TEST_ASSERT_TRUE_MESSAGE(tasa_segmento >= tasa_anterior, "la subida no es monotona");
+        } else if (bajando) {
+            TEST_ASSERT_EQUAL_UINT32(bloque.eventos, limite_fase);
+            TEST_ASSERT_TRUE_MESSAGE(tasa_segmento <= tasa_anterior, "la bajada no es monotona");
+            TEST_ASSERT_TRUE_MESSAGE(tasa_segmento >= bloque.tasa_final, "la bajada paso de la tasa final");
+        } else {
+            TEST_ASSERT_EQUAL_UINT32(bloque.desacelerar_desde, limite_fase);
+        }
+
+        // La tasa nunca pasa de la nominal ni cambia mas de un incremento por tick
+        TEST_ASSERT_TRUE(tasa_segmento <= bloque.tasa_nominal);
+        uint32_t cambio = (tasa_segmento > tasa_anterior) ? tasa_segmento - tasa_anterior :
+                                                            tasa_anterior - tasa_segmento;
+        TEST_ASSERT_TRUE_MESSAGE(cambio <= incremento, "la aceleracion supero la maxima");
+        if (sobreaceleracion != 0 && (subiendo || bajando)) {
+            // En las rampas la aceleracion cambia como mucho un paso de sobreaceleracion por tick
+            uint32_t salto = (rampa.incremento > incremento_anterior) ? rampa.incremento - incremento_anterior :
+                                                                        incremento_anterior - rampa.incremento;
+            TEST_ASSERT_TRUE_MESSAGE(salto <= sobreaceleracion, "la aceleracion cambio de golpe");
+        }
+        incremento_anterior = rampa.incremento;
+        tasa_anterior = tasa_segmento;
+
+        resto += tasa_segmento / TICKS_ACELERACION_POR_SEGUNDO;
+        uint32_t eventos_tick = enteroQ16(resto);
+        resto &= (UNO_Q16 - 1);
+        if (eventos_tick == 0) {
+            eventos_tick = 1;
+        }
+        if (eventos_tick > limite_fase - hechos) {
+            eventos_tick = limite_fase - hechos;
+        }
+        hechos += eventos_tick;
+
+        if (hechos == bloque.acelerar_hasta) {
+            // La subida termina justo en la tasa nominal
+            TEST_ASSERT_EQUAL_UINT32(bloque.tasa_nominal, rampa.tasa);
+            alcanzo_nominal = true;
+        }
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(alcanzo_nominal, "no se llego a la tasa nominal");
+    TEST_ASSERT_EQUAL_UINT32(bloque.eventos, hechos);
+    TEST_ASSERT_EQUAL_UINT32(bloque.tasa_final, rampa.tasa);
+    TEST_ASSERT_EQUAL_UINT32(bloque.tasa_final, tasa_anterior);
+}
+
+/** Aceleracion de 160 eventos/s por tick y sobreaceleracion de 8 eventos/s por tick^2 */
+#define INCREMENTO_PRUEBA (160UL * UNO_Q16)
+#define SOBREACELERACION_PRUEBA (8UL * UNO_Q16)
+
+void test_curva_s_desde_parado() {
+    recorrerBloque(TASA_MINIMA_EVENTOS, 4000, TASA_MINIMA_EVENTOS, INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA, 2500);
+}
+
+void test_curva_s_entre_bloques() {
+    recorrerBloque(1500, 6000, 2200, INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA, 700);
+}
+
+void test_curva_s_sin_crucero() {
+    recorrerBloque(TASA_MINIMA_EVENTOS, 2500, 300, INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA, 0);
+}
+
+void test_curva_s_sin_llegar_a_aceleracion_maxima() {
+    // Rampa corta: la aceleracion sube y baja sin llegar a INCREMENTO_PRUEBA
+    recorrerBloque(TASA_MINIMA_EVENTOS, 350, TASA_MINIMA_EVENTOS, INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA, 50);
+}
+
+void test_curva_s_fraccionaria() {
+    // Incrementos con parte fraccionaria: la rampa no puede acumular redondeos
+    recorrerBloque(137, 5321, 211, INCREMENTO_PRUEBA + 12345, SOBREACELERACION_PRUEBA / 3, 1000);
+}
+
+void test_trapecio() {
+    recorrerBloque(TASA_MINIMA_EVENTOS, 4000, 800, INCREMENTO_PRUEBA, 0, 1200);
+}
+
+/**
+ * @brief El incremento nunca es nulo ni pasa del maximo
+ */
+void test_incremento_acotado() {
+    uint32_t incremento = 0;
+    for (uint32_t falta = 3000UL * UNO_Q16; falta > 0; ) {
+        incremento = NucleoPasos::siguienteIncrementoCurvaS(incremento, falta, INCREMENTO_PRUEBA,
+                                                            SOBREACELERACION_PRUEBA);
+        TEST_ASSERT_TRUE(incremento > 0);
+        TEST_ASSERT_TRUE(incremento <= INCREMENTO_PRUEBA);
+        falta = (falta > incremento) ? falta - incremento : 0;
+    }
+}
+
+/**
+ * @brief Una rampa sin cambio de tasa no recorre eventos
+ */
+void test_rampa_nula() {
+    TEST_ASSERT_EQUAL_UINT32(0, NucleoPasos::eventosRampa(2000UL * UNO_Q16, 2000UL * UNO_Q16,
+                                                          INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA));
+}
+
+/**
+ * @brief En un bloque corto el pico buscado deja caber las dos rampas exactas
+ */
+void test_pico_bloque_corto() {
+    const uint32_t inicial = 900UL * UNO_Q16;
+    const uint32_t final = 1400UL * UNO_Q16;
+    const uint32_t nominal = 9000UL * UNO_Q16;
+    const uint32_t completo = NucleoPasos::eventosRampa(inicial, nominal, INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA) +
+                              NucleoPasos::eventosRampa(nominal, final, INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA);
+    for (uint32_t eventos = completo / 4; eventos < completo; eventos += completo / 16) {
+        uint32_t subida;
+        uint32_t bajada;
+        uint32_t pico = NucleoPasos::picoRampas(inicial, final, true, final, nominal, eventos,
+                                                INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA, subida, bajada);
+        TEST_ASSERT_TRUE(pico >= final && pico <= nominal);
+        TEST_ASSERT_EQUAL_UINT32(NucleoPasos::eventosRampa(inicial, pico, INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA), subida);
+        TEST_ASSERT_EQUAL_UINT32(NucleoPasos::eventosRampa(pico, final, INCREMENTO_PRUEBA, SOBREACELERACION_PRUEBA), bajada);
+        TEST_ASSERT_TRUE_MESSAGE(subida + bajada <= eventos, "las rampas no caben en el bloque");
+        TEST_ASSERT_TRUE_MESSAGE(subida + bajada > eventos - eventos / 8, "el pico se quedo corto");
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_curva_s_desde_parado);
+    RUN_TEST(test_curva_s_entre_bloques);
+    RUN_TEST(test_curva_s_sin_crucero);
+    RUN_TEST(test_curva_s_sin_llegar_a_aceleracion_maxima);
+    RUN_TEST(test_curva_s_fraccionaria);
+    RUN_TEST(test_trapecio);
+    RUN_TEST(test_incremento_acotado);
+    RUN_TEST(test_rampa_nula);
+    RUN_TEST(test_pico_bloque_corto);
+    return UNITY_END();
+}
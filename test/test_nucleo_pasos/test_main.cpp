@@ -0,0 +1,213 @@
+/**
+ * @file test_main.cpp
+ * @brief Pruebas en el ordenador del nucleo Bresenham/AMASS de GeneradorPasos
+ *
+ * @details Se ejecutan con: pio test -e native
+ * Cada prueba carga un bloque en NucleoPasos, recorre todas sus interrupciones
+ * y comprueba los pasos de cada eje y como se intercalan con los del eje
+ * dominante: tras cada interrupcion ningun eje puede estar a mas de medio paso
+ * de la recta ideal.
+ */
+
+#include <unity.h>
+#include <math.h>
+
+#include "nucleo_pasos.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+/**
+ * @brief Ejecuta un bloque completo con un nivel AMASS fijo y comprueba su traza
+ * @param pasos Pasos de cada eje
+ * @param direccion Bit n a 1 si el eje n va en sentido negativo
+ * @param nivel_amass Nivel de sobremuestreo de todos los segmentos
+ */
+static void comprobarRecta(const uint32_t pasos[NUM_EJES], uint8_t direccion, uint8_t nivel_amass) {
+    uint32_t eventos = 0;
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        if (pasos[i] > eventos) {
+            eventos = pasos[i];
+        }
+    }
+
+    NucleoPasos nucleo;
+    nucleo.iniciarBloque(pasos, eventos, direccion, false);
+    nucleo.ajustarNivel(pasos, nivel_amass);
+
+    uint32_t interrupciones = eventos << nivel_amass;
+    uint32_t emitidos[NUM_EJES] = {0, 0, 0};
+    for (uint32_t n = 1; n <= interrupciones; n++) {
+        uint8_t mascara = nucleo.calcularEvento();
+        for (uint8_t i = 0; i < NUM_EJES; i++) {
+            if (mascara & (1 << i)) {
+                emitidos[i]++;
+            }
+            // Pasos que lleva la recta ideal tras n interrupciones
+            double ideal = static_cast<double>(n) * pasos[i] / interrupciones;
+            TEST_ASSERT_TRUE_MESSAGE(fabs(emitidos[i] - ideal) <= 0.5 + 1e-9,
+                                     "un eje se separo mas de medio paso de la recta");
+        }
+    }
+
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        TEST_ASSERT_EQUAL_UINT32(pasos[i], emitidos[i]);
+        TEST_ASSERT_EQUAL_UINT32(0, nucleo.pasosRestantes(i));
+        int32_t esperada = (direccion & (1 << i)) ? -static_cast<int32_t>(pasos[i]) :
+                                                      static_cast<int32_t>(pasos[i]);
+        TEST_ASSERT_EQUAL_INT32(esperada, nucleo.posicionEje(i));
+    }
+}
+
+void test_recta_dos_ejes() {
+    const uint32_t pasos[NUM_EJES] = {100, 37, 0};
+    comprobarRecta(pasos, 0, 0);
+}
+
+void test_diagonal_tres_ejes() {
+    const uint32_t pasos[NUM_EJES] = {7, 7, 7};
+    comprobarRecta(pasos, 0, 0);
+}
+
+void test_dominante_z_con_direccion_negativa() {
+    const uint32_t pasos[NUM_EJES] = {3, 0, 250};
+    comprobarRecta(pasos, (1 << EJE_X) | (1 << EJE_Z), 0);
+}
+
+void test_ejes_casi_iguales() {
+    const uint32_t pasos[NUM_EJES] = {1000, 999, 1};
+    comprobarRecta(pasos, 1 << EJE_Y, 0);
+}
+
+void test_un_solo_paso() {
+    const uint32_t pasos[NUM_EJES] = {1, 1, 0};
+    comprobarRecta(pasos, 0, 0);
+}
+
+void test_amass_intercala_ejes_secundarios() {
+    const uint32_t pasos[NUM_EJES] = {100, 37, 5};
+    for (uint8_t nivel = 1; nivel <= NIVEL_MAXIMO_AMASS; nivel++) {
+        comprobarRecta(pasos, 0, nivel);
+    }
+}
+
+/**
+ * @brief Con AMASS el eje dominante pasa exactamente una de cada 2^nivel interrupciones
+ */
+void test_amass_ritmo_dominante() {
+    const uint32_t pasos[NUM_EJES] = {40, 13, 0};
+    NucleoPasos nucleo;
+    nucleo.iniciarBloque(pasos, 40, 0, false);
+    nucleo.ajustarNivel(pasos, 2);
+
+    uint32_t ultima = 0;
+    for (uint32_t n = 1; n <= (40UL << 2); n++) {
+        if (nucleo.calcularEvento() & (1 << EJE_X)) {
+            if (ultima != 0) {
+                TEST_ASSERT_EQUAL_UINT32(4, n - ultima);
+            }
+            ultima = n;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, nucleo.pasosRestantes(EJE_X));
+}
+
+/**
+ * @brief Cambiar de nivel entre segmentos no pierde ni duplica pasos
+ */
+void test_cambio_de_nivel_entre_segmentos() {
+    const uint32_t pasos[NUM_EJES] = {60, 25, 11};
+    NucleoPasos nucleo;
+    nucleo.iniciarBloque(pasos, 60, 0, false);
+
+    // 20 eventos a nivel 3, 20 a nivel 1 y 20 sin sobremuestreo
+    const uint8_t niveles[3] = {3, 1, 0};
+    uint32_t emitidos[NUM_EJES] = {0, 0, 0};
+    for (uint8_t s = 0; s < 3; s++) {
+        nucleo.ajustarNivel(pasos, niveles[s]);
+        for (uint32_t n = 0; n < (20UL << niveles[s]); n++) {
+            uint8_t mascara = nucleo.calcularEvento();
+            for (uint8_t i = 0; i < NUM_EJES; i++) {
+                if (mascara & (1 << i)) {
+                    emitidos[i]++;
+                }
+            }
+        }
+        // Al final de cada segmento han pasado (s + 1) / 3 del bloque
+        for (uint8_t i = 0; i < NUM_EJES; i++) {
+            double ideal = pasos[i] * (s + 1) / 3.0;
+            TEST_ASSERT_TRUE(fabs(emitidos[i] - ideal) <= 0.5 + 1e-9);
+        }
+    }
+    for (uint8_t i = 0; i < NUM_EJES; i++) {
+        TEST_ASSERT_EQUAL_UINT32(pasos[i], emitidos[i]);
+    }
+}
+
+/**
+ * @brief Un eje bloqueado no pulsa ni mueve su posicion, pero el bloque termina igual
+ */
+void test_eje_bloqueado() {
+    const uint32_t pasos[NUM_EJES] = {50, 20, 0};
+    NucleoPasos nucleo;
+    nucleo.fijarPosicion(EJE_Y, 500);
+    nucleo.iniciarBloque(pasos, 50, 0, false);
+    nucleo.ajustarNivel(pasos, 0);
+
+    uint32_t pulsos_y = 0;
+    for (uint32_t n = 0; n < 25; n++) {
+        nucleo.calcularEvento();
+    }
+    int32_t y_bloqueo = nucleo.posicionEje(EJE_Y);
+    nucleo.bloquear(1 << EJE_Y);
+    for (uint32_t n = 25; n < 50; n++) {
+        if (nucleo.calcularEvento() & (1 << EJE_Y)) {
+            pulsos_y++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, pulsos_y);
+    TEST_ASSERT_EQUAL_INT32(510, y_bloqueo);
+    TEST_ASSERT_EQUAL_INT32(510, nucleo.posicionEje(EJE_Y));
+    TEST_ASSERT_EQUAL_INT32(50, nucleo.posicionEje(EJE_X));
+    TEST_ASSERT_EQUAL_UINT32(0, nucleo.pasosRestantes(EJE_Y));
+}
+
+/**
+ * @brief Los pasos de compensacion de holgura se emiten sin contar en la posicion
+ */
+void test_compensacion_no_mueve_posicion() {
+    const uint32_t pasos[NUM_EJES] = {8, 0, 3};
+    NucleoPasos nucleo;
+    nucleo.iniciarBloque(pasos, 8, 1 << EJE_X, true);
+    nucleo.ajustarNivel(pasos, 0);
+
+    uint32_t pulsos[NUM_EJES] = {0, 0, 0};
+    for (uint32_t n = 0; n < 8; n++) {
+        uint8_t mascara = nucleo.calcularEvento();
+        for (uint8_t i = 0; i < NUM_EJES; i++) {
+            if (mascara & (1 << i)) {
+                pulsos[i]++;
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(8, pulsos[EJE_X]);
+    TEST_ASSERT_EQUAL_UINT32(3, pulsos[EJE_Z]);
+    TEST_ASSERT_EQUAL_INT32(0, nucleo.posicionEje(EJE_X));
+    TEST_ASSERT_EQUAL_INT32(0, nucleo.posicionEje(EJE_Z));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_recta_dos_ejes);
+    RUN_TEST(test_diagonal_tres_ejes);
+    RUN_TEST(test_dominante_z_con_direccion_negativa);
+    RUN_TEST(test_ejes_casi_iguales);
+    RUN_TEST(test_un_solo_paso);
+    RUN_TEST(test_amass_intercala_ejes_secundarios);
+    RUN_TEST(test_amass_ritmo_dominante);
+    RUN_TEST(test_cambio_de_nivel_entre_segmentos);
+    RUN_TEST(test_eje_bloqueado);
+    RUN_TEST(test_compensacion_no_mueve_posicion);
+    return UNITY_END();
+}